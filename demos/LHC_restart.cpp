@@ -8,6 +8,8 @@
 #include <blond/beams/Beams.h>
 #include <blond/beams/Distributions.h>
 #include <blond/beams/Slices.h>
+#include <blond/binary_io.h>
+#include <blond/checkpoint.h>
 #include <blond/globals.h>
 #include <blond/input_parameters/GeneralParameters.h>
 #include <blond/input_parameters/RfParameters.h>
@@ -35,6 +37,9 @@ uint N_t = 1000000;      // Number of turns to track; full ramp: 8700001
 double bl_target = 1.25e-9; // 4 sigma r.m.s. target bunch length in [s]
 
 int N_slices = 151;
+// Save a snapshot every so many turns, 0 for never
+int checkpoint_every = 0;
+const std::string checkpoint_file = "LHC_restart.ckp";
 const std::string datafiles = DEMO_FILES "/LHC_restart/";
 
 // Global variables
@@ -72,9 +77,9 @@ int main(int argc, char **argv)
     timespec begin, end;
     util::get_time(begin);
 
+    // The input files can be text or binary, see binary_io::convert
     f_vector_2d_t momentumVec(1, f_vector_t());
-    util::read_vector_from_file(momentumVec[0],
-                                datafiles + "LHC_momentum_programme");
+    binary_io::read(momentumVec[0], datafiles + "LHC_momentum_programme");
 
     // optional
     momentumVec[0].erase(momentumVec[0].begin(),
@@ -130,7 +135,7 @@ int main(int argc, char **argv)
 
     auto Beam = Context::Beam;
     f_vector_t v2;
-    util::read_vector_from_file(v2, datafiles + "coords_13000001.dat");
+    binary_io::read(v2, datafiles + "coords_13000001.dat");
     int k = 0;
     for (unsigned int i = 0; i < v2.size(); i += 3) {
         Beam->dt[k] = v2[i] * 1e-9;    // [s]
@@ -173,9 +178,15 @@ int main(int argc, char **argv)
            4. * Beam->sigma_dt);
     // print("Initial Gaussian bunch length %.4e ns" %slices.bl_gauss
 
+    // Continue from the last snapshot, if there is one
+    auto checkpoint = new Checkpoint(checkpoint_file, checkpoint_every, RfP,
+                                     Beam, Slice, PL);
+    if (checkpoint_every > 0 && checkpoint->restore())
+        printf("Restored the snapshot of turn %d\n", RfP->counter);
+
     printf("Ready for tracking!\n");
 
-    for (uint i = 0; i < N_t; ++i) {
+    for (uint i = RfP->counter; i < N_t; ++i) {
 
         printf("\nTurn %d\n", i);
 
@@ -192,6 +203,8 @@ int main(int argc, char **argv)
         long_tracker->track();
         track_time += util::time_elapsed(begin_t);
 
+        checkpoint->track();
+
         printf("   RF phase %.6e rad\n", RfP->dphi_rf[0]);
         printf("   PL phase correction %.6e rad\n", PL->dphi);
         // RfP->counter++;
@@ -209,6 +222,7 @@ int main(int argc, char **argv)
     util::dump(Beam->dt.data(), 10, "dt\n");
     util::dump(Slice->n_macroparticles.data(), 10, "n_macroparticles\n");
 
+    delete checkpoint;
     delete PL;
     delete Slice;
     delete long_tracker;
@@ -231,6 +245,7 @@ void parse_args(int argc, char **argv)
         N_TURNS,
         N_PARTICLES,
         N_SLICES,
+        CHECKPOINT,
         OPTIONS_NUM
     };
 
@@ -260,11 +275,19 @@ void parse_args(int argc, char **argv)
             N_THREADS, 0, "m", "threads", util::Arg::Numeric,
             "  --threads=<num>,     -m <num>  Number of threads (default: 1)"
         },
+        {
+            CHECKPOINT, 0, "c", "checkpoint", util::Arg::Numeric,
+            "  --checkpoint=<num>,  -c <num>  Save a snapshot every <num> "
+            "turns\n"
+            "                                 and restart from it (default: "
+            "never)"
+        },
         {
             UNKNOWN, 0, "", "", Arg::None,
             "\nExamples:\n"
             "\t./LHC_restart\n"
             "\t./LHC_restart -t 1000000 -p 100000 -m 4\n"
+            "\t./LHC_restart -t 1000000 -c 10000\n"
         },
         {0, 0, 0, 0, 0, 0}
     };
@@ -303,6 +326,9 @@ void parse_args(int argc, char **argv)
                 N_p = atoi(opt.arg);
                 // fprintf(stdout, "--numeric with argument '%s'\n", opt.arg);
                 break;
+            case CHECKPOINT:
+                checkpoint_every = atoi(opt.arg);
+                break;
             case UNKNOWN:
                 // not possible because Arg::Unknown returns ARG_ILLEGAL
                 // which aborts the parse with an error
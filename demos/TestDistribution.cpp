@@ -97,9 +97,9 @@ int main(int argc, char **argv)
     //     time[i] = 1.0 * (i + 1);
     // plot_voltage_programme(time, voltageVec[0]);
     string h5file = "bunch.h5";
-    auto bunchmonitor = BunchMonitor(GP, RfP, Beam, h5file,
-                                     buffer_time, nullptr, nullptr, nullptr,
-                                     compression_level);
+    BunchMonitor bunchmonitor(GP, RfP, Beam, h5file,
+                              buffer_time, nullptr, nullptr, nullptr,
+                              compression_level);
 
     // auto tracker = RingAndRfSection();
 
@@ -52,12 +52,19 @@ public:
     //                        const double dE_max, int* __restrict id);
 
     void statistics();
+    // Mean dE of the alive particles with dt_min < dt < dt_max, 0 if there
+    // are none. With_statistics also updates the statistics() of the beam,
+    // in the same pass over the particles.
+    double mean_dE_in_window(const double dt_min, const double dt_max,
+                             const bool with_statistics = false);
 
 private:
     void statistics(const double *__restrict dE,
                     const double *__restrict dt,
                     const int *__restrict id,
-                    const int size);
+                    const int size,
+                    const double dt_min = 0, const double dt_max = 0,
+                    double *window_mean_dE = NULL);
 };
 
 #endif /* BEAMS_BEAMS_H_ */
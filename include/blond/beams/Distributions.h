@@ -63,6 +63,8 @@ struct multi_t {
 };
 
 
+// The induced potential iterations stop early once the relative change of
+// the potential between two of them is below sse_tolerance
 line_density_t
 matched_from_line_density(Beams *beam,
                           FullRingAndRf *full_ring,
@@ -76,9 +78,12 @@ matched_from_line_density(Beams *beam,
                           std::map<std::string, f_vector_t> extraVoltageDict =
                               std::map<std::string, f_vector_t>(),
                           int n_iterations_input = 100,
-                          int seed = 0);
+                          int seed = 0,
+                          double sse_tolerance = 1e-12);
 
 
+// n_points_grid is the resolution of the time and energy grid the
+// distribution is generated on
 distribution_denstity_t
 matched_from_distribution_density(Beams *beam,
                                   FullRingAndRf *full_ring,
@@ -89,7 +94,8 @@ matched_from_distribution_density(Beams *beam,
                                   std::map<std::string, f_vector_t> extraVoltageDict =
                                       std::map<std::string, f_vector_t>(),
                                   int n_iterations_input = 1,
-                                  int seed = 0);
+                                  int seed = 0,
+                                  int n_points_grid = 1000);
 
 
 /*
@@ -102,6 +108,8 @@ void matched_from_distribution_density(FullRingAndRf *full_ring,
                                        int seed = 0);
 */
 
+// With seed >= 0 the beam depends on the seed only, not on the number of
+// threads. seed < 0 takes the normal numbers of the test files.
 void longitudinal_bigaussian(GeneralParameters *GP, RfParameters *RfP,
                              Beams *Beam, double sigma_dt, double sigma_dE = 0,
                              int seed = 0, bool reinsertion = false);
@@ -0,0 +1,103 @@
+/*
+ * binary_io.h
+ *
+ *  Binary files of doubles, memory-mapped, and parallel text parsing
+ */
+
+#ifndef INCLUDE_BLOND_BINARY_IO_H_
+#define INCLUDE_BLOND_BINARY_IO_H_
+
+#include <blond/configuration.h>
+#include <blond/utilities.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace binary_io {
+
+    // A binary file is this header followed by the size doubles, in the
+    // byte order of the machine that wrote it. columns is the number of
+    // values per record, e.g. 3 for the (dt, dE, id) coordinates.
+    struct header_t {
+        char magic[8];
+        uint64_t version;
+        uint64_t size;
+        uint64_t columns;
+    };
+
+    // A whole file, mapped into memory read-only. Nothing is read before
+    // it is used. Where the file can not be mapped it is read into memory.
+    class API MappedFile {
+    public:
+        MappedFile(const std::string &file);
+        MappedFile(MappedFile &&other);
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        ~MappedFile();
+
+        const char *data() const { return fData; }
+        size_t size() const { return fSize; }
+
+    private:
+        void *fMap;
+        const char *fData;
+        size_t fSize;
+        std::vector<char> fBuffer;
+    };
+
+    // Read-only view of the values of a binary file
+    class API MappedVector {
+    public:
+        typedef const double *const_iterator;
+
+        MappedVector(const std::string &file);
+        MappedVector(MappedVector &&other)
+            : fFile(std::move(other.fFile)), fData(other.fData),
+              fSize(other.fSize), fColumns(other.fColumns)
+        {
+            other.fData = nullptr;
+            other.fSize = 0;
+        }
+
+        const double *data() const { return fData; }
+        size_t size() const { return fSize; }
+        bool empty() const { return fSize == 0; }
+        size_t columns() const { return fColumns; }
+        double operator[](const size_t i) const { return fData[i]; }
+        const_iterator begin() const { return fData; }
+        const_iterator end() const { return fData + fSize; }
+        f_vector_t vector() const { return f_vector_t(begin(), end()); }
+
+    private:
+        MappedFile fFile;
+        const double *fData;
+        size_t fSize;
+        size_t fColumns;
+    };
+
+    // True if file starts with the header of a binary file
+    API bool is_binary(const std::string &file);
+
+    API bool write(const std::string &file, const double *v, const size_t n,
+                   const size_t columns = 1);
+    static inline bool write(const std::string &file, const f_vector_t &v,
+                             const size_t columns = 1)
+    {
+        return write(file, v.data(), v.size(), columns);
+    }
+
+    // All the numbers of a text file, like util::read_vector_from_file.
+    // The file is split among the threads at whitespace, the parts are
+    // parsed in parallel and joined in order.
+    API void read_text(f_vector_t &v, const std::string &file);
+
+    // Reads a binary or a text file
+    API void read(f_vector_t &v, const std::string &file);
+
+    // Writes the numbers of a text file to a binary file
+    API bool convert(const std::string &text_file,
+                     const std::string &binary_file,
+                     const size_t columns = 1);
+}
+
+#endif /* INCLUDE_BLOND_BINARY_IO_H_ */
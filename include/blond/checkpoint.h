@@ -0,0 +1,99 @@
+/*
+ * checkpoint.h
+ *
+ *  Snapshot of the tracking state, to restart a simulation
+ */
+
+#ifndef INCLUDE_BLOND_CHECKPOINT_H_
+#define INCLUDE_BLOND_CHECKPOINT_H_
+
+#include <blond/beams/Beams.h>
+#include <blond/beams/Slices.h>
+#include <blond/configuration.h>
+#include <blond/globals.h>
+#include <blond/input_parameters/RfParameters.h>
+#include <blond/llrf/LHCNoiseFB.h>
+#include <blond/llrf/PhaseLoop.h>
+#include <blond/utilities.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+class SlicesMonitor;
+class BunchMonitor;
+class PhaseSpaceMonitor;
+class TotalInducedVoltage;
+
+// Saves the state that changes while tracking to one binary file, and
+// restores it into the same objects, built the same way, in a new run:
+// - Beam dt, dE, id and lost particles
+// - RfP counter, phi_rf, omega_rf, dphi_rf and dphi_rf_steering
+// - the PhaseLoop state, see PhaseLoop::checkpoint()
+// - the LHCNoiseFB scaling factor and measured bunch lengths
+// - the Slices cuts and profile
+// - the TotalInducedVoltage turn and voltage, with the multi-turn memory
+// - the turn of the monitors. Their files are new after a restart, the
+//   turns before it are in the files of the previous run.
+// The snapshot is mapped into memory and copied into the objects in
+// parallel. It is written next to the file and then renamed over it, so a
+// run stopped while saving leaves the previous snapshot.
+class API Checkpoint {
+public:
+    std::string fFileName;
+    // save() every fEvery turns in track(), 0 for never
+    int fEvery;
+    RfParameters *fRfP;
+    Beams *fBeam;
+    Slices *fSlices;
+    PhaseLoop *fPL;
+    LHCNoiseFB *fNoiseFB;
+    SlicesMonitor *fSlicesMonitor;
+    BunchMonitor *fBunchMonitor;
+    TotalInducedVoltage *fTotalInducedVoltage;
+    PhaseSpaceMonitor *fPhaseSpaceMonitor;
+
+    // Call after every turn
+    void track();
+    bool save();
+    // false if there is no snapshot
+    bool restore();
+
+    // State to save, by name
+    void add(const std::string &name, double &x);
+    void add(const std::string &name, int &x);
+    void add(const std::string &name, uint &x);
+    void add(const std::string &name, f_vector_t &v);
+    void add(const std::string &name, int_vector_t &v);
+    void add(const std::string &name, f_vector_2d_t &v);
+    // All the values of a stored array, the written turns of a lazy one
+    void add(const std::string &name, TurnArray &a);
+    void add(const std::string &name, std::vector<TurnArray> &v);
+
+    Checkpoint(std::string filename, int every = 0,
+               RfParameters *RfP = Context::RfP, Beams *Beam = Context::Beam,
+               Slices *Slices = NULL, PhaseLoop *PL = NULL,
+               LHCNoiseFB *noiseFB = NULL, SlicesMonitor *slicesMonitor = NULL,
+               BunchMonitor *bunchMonitor = NULL,
+               TotalInducedVoltage *totalInducedVoltage = NULL,
+               PhaseSpaceMonitor *phaseSpaceMonitor = NULL);
+    ~Checkpoint();
+
+private:
+    enum type_t { float64, int32, uint32 };
+    struct entry_t {
+        std::string name;
+        type_t type;
+        std::function<void *()> data;
+        std::function<size_t()> size;
+        std::function<void(size_t)> resize;
+    };
+    std::vector<entry_t> fEntries;
+
+    template <typename T>
+    void add_scalar(const std::string &name, T &x, type_t type);
+    template <typename T>
+    void add_vector(const std::string &name, std::vector<T> &v,
+                    type_t type);
+};
+
+#endif /* INCLUDE_BLOND_CHECKPOINT_H_ */
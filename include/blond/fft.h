@@ -10,11 +10,17 @@
 
 #include <algorithm>
 #include <blond/configuration.h>
+#include <blond/math_functions.h>
 #include <blond/utilities.h>
 #include <cassert>
 #include <cmath>
 #include <fftw3.h>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
 #include <blond/openmp.h>
 
 namespace fft {
@@ -32,6 +38,7 @@ namespace fft {
     // FFTW_DESTROY_INPUT : use the original input to store arbitaty data.
     // May yield better performance but the input is not usable any more.
     // Can be combined with all the above
+    // Default planner flags, can be changed with set_planner_flags()
     const uint FFTW_FLAGS = FFTW_ESTIMATE | FFTW_DESTROY_INPUT;
     // const uint FFTW_FLAGS = FFTW_ESTIMATE;// | FFTW_DESTROY_INPUT;
     // const uint ELEMS_PER_THREAD_FFT = 10000;
@@ -39,17 +46,282 @@ namespace fft {
 
     enum fft_type_t { FFT, IFFT, RFFT, IRFFT };
 
-    struct API fft_plan_t {
-        fftw_plan p; // fftw_plan
+    // Precision of the transforms. Single precision uses the fftwf plans,
+    // about twice as fast with half the memory.
+    enum precision_t { double_precision, single_precision };
+
+    // The fftw functions of each precision, T is the real type
+    template <typename T> struct fftw_traits;
+
+    template <> struct fftw_traits<double> {
+        typedef fftw_plan plan_t;
+        typedef fftw_complex fftw_complex_t;
+
+        static void *malloc(size_t bytes) { return fftw_malloc(bytes); }
+        static void free(void *p) { fftw_free(p); }
+        static void destroy_plan(plan_t p) { fftw_destroy_plan(p); }
+        static int alignment_of(double *p) { return fftw_alignment_of(p); }
+
+        static void plan_with_nthreads(const int threads)
+        {
+#ifdef USE_FFTW_OMP
+            if (threads > 1) {
+                fftw_init_threads();
+                fftw_plan_with_nthreads(threads);
+            }
+#endif
+        }
+
+        static plan_t plan_dft_1d(int n, fftw_complex_t *in,
+                                  fftw_complex_t *out, int sign, unsigned flags)
+        {
+            return fftw_plan_dft_1d(n, in, out, sign, flags);
+        }
+
+        static plan_t plan_dft_r2c_1d(int n, double *in, fftw_complex_t *out,
+                                      unsigned flags)
+        {
+            return fftw_plan_dft_r2c_1d(n, in, out, flags);
+        }
+
+        static plan_t plan_dft_c2r_1d(int n, fftw_complex_t *in, double *out,
+                                      unsigned flags)
+        {
+            return fftw_plan_dft_c2r_1d(n, in, out, flags);
+        }
+
+        static plan_t plan_many_dft_c2r(int n, int howmany, fftw_complex_t *in,
+                                        double *out, unsigned flags)
+        {
+            return fftw_plan_many_dft_c2r(1, &n, howmany, in, NULL, 1,
+                                          n / 2 + 1, out, NULL, 1, n, flags);
+        }
+
+        static void execute_dft(plan_t p, fftw_complex_t *in,
+                                fftw_complex_t *out)
+        {
+            fftw_execute_dft(p, in, out);
+        }
+
+        static void execute_dft_r2c(plan_t p, double *in, fftw_complex_t *out)
+        {
+            fftw_execute_dft_r2c(p, in, out);
+        }
+
+        static void execute_dft_c2r(plan_t p, fftw_complex_t *in, double *out)
+        {
+            fftw_execute_dft_c2r(p, in, out);
+        }
+    };
+
+    template <> struct fftw_traits<float> {
+        typedef fftwf_plan plan_t;
+        typedef fftwf_complex fftw_complex_t;
+
+        static void *malloc(size_t bytes) { return fftwf_malloc(bytes); }
+        static void free(void *p) { fftwf_free(p); }
+        static void destroy_plan(plan_t p) { fftwf_destroy_plan(p); }
+        static int alignment_of(float *p) { return fftwf_alignment_of(p); }
+
+        static void plan_with_nthreads(const int threads)
+        {
+#ifdef USE_FFTW_OMP
+            if (threads > 1) {
+                fftwf_init_threads();
+                fftwf_plan_with_nthreads(threads);
+            }
+#endif
+        }
+
+        static plan_t plan_dft_1d(int n, fftw_complex_t *in,
+                                  fftw_complex_t *out, int sign, unsigned flags)
+        {
+            return fftwf_plan_dft_1d(n, in, out, sign, flags);
+        }
+
+        static plan_t plan_dft_r2c_1d(int n, float *in, fftw_complex_t *out,
+                                      unsigned flags)
+        {
+            return fftwf_plan_dft_r2c_1d(n, in, out, flags);
+        }
+
+        static plan_t plan_dft_c2r_1d(int n, fftw_complex_t *in, float *out,
+                                      unsigned flags)
+        {
+            return fftwf_plan_dft_c2r_1d(n, in, out, flags);
+        }
+
+        static plan_t plan_many_dft_c2r(int n, int howmany, fftw_complex_t *in,
+                                        float *out, unsigned flags)
+        {
+            return fftwf_plan_many_dft_c2r(1, &n, howmany, in, NULL, 1,
+                                           n / 2 + 1, out, NULL, 1, n, flags);
+        }
+
+        static void execute_dft(plan_t p, fftw_complex_t *in,
+                                fftw_complex_t *out)
+        {
+            fftwf_execute_dft(p, in, out);
+        }
+
+        static void execute_dft_r2c(plan_t p, float *in, fftw_complex_t *out)
+        {
+            fftwf_execute_dft_r2c(p, in, out);
+        }
+
+        static void execute_dft_c2r(plan_t p, fftw_complex_t *in, float *out)
+        {
+            fftwf_execute_dft_c2r(p, in, out);
+        }
+    };
+
+    template <typename T>
+    struct API basic_fft_plan_t {
+        typename fftw_traits<T>::plan_t p; // fftw_plan or fftwf_plan
         uint n;      // size of the fft
         fft_type_t type;
-        void *in;
-        void *out;
+        uint threads;
+        uint flags;
+        uint howmany; // number of transforms done by one execution
+        // The buffers are shared with the registry, a copy of the plan
+        // keeps them alive after destroy_plans(). The fftw plan itself is
+        // destroyed there, so the copy must not be executed afterwards.
+        std::shared_ptr<void> in;
+        std::shared_ptr<void> out;
     };
 
-    static std::vector<fft::fft_plan_t> planV;
+    typedef basic_fft_plan_t<double> fft_plan_t;
+    typedef basic_fft_plan_t<float> fftf_plan_t;
+
+    // Process-wide cache of fftw plans, shared by all translation units.
+    // Plans are keyed by (n, type, threads, flags, howmany, slot) and
+    // created once, the double and the single precision plans are kept
+    // apart. All the accesses go through a mutex, as the fftw planner is
+    // not thread-safe.
+    // The buffers of a plan are shared, so a plan must not be executed by
+    // several threads at once. The wrappers below ask for the slot of the
+    // calling thread (see plan_slot()), which gives every thread its own
+    // plans.
+    class API PlanRegistry {
+    public:
+        static PlanRegistry &instance();
+
+        // Returns the plan, creates it on the first request.
+        // With howmany > 1 the plan does howmany transforms of contiguous
+        // arrays of size n (n/2+1 for the complex side of real ffts).
+        // T is double or float.
+        // Plans of different slots have their own buffers.
+        template <typename T = double>
+        basic_fft_plan_t<T> get(uint n, fft_type_t type, uint threads,
+                                uint flags, uint howmany = 1, uint slot = 0);
+        // Destroys all the plans
+        void clear();
+        uint size();
+
+        // Slots of the threads, see plan_slot(). A released slot loses its
+        // plans and is handed out again, so threads that come and go, like
+        // the writer threads of the monitors, do not pile up plans.
+        uint acquire_slot();
+        void release_slot(uint slot);
+
+        // Planner flags of the plans created from now on.
+        // FFTW_MEASURE and FFTW_PATIENT are only worth it together
+        // with a wisdom file.
+        void set_flags(uint flags);
+        uint flags();
+
+        // Wisdom is imported from the file now, and exported to it every
+        // time a new plan is created with a flag other than FFTW_ESTIMATE,
+        // so the planning time is paid only once per size.
+        // The single precision wisdom goes to file + ".single".
+        bool set_wisdom_file(const std::string &file);
+        bool export_wisdom();
+
+    private:
+        typedef std::tuple<uint, int, uint, uint, uint, uint> plan_key_t;
+
+        std::mutex fMutex;
+        std::map<plan_key_t, fft_plan_t> fPlans;
+        std::map<plan_key_t, fftf_plan_t> fPlansSingle;
+        uint fFlags = FFTW_FLAGS;
+        std::string fWisdomFile;
+        uint fNextSlot = 0;
+        std::vector<uint> fFreeSlots;
+
+        PlanRegistry() {}
+        ~PlanRegistry();
+        PlanRegistry(const PlanRegistry &) = delete;
+        PlanRegistry &operator=(const PlanRegistry &) = delete;
+        bool export_wisdom_unlocked();
+        template <typename T>
+        std::map<plan_key_t, basic_fft_plan_t<T>> &plans();
+        template <typename T>
+        void erase_slot(uint slot);
+    };
 
+    // Choice of the padded length of an fft of target points
+    //  smallest_235: the smallest 2,3,5-smooth length, same as
+    //      mymath::next_regular (default)
+    //  smallest_fftw: the smallest length made of the radices fftw has
+    //      fast codelets for, 2,3,5,7 and at most one 11
+    //  fastest: the length with the fastest measured rfft among the
+    //      smallest_fftw lengths up to the next power of two
+    enum size_policy_t { smallest_235, smallest_fftw, fastest };
+
+    // Process-wide fft length selection. The smooth lengths are
+    // precomputed in tables. With the fastest policy every candidate
+    // length is timed once, the timings can be kept in a file so that
+    // they are measured only once per machine.
+    class API SizeSelector {
+    public:
+        static SizeSelector &instance();
+
+        // A length greater than target, like mymath::next_regular
+        uint size(uint target);
+
+        void set_policy(size_policy_t policy);
+        size_policy_t policy();
+
+        // The timings are imported from the file now, and exported to it
+        // every time new lengths are measured
+        bool set_timings_file(const std::string &file);
+        bool export_timings();
+
+        // Seconds per rfft of n points, measured on the first call
+        double timing(uint n);
+
+    private:
+        std::mutex fMutex;
+        size_policy_t fPolicy = smallest_235;
+        std::vector<uint> fSmooth235;
+        std::vector<uint> fSmoothFFTW;
+        std::map<uint, double> fTimings;
+        std::map<uint, uint> fFastest;
+        std::string fTimingsFile;
+
+        SizeSelector();
+        SizeSelector(const SizeSelector &) = delete;
+        SizeSelector &operator=(const SizeSelector &) = delete;
+        double timing_unlocked(uint n);
+        bool export_timings_unlocked();
+    };
 
+    // Padded length of an fft of target points, according to the policy
+    // set with set_size_policy()
+    static inline uint good_size(const uint target)
+    {
+        return SizeSelector::instance().size(target);
+    }
+
+    static inline void set_size_policy(const size_policy_t policy)
+    {
+        SizeSelector::instance().set_policy(policy);
+    }
+
+    static inline bool set_size_timings_file(const std::string &file)
+    {
+        return SizeSelector::instance().set_timings_file(file);
+    }
 
     static inline void real_to_complex(const std::vector<double> &in,
                                        std::vector<complex_t> &out)
@@ -91,151 +363,239 @@ namespace fft {
     }
 
     //#ifdef USE_FFTW
-    static inline fftw_plan init_fft(const int n, complex_t *in, complex_t *out,
-                                     const int sign = FFTW_FORWARD,
-                                     const unsigned flag = FFTW_ESTIMATE,
-                                     const int threads = 1)
+    template <typename T>
+    static inline typename fftw_traits<T>::plan_t
+    init_fft(const int n, std::complex<T> *in, std::complex<T> *out,
+             const int sign = FFTW_FORWARD,
+             const unsigned flag = FFTW_ESTIMATE, const int threads = 1)
     {
-#ifdef USE_FFTW_OMP
-        if (threads > 1) {
-            fftw_init_threads();
-            fftw_plan_with_nthreads(threads);
-            // std::min(
-            //     threads,
-            //     (int)((n + ELEMS_PER_THREAD_FFT - 1) / ELEMS_PER_THREAD_FFT)));
-        }
-#endif
-        fftw_complex *a, *b;
-        a = reinterpret_cast<fftw_complex *>(in);
-        b = reinterpret_cast<fftw_complex *>(out);
-        return fftw_plan_dft_1d(n, a, b, sign, flag);
+        typedef fftw_traits<T> fftw;
+        fftw::plan_with_nthreads(threads);
+        auto a = reinterpret_cast<typename fftw::fftw_complex_t *>(in);
+        auto b = reinterpret_cast<typename fftw::fftw_complex_t *>(out);
+        return fftw::plan_dft_1d(n, a, b, sign, flag);
     }
 
-    static inline fftw_plan init_rfft(const int n, double *in, complex_t *out,
-                                      const unsigned flag = FFTW_ESTIMATE,
-                                      const int threads = 1)
+    template <typename T>
+    static inline typename fftw_traits<T>::plan_t
+    init_rfft(const int n, T *in, std::complex<T> *out,
+              const unsigned flag = FFTW_ESTIMATE, const int threads = 1)
+    {
+        typedef fftw_traits<T> fftw;
+        fftw::plan_with_nthreads(threads);
+        auto b = reinterpret_cast<typename fftw::fftw_complex_t *>(out);
+        return fftw::plan_dft_r2c_1d(n, in, b, flag);
+    }
 
+    template <typename T>
+    static inline typename fftw_traits<T>::plan_t
+    init_irfft(const int n, std::complex<T> *in, T *out,
+               const unsigned flag = FFTW_ESTIMATE, const int threads = 1)
     {
-#ifdef USE_FFTW_OMP
-        if (threads > 1) {
-            fftw_init_threads();
-            fftw_plan_with_nthreads(threads);
-            // std::min(threads, (int)((n + ELEMS_PER_THREAD_RFFT - 1) /
-            //                         ELEMS_PER_THREAD_RFFT)));
-        }
-#endif
-        fftw_complex *b;
-        b = reinterpret_cast<fftw_complex *>(out);
-        return fftw_plan_dft_r2c_1d(n, in, b, flag);
+        typedef fftw_traits<T> fftw;
+        fftw::plan_with_nthreads(threads);
+        auto b = reinterpret_cast<typename fftw::fftw_complex_t *>(in);
+        return fftw::plan_dft_c2r_1d(n, b, out, flag);
     }
 
-    static inline fftw_plan init_irfft(const int n, complex_t *in, double *out,
-                                       const unsigned flag = FFTW_ESTIMATE,
-                                       const int threads = 1)
+    // howmany inverse real transforms of contiguous rows
+    template <typename T>
+    static inline typename fftw_traits<T>::plan_t
+    init_irfft_many(const int n, const int howmany, std::complex<T> *in,
+                    T *out, const unsigned flag = FFTW_ESTIMATE,
+                    const int threads = 1)
     {
-#ifdef USE_FFTW_OMP
-        if (threads > 1) {
-            fftw_init_threads();
-            fftw_plan_with_nthreads(threads);
-            // std::min(threads, (int)((n + ELEMS_PER_THREAD_FFT - 1) /
-            //                         ELEMS_PER_THREAD_FFT)));
-        }
-#endif
-        fftw_complex *b;
-        b = reinterpret_cast<fftw_complex *>(in);
-        return fftw_plan_dft_c2r_1d(n, b, out, flag);
+        typedef fftw_traits<T> fftw;
+        fftw::plan_with_nthreads(threads);
+        auto b = reinterpret_cast<typename fftw::fftw_complex_t *>(in);
+        return fftw::plan_many_dft_c2r(n, howmany, b, out, flag);
     }
 
     static inline void run_fft(const fftw_plan &p) { fftw_execute(p); }
 
     static inline void destroy_fft(fftw_plan &p) { fftw_destroy_plan(p); }
 
-    static inline void destroy_plans()
+    // Frees all the cached plans. Only meant for the end of a program or
+    // a test, the objects that use ffts do not call it any more.
+    static inline void destroy_plans() { PlanRegistry::instance().clear(); }
+
+    static inline void set_planner_flags(const uint flags)
     {
-        // std::cout<<"planV size = " << planV.size()<<"\n";
-        for (auto &i : planV) {
-            fftw_destroy_plan(i.p);
-            fftw_free(i.in);
-            fftw_free(i.out);
-        }
-        planV.clear();
+        PlanRegistry::instance().set_flags(flags);
+    }
+
+    static inline bool set_wisdom_file(const std::string &file)
+    {
+        return PlanRegistry::instance().set_wisdom_file(file);
     }
 
     //#endif
 
-    static inline fft_plan_t find_plan(uint n, fft_type_t type, uint threads,
-                                       std::vector<fft_plan_t> &v)
+    // Slot of the plans of the calling thread. Every thread, of openmp or
+    // not, gets its own slot the first time it asks for one. The slot and
+    // its plans are released when the thread exits.
+    API uint plan_slot();
+
+    template <typename T = double>
+    static inline basic_fft_plan_t<T> find_plan(uint n, fft_type_t type,
+            uint threads)
     {
-        const uint flag = FFTW_FLAGS;
-        auto it =
-        std::find_if(v.begin(), v.end(), [n, type](const fft_plan_t &s) {
-            return ((s.n == n) && (s.type == type));
-        });
-
-        if (it == v.end()) {
-            // std::cout << "I have to create a new plan :(\n";
-            fft_plan_t plan;
-            plan.n = n;
-            plan.type = type;
-
-            if (type == FFT) {
-                fftw_complex *in =
-                    (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * n);
-                fftw_complex *out =
-                    (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * n);
-
-                auto p = init_fft(n, reinterpret_cast<complex_t *>(in),
-                                  reinterpret_cast<complex_t *>(out),
-                                  FFTW_FORWARD, flag, threads);
-                plan.p = p;
-                plan.in = in;
-                plan.out = out;
-            } else if (type == IFFT) {
-
-                fftw_complex *in =
-                    (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * n);
-                fftw_complex *out =
-                    (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * n);
-                auto p = init_fft(n, reinterpret_cast<complex_t *>(in),
-                                  reinterpret_cast<complex_t *>(out),
-                                  FFTW_BACKWARD, flag, threads);
-                plan.p = p;
-                plan.in = in;
-                plan.out = out;
-
-            } else if (type == RFFT) {
-                double *in = (double *)fftw_malloc(sizeof(double) * n);
-                fftw_complex *out = (fftw_complex *)fftw_malloc(
-                                        sizeof(fftw_complex) * (n / 2 + 1));
-                auto p = init_rfft(n, in, reinterpret_cast<complex_t *>(out),
-                                   flag, threads);
-                // std::cout << "threads : " << threads << "\n";
-                plan.p = p;
-                plan.in = in;
-                plan.out = out;
-
-            } else if (type == IRFFT) {
-                double *out = (double *)fftw_malloc(sizeof(double) * n);
-                fftw_complex *in = (fftw_complex *)fftw_malloc(
-                                       sizeof(fftw_complex) * (n / 2 + 1));
-                auto p = init_irfft(n, reinterpret_cast<complex_t *>(in), out,
-                                    flag, threads);
-                plan.p = p;
-                plan.in = in;
-                plan.out = out;
-
-            } else {
-                std::cerr << "[fft::find_plan]: ERROR "
-                          << "Wrong fft type!\n";
-                exit(-1);
-            }
+        auto &registry = PlanRegistry::instance();
+        return registry.get<T>(n, type, threads, registry.flags(), 1,
+                               plan_slot());
+    }
+
+    // Zero-copy transforms on caller owned arrays.
+    // They run fftw's new-array execute functions directly on the given
+    // arrays, so no data goes through the plan buffers. This needs the
+    // arrays to have the same simd alignment as the plan buffers, which
+    // holds for the storage of std::vector and fftw_malloc. Otherwise the
+    // data is copied through the plan buffers.
+    // All of them work on double or float (fftwf) arrays.
+    // @scale: the output is multiplied with it in the same pass
+
+    template <typename T = double>
+    static inline bool same_alignment(const void *a, const void *b)
+    {
+        return fftw_traits<T>::alignment_of((T *) a) ==
+               fftw_traits<T>::alignment_of((T *) b);
+    }
+
+    // The plans are out-of-place, fftw must not read and write the same
+    // memory with them
+    static inline bool overlaps(const void *a, const size_t a_bytes,
+                                const void *b, const size_t b_bytes)
+    {
+        auto pa = reinterpret_cast<const char *>(a);
+        auto pb = reinterpret_cast<const char *>(b);
+        return pa < pb + b_bytes && pb < pa + a_bytes;
+    }
+
+    // Plans that leave the input of the transform untouched
+    template <typename T = double>
+    static inline basic_fft_plan_t<T> find_preserving_plan(uint n,
+            fft_type_t type, uint threads)
+    {
+        auto &registry = PlanRegistry::instance();
+        return registry.get<T>(n, type, threads,
+                               registry.flags() & ~FFTW_DESTROY_INPUT, 1,
+                               plan_slot());
+    }
+
+    template <typename T>
+    static inline void scale_array(T *a, const uint n, const double scale)
+    {
+        if (scale == 1.0)
+            return;
+        #pragma omp parallel for
+        for (int i = 0; i < (int) n; ++i)
+            a[i] *= scale;
+    }
+
+    // @in:  n real points, not modified
+    // @out: n/2+1 complex points
+    template <typename T>
+    static inline void rfft(const T *in, std::complex<T> *out, const uint n,
+                            const uint threads = 1, const double scale = 1.0)
+    {
+        typedef fftw_traits<T> fftw;
+        auto plan = find_preserving_plan<T>(n, RFFT, threads);
+        auto to = reinterpret_cast<typename fftw::fftw_complex_t *>(out);
+
+        if (same_alignment<T>(in, plan.in.get()) &&
+                same_alignment<T>(out, plan.out.get()) &&
+                !overlaps(in, n * sizeof(T),
+                          out, (n / 2 + 1) * sizeof(std::complex<T>))) {
+            fftw::execute_dft_r2c(plan.p, const_cast<T *>(in), to);
+        } else {
+            auto from = (T *)plan.in.get();
+            std::copy(in, in + n, from);
+            fftw::execute_dft_r2c(plan.p, from, to);
+        }
+        scale_array(out, n / 2 + 1, scale);
+    }
 
-            v.push_back(plan);
-            // planV.push_back(plan);
-            return plan;
+    // Batch of irffts, normalised like numpy.fft.irfft, times scale
+    // @in:  howmany rows of n/2+1 complex points, overwritten
+    // @out: howmany rows of n real points
+    template <typename T>
+    static inline void irfft_many(std::complex<T> *in, T *out, const uint n,
+                                  const uint howmany, const uint threads = 1,
+                                  const double scale = 1.0)
+    {
+        typedef fftw_traits<T> fftw;
+        typedef typename fftw::fftw_complex_t fftw_complex_t;
+        // c2r transforms always destroy their input
+        auto &registry = PlanRegistry::instance();
+        auto plan = registry.get<T>(n, IRFFT, threads, registry.flags(),
+                                    howmany, plan_slot());
+        auto from = reinterpret_cast<fftw_complex_t *>(in);
+
+        if (!same_alignment<T>(in, plan.in.get())) {
+            from = (fftw_complex_t *)plan.in.get();
+            std::copy(in, in + howmany * (n / 2 + 1),
+                      (std::complex<T> *) from);
+        }
+        if (same_alignment<T>(out, plan.out.get()) &&
+                !overlaps(from, howmany * (n / 2 + 1) * sizeof(std::complex<T>),
+                          out, howmany * n * sizeof(T))) {
+            fftw::execute_dft_c2r(plan.p, from, out);
         } else {
-            return *it;
+            auto to = (T *)plan.out.get();
+            fftw::execute_dft_c2r(plan.p, from, to);
+            std::copy(to, to + howmany * n, out);
         }
+        scale_array(out, howmany * n, scale / n);
+    }
+
+    // Normalised like numpy.fft.irfft, times scale
+    // @in:  n/2+1 complex points, overwritten by the transform
+    // @out: n real points
+    template <typename T>
+    static inline void irfft(std::complex<T> *in, T *out, const uint n,
+                             const uint threads = 1, const double scale = 1.0)
+    {
+        irfft_many(in, out, n, 1, threads, scale);
+    }
+
+    // Complex transform, the inverse one is normalised like numpy.fft.ifft
+    // @in:  n complex points, not modified
+    // @out: n complex points
+    template <typename T>
+    static inline void fft(const std::complex<T> *in, std::complex<T> *out,
+                           const uint n, const uint threads = 1,
+                           const double scale = 1.0,
+                           const fft_type_t type = FFT)
+    {
+        typedef fftw_traits<T> fftw;
+        typedef typename fftw::fftw_complex_t fftw_complex_t;
+        auto plan = find_preserving_plan<T>(n, type, threads);
+        auto from = reinterpret_cast<fftw_complex_t *>(
+                        const_cast<std::complex<T> *>(in));
+        auto to = reinterpret_cast<fftw_complex_t *>(out);
+
+        if (!same_alignment<T>(in, plan.in.get()) ||
+                overlaps(in, n * sizeof(std::complex<T>),
+                         out, n * sizeof(std::complex<T>))) {
+            from = (fftw_complex_t *)plan.in.get();
+            std::copy(in, in + n, (std::complex<T> *) from);
+        }
+        if (same_alignment<T>(out, plan.out.get())) {
+            fftw::execute_dft(plan.p, from, to);
+        } else {
+            auto tmp = (std::complex<T> *)plan.out.get();
+            fftw::execute_dft(plan.p, from, (fftw_complex_t *) tmp);
+            std::copy(tmp, tmp + n, out);
+        }
+        scale_array(out, n, (type == IFFT) ? scale / n : scale);
+    }
+
+    template <typename T>
+    static inline void ifft(const std::complex<T> *in, std::complex<T> *out,
+                            const uint n, const uint threads = 1,
+                            const double scale = 1.0)
+    {
+        fft(in, out, n, threads, scale, IFFT);
     }
 
     // Parameters are like python's numpy.fft.rfft
@@ -243,8 +603,9 @@ namespace fft {
     // @n:   number of points to use. If n < in.size() then the input is cropped
     //       if n > in.size() then input is padded with zeros
     // @out: the transformed array
-    static inline void rfft(f_vector_t &in, complex_vector_t &out, uint n = 0,
-                            const uint threads = 1)
+    template <typename T>
+    static inline void rfft(std::vector<T> &in, std::vector<std::complex<T>> &out,
+                            uint n = 0, const uint threads = 1)
     {
         if (n == 0)
             n = in.size();
@@ -253,15 +614,7 @@ namespace fft {
 
         out.resize(n / 2 + 1);
 
-        auto plan = fft::find_plan(n, RFFT, threads, planV);
-        auto from = (double *)plan.in;
-        auto to = (complex_t *)plan.out;
-
-        std::copy(in.begin(), in.end(), from);
-
-        run_fft(plan.p);
-
-        std::copy(&to[0], &to[n / 2 + 1], out.begin());
+        rfft(in.data(), out.data(), n, threads);
     }
 
     // Parameters are like python's numpy.fft.fft
@@ -269,7 +622,7 @@ namespace fft {
     // @n:   number of points to use. If n < in.size() then the input is cropped
     //       if n > in.size() then input is padded with zeros
     // @out: the transformed array
-    static inline void fft(complex_vector_t &in, complex_vector_t &out,
+    static inline void fft(const complex_vector_t &in, complex_vector_t &out,
                            uint n = 0, const uint threads = 1)
     {
         if (n == 0)
@@ -277,15 +630,14 @@ namespace fft {
 
         out.resize(n);
 
-        auto plan = fft::find_plan(n, FFT, threads, planV);
-        auto from = (complex_t *)plan.in;
-        auto to = (complex_t *)plan.out;
-
-        std::copy(in.begin(), in.end(), from);
-
-        run_fft(plan.p);
-
-        std::copy(&to[0], &to[n], out.begin());
+        if (in.size() == n) {
+            fft(in.data(), out.data(), n, threads);
+        } else {
+            complex_vector_t padded(in.begin(),
+                                    in.begin() + std::min(n, (uint) in.size()));
+            padded.resize(n, complex_t(0, 0));
+            fft(padded.data(), out.data(), n, threads);
+        }
     }
 
     // Parameters are like python's numpy.fft.ifft
@@ -293,7 +645,7 @@ namespace fft {
     // @n:   number of points to use. If n < in.size() then the input is cropped
     //       if n > in.size() then input is padded with zeros
     // @out: the inverse Fourier transform of input data
-    static inline void ifft(complex_vector_t &in, complex_vector_t &out,
+    static inline void ifft(const complex_vector_t &in, complex_vector_t &out,
                             uint n = 0, const uint threads = 1)
     {
         if (n == 0)
@@ -301,38 +653,38 @@ namespace fft {
 
         out.resize(n);
 
-        auto plan = fft::find_plan(n, IFFT, threads, planV);
-        auto from = (complex_t *)plan.in;
-        auto to = (complex_t *)plan.out;
-        std::copy(in.begin(), in.end(), from);
-
-        run_fft(plan.p);
-
-        std::transform(&to[0], &to[n], out.begin(),
-                       std::bind2nd(std::divides<complex_t>(), n));
+        if (in.size() == n) {
+            ifft(in.data(), out.data(), n, threads);
+        } else {
+            complex_vector_t padded(in.begin(),
+                                    in.begin() + std::min(n, (uint) in.size()));
+            padded.resize(n, complex_t(0, 0));
+            ifft(padded.data(), out.data(), n, threads);
+        }
     }
 
     // Inverse of rfft
     // @in: input vector which must be the result of a rfft
     // @out: irfft of input, always real
     // Missing n: size of output
-    static inline void irfft(complex_vector_t in, f_vector_t &out, uint n = 0,
+    template <typename T>
+    static inline void irfft(const std::vector<std::complex<T>> &in,
+                             std::vector<T> &out, uint n = 0,
                              const uint threads = 1)
     {
         n = (n == 0) ? 2 * (in.size() - 1) : n;
         // std::cout << "out size will be " << n << "\n";
         out.resize(n);
 
-        auto plan = fft::find_plan(n, IRFFT, threads, planV);
-        auto from = (complex_t *)plan.in;
-        auto to = (double *)plan.out;
-
-        std::copy(in.begin(), in.end(), from);
+        // The input has to be copied as the transform destroys it, the
+        // plan buffer is used for that
+        auto plan = find_plan<T>(n, IRFFT, threads);
+        auto from = (std::complex<T> *)plan.in.get();
+        const uint size = std::min(n / 2 + 1, (uint) in.size());
+        std::copy(in.begin(), in.begin() + size, from);
+        std::fill(from + size, from + n / 2 + 1, std::complex<T>(0, 0));
 
-        run_fft(plan.p);
-
-        std::transform(&to[0], &to[n], out.begin(),
-                       std::bind2nd(std::divides<double>(), n));
+        irfft(from, out.data(), n, threads);
     }
 
     // Same as python's numpy.fft.rfftfreq
@@ -358,16 +710,237 @@ namespace fft {
         complex_vector_t v1; //(signal.size());
         complex_vector_t v2; //(kernel.size());
         const long unsigned size = signal.size() + kernel.size() - 1;
-        res.resize(size);
+        // Padding to a smooth length is much faster than an
+        // arbitrary size, the extra points are zeros
+        const uint n = good_size(size);
 
-        fft::rfft(signal, v1, size, omp_get_max_threads());
-        fft::rfft(kernel, v2, size, omp_get_max_threads());
+        fft::rfft(signal, v1, n, omp_get_max_threads());
+        fft::rfft(kernel, v2, n, omp_get_max_threads());
 
         std::transform(v1.begin(), v1.end(), v2.begin(), v1.begin(),
                        std::multiplies<complex_t>());
 
-        fft::irfft(v1, res, size, omp_get_max_threads());
+        fft::irfft(v1, res, n, omp_get_max_threads());
+        res.resize(size);
     }
+
+    // Linear convolution of signals with a fixed kernel.
+    // The spectrum of the kernel is computed once and reused for every
+    // signal of the same length, until the kernel is changed.
+    //  direct_method: sum of products in the time domain
+    //  fft_method: one transform of a good_size() length >= s + k - 1
+    //  overlap_save_method: the signal is split in blocks and every block
+    //      is convolved with a short fft, good when s >> k
+    //  auto_method: the cheapest of the above according to a flop count
+    // With single_precision the ffts are done in float, the direct
+    // method is always double.
+    class API Convolution {
+    public:
+        enum conv_method_t {
+            auto_method,
+            direct_method,
+            fft_method,
+            overlap_save_method
+        };
+
+        f_vector_t fKernel;
+        conv_method_t fMethod;
+        precision_t fPrecision;
+
+        Convolution(const f_vector_t &kernel = f_vector_t(),
+                    conv_method_t method = auto_method,
+                    precision_t precision = double_precision)
+        {
+            fMethod = method;
+            fPrecision = precision;
+            set_kernel(kernel);
+        }
+
+        // Replaces the kernel, the cached spectra are dropped
+        void set_kernel(const f_vector_t &kernel)
+        {
+            fKernel = kernel;
+            fSignalLen = 0;
+            fNFFT = 0;
+        }
+
+        // Same as mymath::convolution, res has size s + k - 1, or is empty
+        // if the signal or the kernel is
+        void convolve(const f_vector_t &signal, f_vector_t &res)
+        {
+            const uint s = signal.size();
+            const uint k = fKernel.size();
+            if (s == 0 || k == 0) {
+                res.clear();
+                return;
+            }
+            res.resize(s + k - 1);
+
+            if (s != fSignalLen)
+                setup(s);
+
+            if (fSelected == direct_method)
+                mymath::convolution(signal.data(), s, fKernel.data(), k,
+                                    res.data());
+            else if (fPrecision == single_precision)
+                fft_convolve(fSingle, signal, res);
+            else
+                fft_convolve(fDouble, signal, res);
+        }
+
+        // The method that convolve() uses for signals of length s
+        conv_method_t select(const uint s) const
+        {
+            uint n;
+            return select(s, n);
+        }
+
+    private:
+        // Work arrays of the ffts in one precision
+        template <typename T>
+        struct buffers_t {
+            std::vector<std::complex<T>> kernelSpectrum;
+            std::vector<T> in, out;
+            std::vector<std::complex<T>> spectrum;
+        };
+
+        uint fSignalLen;
+        uint fNFFT;
+        conv_method_t fSelected;
+        buffers_t<double> fDouble;
+        buffers_t<float> fSingle;
+
+        // Approximate flop count of a real fft of size n
+        static double fft_cost(const uint n)
+        {
+            return 2.5 * n * std::log2((double) n);
+        }
+
+        // How many times faster per flop the direct sum runs than the
+        // rfft, timed once per process
+        static double direct_speedup();
+
+        conv_method_t select(const uint s, uint &nFFT) const
+        {
+            const uint k = fKernel.size();
+            if (s == 0 || k == 0) {
+                nFFT = 0;
+                return direct_method;
+            }
+            const uint size = s + k - 1;
+            const uint fullFFT = good_size(size);
+
+            // One forward and one inverse transform plus the product,
+            // the kernel transform is cached
+            double fftCost = 2 * fft_cost(fullFFT) + 3.0 * fullFFT;
+            // The tiled direct kernel vectorizes well and has no
+            // overhead, it runs faster per flop than the ffts
+            const double directCost = 2.0 * s * k / direct_speedup();
+            // Twice as many floats fit in a simd register
+            const double fftSpeedup =
+                (fPrecision == single_precision) ? 2.0 : 1.0;
+            fftCost /= fftSpeedup;
+
+            // Blocks of 2k, 4k, ... points, up to the full transform
+            double olsCost = std::numeric_limits<double>::max();
+            uint olsFFT = fullFFT;
+            for (uint m = std::max(2 * k, 2u); m < fullFFT; m *= 2) {
+                const uint n = good_size(m);
+                if (n >= fullFFT) break;
+                const uint blocks = (size + n - k) / (n - k + 1);
+                const double cost = blocks * (2 * fft_cost(n) + 3.0 * n)
+                                    / fftSpeedup;
+                if (cost < olsCost) {
+                    olsCost = cost;
+                    olsFFT = n;
+                }
+            }
+
+            conv_method_t method = fMethod;
+            if (method == auto_method) {
+                if (directCost <= fftCost && directCost <= olsCost)
+                    method = direct_method;
+                else if (olsCost < fftCost)
+                    method = overlap_save_method;
+                else
+                    method = fft_method;
+            }
+            if (method == overlap_save_method && olsFFT == fullFFT)
+                method = fft_method;
+
+            nFFT = (method == overlap_save_method) ? olsFFT : fullFFT;
+            return method;
+        }
+
+        void setup(const uint s)
+        {
+            uint n;
+            fSelected = select(s, n);
+            fSignalLen = s;
+            if (fSelected == direct_method || n == fNFFT)
+                return;
+
+            fNFFT = n;
+            if (fPrecision == single_precision)
+                kernel_spectrum(fSingle);
+            else
+                kernel_spectrum(fDouble);
+        }
+
+        template <typename T>
+        void kernel_spectrum(buffers_t<T> &b)
+        {
+            b.in.assign(fKernel.begin(), fKernel.end());
+            fft::rfft(b.in, b.kernelSpectrum, fNFFT, omp_get_max_threads());
+        }
+
+        template <typename T>
+        void fft_convolve(buffers_t<T> &b, const f_vector_t &signal,
+                          f_vector_t &res)
+        {
+            const uint s = signal.size();
+            const uint k = fKernel.size();
+            const uint size = s + k - 1;
+
+            if (fSelected == fft_method) {
+                b.in.assign(signal.begin(), signal.end());
+                block_convolve(b, res.data(), 0, size);
+                return;
+            }
+            // The signal is padded with k-1 zeros in front, every block
+            // of fNFFT points gives step = fNFFT - k + 1 valid outputs
+            const uint step = fNFFT - k + 1;
+            for (uint start = 0; start < size; start += step) {
+                b.in.assign(fNFFT, 0.0);
+                const int first = (int) start - (int)(k - 1);
+                const uint from = std::max(first, 0);
+                const uint to = std::min(first + (int) fNFFT, (int) s);
+                if (from < to)
+                    std::copy(signal.begin() + from, signal.begin() + to,
+                              b.in.begin() + (from - first));
+                block_convolve(b, &res[start], k - 1,
+                               std::min(step, size - start));
+            }
+        }
+
+        // Convolves b.in with the kernel and copies len points, starting
+        // at offset, to out
+        template <typename T>
+        void block_convolve(buffers_t<T> &b, double *out, const uint offset,
+                            const uint len)
+        {
+            fft::rfft(b.in, b.spectrum, fNFFT, omp_get_max_threads());
+
+            std::transform(b.spectrum.begin(), b.spectrum.end(),
+                           b.kernelSpectrum.begin(), b.spectrum.begin(),
+                           std::multiplies<std::complex<T>>());
+
+            b.out.resize(fNFFT);
+            fft::irfft(b.spectrum.data(), b.out.data(), fNFFT,
+                       omp_get_max_threads());
+            std::copy(&b.out[offset], &b.out[offset + len], out);
+        }
+    };
 }
 
 #endif /* INCLUDE_FFT_H_ */
@@ -10,6 +10,7 @@
 
 #include <blond/configuration.h>
 #include <blond/beams/Beams.h>
+#include <blond/fft.h>
 #include <blond/impedances/Intensity.h>
 #include <vector>
 
@@ -38,7 +39,9 @@ public:
 
 class API InducedVoltageTime : public InducedVoltage {
 public:
-    enum time_or_freq { time_domain, freq_domain };
+    // auto_domain: direct or fft convolution, whichever is cheaper
+    // for the wake and slices lengths
+    enum time_or_freq { time_domain, freq_domain, auto_domain };
 
     std::vector<Intensity *> fWakeSourceList;
     f_vector_t fTimeArray;
@@ -46,6 +49,11 @@ public:
     uint fCut;
     uint fShape;
     time_or_freq fTimeOrFreq;
+    // Precision of the ffts of the convolution
+    fft::precision_t fPrecision;
+    // Convolution with the total wake, keeps the wake spectrum
+    // between turns
+    fft::Convolution fConvolution;
 
     void track(Beams *beam);
     void sum_wakes(f_vector_t &v);
@@ -53,7 +61,8 @@ public:
     f_vector_t induced_voltage_generation(Beams *beam, uint length = 0);
     InducedVoltageTime(Slices *slices,
                        const std::vector<Intensity *> &WakeSourceList,
-                       time_or_freq TimeOrFreq = freq_domain);
+                       time_or_freq TimeOrFreq = freq_domain,
+                       fft::precision_t precision = fft::double_precision);
 
     ~InducedVoltageTime();
 };
@@ -78,6 +87,9 @@ public:
     uint fNTurnsMem;
     bool fRecalculationImpedance;
     bool fSaveIndividualVoltages;
+    // Precision of the spectrum and of the inverse ffts, the multi-turn
+    // memory is always computed in double
+    fft::precision_t fPrecision;
     // *Real frequency resolution in [Hz], according to the obtained
     // n_fft_sampling.*
     double fFreqResolution;
@@ -106,14 +118,31 @@ public:
 
     // Reprocess the impedance contributions with respect to the new_slicing.
     void reprocess(Slices *newSlices);
+    // Recompute the multi-turn memory frequency array and impedance
+    // for an fft of nPointsFFT points
+    void impedance_memory(uint nPointsFFT);
     f_vector_t induced_voltage_generation(Beams *beam, uint length = 0);
     InducedVoltageFreq(Slices *slices,
                        const std::vector<Intensity *> &impedanceSourceList,
                        double freqResolutionInput = 0.0,
                        freq_res_option_t freq_res_option = freq_res_option_t::round_option,
                        uint NTurnsMem = 0, bool recalculationImpedance = false,
-                       bool saveIndividualVoltages = false);
+                       bool saveIndividualVoltages = false,
+                       fft::precision_t precision = fft::double_precision);
     ~InducedVoltageFreq();
+
+private:
+    // Work arrays of induced_voltage_generation in one precision, sized
+    // by the first call and kept for the next turns
+    template <typename T>
+    struct work_t {
+        std::vector<T> profile;
+        std::vector<std::complex<T>> spectrum;
+        std::vector<std::complex<T>> in;
+        std::vector<T> voltages;
+    };
+    work_t<double> fWorkDouble;
+    work_t<float> fWorkSingle;
 };
 
 class API TotalInducedVoltage : public InducedVoltage {
@@ -125,10 +154,28 @@ public:
     uint fNTurnsMemory;
     bool fInductiveImpedanceOn = false;
 
+    // Multi-turn memory, only used if fNTurnsMemory > 0
+    // Induced voltage sources that keep a memory of the previous turns
+    std::vector<InducedVoltageFreq *> fMemoryList;
+    // Induced voltage sources without memory, summed every turn
+    std::vector<InducedVoltage *> fNoMemoryList;
+    // Length of the memory window in samples
+    uint fLenArrayMem = 0;
+    // Number of points of the memory ffts
+    uint fNPointsFFT = 0;
+    // Sum of the memory impedances, sampled on fNPointsFFT points
+    complex_vector_t fTotalImpedanceMem;
+    // Sample spacing of the memory window [s]
+    double fTimeResolution = 0.0;
+    // Induced voltage of the whole memory window [V]. The window is
+    // circular, every turn it is rotated by the revolution time
+    f_vector_t fInducedVoltageMem;
+
     Beams *fBeam;
 
     void track(Beams *beam);
     void track_memory();
+    void shift_memory(complex_vector_t &spectrum, double revTime);
     void track_ghosts_particles(Beams *ghostBeam);
     f_vector_t induced_voltage_sum(Beams *beam, uint length = 0);
     void reprocess(Slices *newSlices);
@@ -145,6 +192,14 @@ public:
                         f_vector_t RevTimeArray = f_vector_t());
 
     ~TotalInducedVoltage();
+
+private:
+    // Work arrays of track_memory, sized by the first turn and kept for
+    // the next ones
+    f_vector_t fWorkProfile;
+    complex_vector_t fWorkSpectrum;
+    complex_vector_t fWorkProfileSpectrum;
+    f_vector_t fWorkKick;
 };
 
 #endif /* IMPEDANCES_INDUCEDVOLTAGE_H_ */
\ No newline at end of file
@@ -9,18 +9,13 @@
 #define INPUT_PARAMETERS_GENERALPARAMETERS_H_
 
 #include <blond/configuration.h>
+#include <blond/input_parameters/TurnArray.h>
 #include <blond/utilities.h>
 #include <vector>
 
 
 class API GeneralParameters {
 
-private:
-    void eta_generation();
-    void _eta0();
-    void _eta1();
-    void _eta2();
-
 public:
     enum particle_t { proton, electron, user_input, none };
 
@@ -32,18 +27,20 @@ public:
     ftype charge, charge2;
     ftype cumulative_times;
     f_vector_2d_t alpha;
-    f_vector_2d_t momentum;
+    std::vector<TurnArray> momentum;
     f_vector_t ring_length;
     ftype ring_circumference;
     ftype ring_radius;
-    f_vector_2d_t beta;
-    f_vector_2d_t gamma;
-    f_vector_2d_t energy;
-    f_vector_2d_t kin_energy;
-    f_vector_t cycle_time;
-    f_vector_t f_rev, omega_rev;
-    f_vector_t t_rev;
-    f_vector_2d_t eta_0, eta_1, eta_2;
+    std::vector<TurnArray> beta;
+    std::vector<TurnArray> gamma;
+    std::vector<TurnArray> energy;
+    std::vector<TurnArray> kin_energy;
+    TurnArray cycle_time;
+    TurnArray f_rev, omega_rev;
+    TurnArray t_rev;
+    std::vector<TurnArray> eta_0, eta_1, eta_2;
+    // Turns per block of the lazy mode, 0 if all the turns are stored
+    uint turn_block;
 
     GeneralParameters(const int n_turns, f_vector_t &ring_length,
                       f_vector_2d_t &alpha, const int alpha_order,
@@ -53,7 +50,52 @@ public:
                       ftype user_mass_2 = 0, ftype user_charge_2 = 0,
                       const int number_of_sections = 1);
 
+    // Lazy mode, for long ramps. The momentum of every section is given
+    // at the turns momentum_turns (from 0 to n_turns, increasing) and is
+    // linear in between. None of the per-turn arrays is stored: they are
+    // evaluated turn_block turns at a time, when the tracking reaches
+    // them (see TurnArray). The RfParameters built on it still store
+    // omega_rf, phi_rf and t_rf for every turn.
+    GeneralParameters(const int n_turns, f_vector_t &ring_length,
+                      f_vector_2d_t &alpha, const int alpha_order,
+                      const f_vector_t &momentum_turns,
+                      f_vector_2d_t &momentum_program,
+                      const particle_t particle,
+                      const uint turn_block = 10000,
+                      ftype user_mass = 0, ftype user_charge = 0,
+                      const particle_t particle2 = none,
+                      ftype user_mass_2 = 0, ftype user_charge_2 = 0,
+                      const int number_of_sections = 1);
+
+    // The per-turn arrays are evaluated from this object
+    GeneralParameters(const GeneralParameters &) = delete;
+    GeneralParameters &operator=(const GeneralParameters &) = delete;
+
     ~GeneralParameters();
+
+    // Moves the windows of the lazy arrays to the turn (see TurnArray)
+    void advance(const int turn);
+
+private:
+    // Momentum program of the lazy mode, linear between the given turns
+    f_vector_t fProgramTurns;
+    f_vector_2d_t fProgramMomentum;
+    // cycle_time at the first turn of every block, in the lazy mode
+    f_vector_t fCycleTimeBlocks;
+
+    void set_particles(const particle_t particle, ftype user_mass,
+                       ftype user_charge, const particle_t particle2,
+                       ftype user_mass_2, ftype user_charge_2);
+    void generate();
+    template <typename F>
+    TurnArray momentum_function(const int section, F f);
+    void momentum_block(int section, int first, int n, double *out) const;
+    void t_rev_block(int first, int n, double *out) const;
+    void cycle_time_block(int first, int n, double *out) const;
+    void eta_generation();
+    void _eta0(int section, int first, int n, double *out) const;
+    void _eta1(int section, int first, int n, double *out) const;
+    void _eta2(int section, int first, int n, double *out) const;
 };
 
 #endif /* INPUT_PARAMETERS_GENERALPARAMETERS_H_ */
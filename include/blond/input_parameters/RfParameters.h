@@ -29,27 +29,30 @@ public:
     double &ring_circumference;
     double &charge;
     int &alpha_order;
-    f_vector_t &t_rev;
-    f_vector_t &momentum;
-    f_vector_t &beta;
-    f_vector_t &gamma;
-    f_vector_t &energy;
-    f_vector_t &eta_0;
-    f_vector_t &eta_1;
-    f_vector_t &eta_2;
-
-
-    f_vector_t E_increment;
-    f_vector_t phi_s;
-    f_vector_t Qs;
-    f_vector_t omega_s0;
-    f_vector_2d_t omega_rf_d;
-    f_vector_2d_t phi_rf;
+    TurnArray &t_rev;
+    TurnArray &momentum;
+    TurnArray &beta;
+    TurnArray &gamma;
+    TurnArray &energy;
+    TurnArray &eta_0;
+    TurnArray &eta_1;
+    TurnArray &eta_2;
+
+    // Lazy when the GeneralParameters are (see TurnArray)
+    TurnArray E_increment;
+    TurnArray phi_s;
+    TurnArray Qs;
+    TurnArray omega_s0;
+    std::vector<TurnArray> omega_rf_d;
+    TurnArray sign_eta_0;
+    // omega_rf and phi_rf start as omega_rf_d and phi_offset. The phase
+    // loops and the noise write them with set(), a lazy array keeps only
+    // the written turns. t_rf is the period of the starting omega_rf.
+    std::vector<TurnArray> phi_rf;
     f_vector_t dphi_rf;
     f_vector_t dphi_rf_steering;
-    f_vector_t t_rf;
-    f_vector_2d_t omega_rf;
-    int_vector_t sign_eta_0;
+    TurnArray t_rf;
+    std::vector<TurnArray> omega_rf;
 
     int counter;
     int n_rf;
@@ -65,7 +68,38 @@ public:
     f_vector_t calc_phi_s(RfParameters *rfp,
                           const acc_sys_t acc_sys =
                               acc_sys_t::as_single);
-
+    // The as_single synchronous phase of the turns [first, first + n)
+    void calc_phi_s(const int first, const int n, double *out) const;
+
+    // The synchronous phase and the synchrotron tune of a single turn.
+    // Stored and lazy arrays, whatever their blocks, go through them one
+    // turn at a time: a vectorized asin or cos differs from the scalar one
+    // in the last bits, and the value of a turn would then depend on its
+    // place in the block.
+    static double phi_s_turn(const double acceleration_ratio,
+                             const double eta);
+    static double Qs_turn(const double harmonic, const double charge,
+                          const double voltage, const double eta,
+                          const double phi_s, const double beta,
+                          const double energy);
+
+
+    // Moves the windows of the lazy arrays to the turn (see TurnArray)
+    void advance(const int turn)
+    {
+        E_increment.advance(turn);
+        phi_s.advance(turn);
+        Qs.advance(turn);
+        omega_s0.advance(turn);
+        for (auto &o : omega_rf_d)
+            o.advance(turn);
+        sign_eta_0.advance(turn);
+        for (auto &p : phi_rf)
+            p.advance(turn);
+        t_rf.advance(turn);
+        for (auto &o : omega_rf)
+            o.advance(turn);
+    }
 
     // TODO write an eta_tracking function with a vector dE
     double eta_tracking(const Beams *beam,
@@ -103,48 +137,106 @@ public:
         phi_offset = _phi_offset;
         section_length = GP->ring_length[section_index];
         length_ratio = section_length / ring_circumference;
+        const uint block = GP->turn_block;
 
-        for (const auto &e : eta_0)
-            sign_eta_0.push_back(mymath::sign(e));
+        sign_eta_0 = TurnArray(n_turns + 1,
+        [this](int first, int n, double * out) {
+            eta_0.get(first, n, out);
+            #pragma omp parallel for
+            for (int i = 0; i < n; ++i)
+                out[i] = mymath::sign(out[i]);
+        }, block);
 
         // TODO: check with multi Rf
-        E_increment.resize(n_turns);
-        for (int j = 0; j < n_turns; ++j)
-            E_increment[j] = energy[j + 1] - energy[j];
-
-        phi_s = calc_phi_s(this, acc_sys);
-
-        Qs.resize(n_turns + 1);
-        for (int i = 0; i < n_turns + 1; ++i)
-            Qs[i] = std::sqrt(harmonic[section_index][i] * charge
-                              * voltage[section_index][i]
-                              * std::abs(eta_0[i] * std::cos(phi_s[i])) /
-                              (2 * constant::pi * beta[i] *
-                               beta[i] * energy[i]));
-
-        omega_s0.resize(n_turns + 1);
-        for (int i = 0; i < (n_turns + 1); ++i)
-            omega_s0[i] = Qs[i] * GP->omega_rev[i];
-
-        omega_rf_d.resize(n_rf, f_vector_t(n_turns + 1));
+        E_increment = TurnArray(n_turns,
+        [this](int first, int n, double * out) {
+            f_vector_t e(n + 1);
+            energy.get(first, n + 1, e.data());
+            #pragma omp parallel for
+            for (int j = 0; j < n; ++j)
+                out[j] = e[j + 1] - e[j];
+        }, block);
+
+        if (acc_sys == as_single)
+            phi_s = TurnArray(n_turns + 1,
+            [this](int first, int n, double * out) {
+                calc_phi_s(first, n, out);
+            }, block);
+        else
+            phi_s = calc_phi_s(this, acc_sys);
+
+        Qs = TurnArray(n_turns + 1, [this](int first, int n, double * out) {
+            f_vector_t b(n), e(n), eta(n), phis(n);
+            beta.get(first, n, b.data());
+            energy.get(first, n, e.data());
+            eta_0.get(first, n, eta.data());
+            phi_s.get(first, n, phis.data());
+            const double *h = &harmonic[section_index][first];
+            const double *v = &voltage[section_index][first];
+            const double q = charge;
+            #pragma omp parallel for
+            for (int j = 0; j < n; ++j)
+                out[j] = Qs_turn(h[j], q, v[j], eta[j], phis[j], b[j], e[j]);
+        }, block);
+
+        omega_s0 = TurnArray(n_turns + 1,
+        [this, GP](int first, int n, double * out) {
+            f_vector_t omega_rev(n);
+            Qs.get(first, n, out);
+            GP->omega_rev.get(first, n, omega_rev.data());
+            #pragma omp parallel for
+            for (int j = 0; j < n; ++j)
+                out[j] = out[j] * omega_rev[j];
+        }, block);
 
         for (int i = 0; i < n_rf; ++i)
-            for (int j = 0; j < n_turns + 1; ++j)
-                omega_rf_d[i][j] = 2. * constant::pi * beta[j] * constant::c *
-                                   harmonic[i][j] / ring_circumference;
+            omega_rf_d.push_back(TurnArray(n_turns + 1,
+            [this, i](int first, int n, double * out) {
+                beta.get(first, n, out);
+                const double *h = &harmonic[i][first];
+                const double C = ring_circumference;
+                #pragma omp parallel for
+                for (int j = 0; j < n; ++j)
+                    out[j] = 2. * constant::pi * out[j] * constant::c *
+                             h[j] / C;
+            }, block));
+
+        // A given frequency program is stored
+        for (int i = 0; i < n_rf; ++i)
+            if (_omega_rf.empty())
+                omega_rf.push_back(TurnArray(n_turns + 1,
+                [this, i](int first, int n, double * out) {
+                    omega_rf_d[i].get(first, n, out);
+                }, block));
+            else
+                omega_rf.push_back(TurnArray(_omega_rf[i]));
 
-        if (_omega_rf.empty())
-            omega_rf = omega_rf_d;
-        else
-            omega_rf = _omega_rf;
+        for (int i = 0; i < n_rf; ++i)
+            phi_rf.push_back(TurnArray(n_turns + 1,
+            [this, i](int first, int n, double * out) {
+                std::copy_n(&phi_offset[i][first], n, out);
+            }, block));
 
-        phi_rf = phi_offset;
         dphi_rf.resize(n_rf, 0);
         dphi_rf_steering.resize(n_rf, 0);
-        t_rf.resize(n_turns + 1);
-        for (int i = 0; i < n_turns + 1; ++i)
-            t_rf[i] = 2 * constant::pi / omega_rf[section_index][i];
+
+        // Before any write to omega_rf
+        const TurnArray *program = _omega_rf.empty()
+                                   ? &omega_rf_d[section_index]
+                                   : &omega_rf[section_index];
+        t_rf = TurnArray(n_turns + 1,
+        [program](int first, int n, double * out) {
+            program->get(first, n, out);
+            #pragma omp parallel for
+            for (int j = 0; j < n; ++j)
+                out[j] = 2 * constant::pi / out[j];
+        }, _omega_rf.empty() ? block : 0);
     }
+
+    // The per-turn arrays are evaluated from this object
+    RfParameters(const RfParameters &) = delete;
+    RfParameters &operator=(const RfParameters &) = delete;
+
     ~RfParameters() {};
 };
 
@@ -0,0 +1,235 @@
+/*
+ * TurnArray.h
+ *
+ *  Per-turn quantities, stored or evaluated on demand in blocks of turns
+ */
+
+#ifndef INPUT_PARAMETERS_TURNARRAY_H_
+#define INPUT_PARAMETERS_TURNARRAY_H_
+
+#include <algorithm>
+#include <blond/configuration.h>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+// An array with one value per turn.
+// A stored array holds all the values, like a f_vector_t. A lazy array
+// holds only a window of 2 * block turns. Only advance() moves it, the
+// tracker calls it every turn. The window then starts block/2 turns before
+// the current turn, so that the reads around it (counter - 1 ...
+// counter + 1) find their values there. Reading a turn outside of the
+// window calls the generator for that turn, so reads never change the
+// array and are safe from several threads, as long as the window does not
+// move at the same time. A lazy array keeps the turns written with set()
+// apart, they take the place of the generated values.
+class TurnArray {
+public:
+    // Fills out[0, n) with the values of the turns [first, first + n)
+    typedef std::function<void(int first, int n, double *out)> generator_t;
+
+    class const_iterator {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef double value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const double *pointer;
+        typedef double reference;
+
+        const_iterator(const TurnArray *a, int i) : fArray(a), fIndex(i) {}
+        double operator*() const { return (*fArray)[fIndex]; }
+        double operator[](difference_type n) const
+        {
+            return (*fArray)[fIndex + n];
+        }
+        const_iterator &operator++() { ++fIndex; return *this; }
+        const_iterator operator++(int)
+        {
+            const_iterator old(*this);
+            ++fIndex;
+            return old;
+        }
+        const_iterator &operator--() { --fIndex; return *this; }
+        const_iterator &operator+=(difference_type n)
+        {
+            fIndex += n;
+            return *this;
+        }
+        const_iterator operator+(difference_type n) const
+        {
+            return const_iterator(fArray, fIndex + n);
+        }
+        const_iterator operator-(difference_type n) const
+        {
+            return const_iterator(fArray, fIndex - n);
+        }
+        difference_type operator-(const const_iterator &o) const
+        {
+            return fIndex - o.fIndex;
+        }
+        bool operator==(const const_iterator &o) const
+        {
+            return fIndex == o.fIndex;
+        }
+        bool operator!=(const const_iterator &o) const
+        {
+            return fIndex != o.fIndex;
+        }
+        bool operator<(const const_iterator &o) const
+        {
+            return fIndex < o.fIndex;
+        }
+
+    private:
+        const TurnArray *fArray;
+        int fIndex;
+    };
+
+    TurnArray() : fSize(0), fBlock(0), fStart(0) {}
+
+    TurnArray(const f_vector_t &values)
+        : fSize(values.size()), fBlock(0), fValues(values), fStart(0) {}
+
+    // With block = 0 the generator is called once for all the turns and
+    // the array is stored, otherwise the array is lazy
+    TurnArray(const int size, generator_t generator, const uint block = 0)
+        : fSize(size), fBlock(block), fGenerator(generator), fStart(0)
+    {
+        if (fBlock == 0) {
+            fValues.resize(fSize);
+            if (fSize > 0)
+                fGenerator(0, fSize, fValues.data());
+        } else if (fSize > 0) {
+            fill(0);
+        }
+    }
+
+    TurnArray &operator=(const f_vector_t &values)
+    {
+        fSize = values.size();
+        fBlock = 0;
+        fGenerator = generator_t();
+        fValues = values;
+        fStart = 0;
+        fWrittenTurns.clear();
+        fWrittenValues.clear();
+        return *this;
+    }
+
+    inline double operator[](const int turn) const
+    {
+        if (fBlock == 0)
+            return fValues[turn];
+        if (!fWrittenTurns.empty()) {
+            const int k = written(turn);
+            if (k >= 0)
+                return fWrittenValues[k];
+        }
+        if (turn >= fStart && turn < fStart + (int) fValues.size())
+            return fValues[turn - fStart];
+        double value;
+        fGenerator(turn, 1, &value);
+        return value;
+    }
+
+    void set(const int turn, const double value)
+    {
+        if (fBlock == 0) {
+            fValues[turn] = value;
+            return;
+        }
+        // The turns are mostly written in order, at the end
+        auto it = std::lower_bound(fWrittenTurns.begin(), fWrittenTurns.end(),
+                                   turn);
+        const int k = it - fWrittenTurns.begin();
+        if (it != fWrittenTurns.end() && *it == turn) {
+            fWrittenValues[k] = value;
+        } else {
+            fWrittenTurns.insert(it, turn);
+            fWrittenValues.insert(fWrittenValues.begin() + k, value);
+        }
+    }
+
+    // Moves the window of a lazy array, if needed, so that it holds turn
+    // and the turn after it
+    void advance(const int turn)
+    {
+        if (fBlock == 0)
+            return;
+        const int last = std::min(turn + 1, fSize - 1);
+        if (turn < fStart || last >= fStart + (int) fValues.size())
+            fill(turn);
+    }
+
+    uint size() const { return fSize; }
+    bool empty() const { return fSize == 0; }
+    double front() const { return (*this)[0]; }
+    double back() const { return (*this)[fSize - 1]; }
+    bool lazy() const { return fBlock != 0; }
+    uint block() const { return fBlock; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, fSize); }
+
+    // Copies the values of the turns [first, first + n) to out, without
+    // moving the window of a lazy array
+    void get(const int first, const int n, double *out) const
+    {
+        if (n <= 0)
+            return;
+        if (fBlock == 0) {
+            std::copy_n(fValues.begin() + first, n, out);
+            return;
+        }
+        fGenerator(first, n, out);
+        auto it = std::lower_bound(fWrittenTurns.begin(), fWrittenTurns.end(),
+                                   first);
+        for (; it != fWrittenTurns.end() && *it < first + n; ++it)
+            out[*it - first] = fWrittenValues[it - fWrittenTurns.begin()];
+    }
+
+    // All the values, without moving the window of a lazy array
+    f_vector_t vector() const
+    {
+        if (fBlock == 0)
+            return fValues;
+        f_vector_t v(fSize);
+        get(0, fSize, v.data());
+        return v;
+    }
+
+private:
+    // Saves and restores the values, or the written turns of a lazy array
+    friend class Checkpoint;
+
+    int fSize;
+    uint fBlock;
+    generator_t fGenerator;
+    f_vector_t fValues;
+    int fStart;
+    // Written turns of a lazy array, in order, and their values
+    int_vector_t fWrittenTurns;
+    f_vector_t fWrittenValues;
+
+    // Index of turn in the written turns, -1 if it is not there
+    int written(const int turn) const
+    {
+        auto it = std::lower_bound(fWrittenTurns.begin(), fWrittenTurns.end(),
+                                   turn);
+        if (it == fWrittenTurns.end() || *it != turn)
+            return -1;
+        return it - fWrittenTurns.begin();
+    }
+
+    void fill(const int turn)
+    {
+        const int window = 2 * fBlock;
+        fStart = std::max(0, std::min(turn - (int) fBlock / 2,
+                                      fSize - window));
+        fValues.resize(std::min(window, fSize - fStart));
+        fGenerator(fStart, fValues.size(), fValues.data());
+    }
+};
+
+#endif /* INPUT_PARAMETERS_TURNARRAY_H_ */
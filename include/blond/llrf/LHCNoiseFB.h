@@ -62,6 +62,8 @@ class API LHCNoiseFB {
     ~LHCNoiseFB();
     void track();
     double fwhm_interpolation(uint_vector_t index, double half_height);
+    // Same, with the first and the last bin of index
+    double fwhm_interpolation(int first, int last, double half_height);
     void fwhm_single_bunch();
     void fwhm_multi_bunch();
 };
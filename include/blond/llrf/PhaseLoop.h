@@ -14,9 +14,13 @@
 #include <blond/llrf/PhaseNoise.h>
 #include <blond/utilities.h>
 
+class Checkpoint;
+
 class API PhaseLoop {
   public:
     virtual void track(){};
+    // Registers the state that changes while tracking
+    virtual void checkpoint(Checkpoint &c);
     void default_track();
     PhaseLoop(f_vector_t PL_gain, double window_coefficient, uint _delay,
               PhaseNoise* phaseNoise, LHCNoiseFB* LHCNoiseFB);
@@ -35,9 +39,21 @@ class API PhaseLoop {
     double phi_beam = 0;
     double dphi = 0;
     double reference = 0;
+    // radial_difference() also updates the statistics() of the beam
+    bool beam_statistics = false;
     PhaseNoise* RFnoise;
     LHCNoiseFB* noiseFB;
     virtual ~PhaseLoop(){};
+
+  protected:
+    // Window exp(alpha * t) of beam_phase() on the bin centers. The bins
+    // are uniform, so it is kept while alpha, the number of bins and the
+    // first and last bin centers do not change.
+    f_vector_t window;
+    double window_alpha = 0;
+    double window_first = 0;
+    double window_last = 0;
+    const double* window_function();
 };
 
 class API LHC : public PhaseLoop {
@@ -51,6 +67,7 @@ class API LHC : public PhaseLoop {
 
     ~LHC();
     void track();
+    void checkpoint(Checkpoint &c);
     LHC(f_vector_t PL_gain, double SL_gain = 0, double window_coefficient = 0,
         PhaseNoise* phaseNoise = NULL, LHCNoiseFB* LHCNoiseFB = NULL,
         uint _delay = 0);
@@ -73,6 +90,7 @@ class API PSB : public PhaseLoop {
     double domega_RL;
     ~PSB();
     void track();
+    void checkpoint(Checkpoint &c);
     PSB(f_vector_t PL_gain, f_vector_t RL_gain = f_vector_t(),
         double PL_period = 0, double RL_period = 0,
         f_vector_t coefficients = f_vector_t(), double window_coefficient = 0,
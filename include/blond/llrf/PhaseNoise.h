@@ -10,7 +10,12 @@
 
 #include <blond/configuration.h>
 #include <blond/globals.h>
+#include <blond/input_parameters/TurnArray.h>
 #include <blond/utilities.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
 
 class API PhaseNoise {
 private:
@@ -32,21 +37,70 @@ public:
     predistortion_t fPredistortion;
     uint fNTurns;
     f_vector_t fDphi;
-    f_vector_t fFs;
+    // Synchrotron frequency per turn [Hz], lazy in streaming mode
+    TurnArray fFs;
+    // Streaming mode: fDphi stays empty and generate() does nothing. The
+    // noise is generated one correlation window (fCorr turns) at a time.
+    // Once half of a window is read, the next one is generated by a
+    // background thread. Only the previous, the current and the next
+    // windows are kept.
+    bool fStreaming = false;
 
     void spectrum_to_phase_noise(f_vector_t &t, f_vector_t &dphi,
                                  const f_vector_t &freq_array,
                                  const f_vector_t &ReS,
                                  transform_t transform
                                  = transform_t::transform_none);
+    void spectrum_to_phase_noise(f_vector_t &t, f_vector_t &dphi,
+                                 const f_vector_t &freq_array,
+                                 const f_vector_t &ReS,
+                                 transform_t transform,
+                                 int seed1, int seed2);
 
     f_vector_t spectrum_generation(int k, int nt, double df, double ampl,
                                    f_vector_t freq,
                                    predistortion_t predistortion);
 
+    // Phase noise of a turn [rad], from fDphi or from the windows
+    double dphi(uint turn);
+    // Number of correlation windows of the noise
+    uint n_windows() const { return fNTurns / fCorr; }
+    // Phase noise of the turns from i * fCorr on. Window i always uses
+    // the seeds fSeed1 + 239 i and fSeed2 + 158 i, so it does not depend
+    // on the windows generated before.
+    virtual f_vector_t generate_window(uint i) { return f_vector_t(); }
+
     PhaseNoise() {};
-    virtual ~PhaseNoise() {};
+    virtual ~PhaseNoise() { stop_prefetch(); };
     virtual void generate() {};
+
+protected:
+    // Generated windows of the streaming mode, by index
+    std::map<uint, f_vector_t> fWindows;
+    // Fills fDphi with all the windows
+    void fill_dphi();
+    // Synchrotron frequency of a turn, without moving the window of fFs
+    double fs(uint turn) const;
+    // Joins the background thread. The derived classes call it in their
+    // destructor, as the thread calls their generate_window().
+    void stop_prefetch();
+
+private:
+    std::thread fPrefetchThread;
+    std::mutex fPrefetchMutex;
+    std::condition_variable fPrefetchCv;
+    // Window to generate in the background, -1 for none
+    int fPrefetchWanted = -1;
+    // Window held by fPrefetched, -1 for none
+    int fPrefetchReady = -1;
+    f_vector_t fPrefetched;
+    bool fPrefetchStop = false;
+    // Last window asked for, only used by the thread calling dphi()
+    int fPrefetchAsked = -1;
+
+    void prefetch(uint i);
+    void prefetch_loop();
+    f_vector_t take_window(uint i);
 };
 
 class API LHCFlatSpectrum : public PhaseNoise {
@@ -59,9 +113,11 @@ public:
                     double initial_amplitude = 1e-6, int seed1 = 1234,
                     int seed2 = 7564,
                     predistortion_t predistortion
-                    = predistortion_t::predistortion_none);
+                    = predistortion_t::predistortion_none,
+                    bool streaming = false);
     ~LHCFlatSpectrum();
     void generate();
+    f_vector_t generate_window(uint i);
 };
 
 class API PSBPhaseNoiseInjection : public PhaseNoise {
@@ -77,9 +133,11 @@ public:
                            double fmax = 1.1, double initial_amplitude = 1e-6,
                            int seed1 = 1234, int seed2 = 7564,
                            predistortion_t predistortion = predistortion_t::predistortion_none,
-                           rescale_ampl_t rescale_ampl = rescale_ampl_t::with_sync_freq);
+                           rescale_ampl_t rescale_ampl = rescale_ampl_t::with_sync_freq,
+                           bool streaming = false);
     ~PSBPhaseNoiseInjection();
     void generate();
+    f_vector_t generate_window(uint i);
 };
 
 #endif /* LLRF_PHASENOISE_H_ */
\ No newline at end of file
@@ -50,14 +50,32 @@ namespace mymath {
         }
     };
 
-    static inline uint next_regular(uint target)
+    // Sorted numbers up to limit whose prime factors are all in primes
+    static inline std::vector<uint> smooth_numbers(
+        const std::vector<uint> &primes,
+        const uint limit = std::numeric_limits<int>::max())
     {
-
-        for (auto i : Ham({2, 3, 5})) {
-            if (i > target)
-                return i;
+        std::vector<uint> v(1, 1);
+        for (const auto p : primes) {
+            const uint size = v.size();
+            for (uint i = 0; i < size; ++i) {
+                for (unsigned long long x = (unsigned long long) v[i] * p;
+                        x <= limit; x *= p)
+                    v.push_back(x);
+            }
         }
-        return 0;
+        std::sort(v.begin(), v.end());
+        return v;
+    }
+
+    // The first 2,3,5-smooth number greater than target, 0 if there is
+    // none up to the largest int
+    static inline uint next_regular(uint target)
+    {
+        // Built once, instead of walking Ham({2, 3, 5}) on every call
+        static const std::vector<uint> table = smooth_numbers({2, 3, 5});
+        auto it = std::upper_bound(table.begin(), table.end(), target);
+        return (it == table.end()) ? 0 : *it;
     }
 
     // Wrapper function for vdt::fucntions
@@ -65,24 +83,65 @@ namespace mymath {
 
     static inline double fast_cos(double x) { return vdt::fast_sin(x + M_PI_2); }
 
+    // Sine and cosine with one range reduction
+    static inline void fast_sincos(double x, double &s, double &c)
+    {
+        vdt::fast_sincos(x, s, c);
+    }
+
     static inline double fast_exp(double x) { return vdt::fast_exp(x); }
 
     // linear convolution function
+    // The outputs are computed in tiles of CONV_TILE consecutive points,
+    // the partial sums of a tile stay in registers and every signal point
+    // is multiplied with a contiguous slice of the kernel, so the inner
+    // loop vectorizes. The ragged edges of a tile are done point by point.
     static inline void convolution(const double *__restrict signal,
                                    const int SignalLen,
                                    const double *__restrict kernel,
                                    const int KernelLen, double *__restrict res)
     {
+        const int CONV_TILE = 8;
         const int size = KernelLen + SignalLen - 1;
+        const int tiles = (size + CONV_TILE - 1) / CONV_TILE;
+
+        #pragma omp parallel for schedule(static)
+        for (int tile = 0; tile < tiles; ++tile) {
+            const int n0 = tile * CONV_TILE;
+            const int width = std::min(CONV_TILE, size - n0);
+
+            double acc[CONV_TILE] = {0.0};
+
+            // Range of signal points that contribute to every output
+            // of the tile
+            const int kmin = std::max(0, n0 + width - KernelLen);
+            const int kmax = std::min(n0, SignalLen - 1);
+
+            const bool tiled = (width == CONV_TILE) && (kmin <= kmax);
+
+            if (tiled) {
+                for (int k = kmin; k <= kmax; ++k) {
+                    const double s = signal[k];
+                    const double *__restrict ker = &kernel[n0 - k];
+                    #pragma omp simd
+                    for (int t = 0; t < CONV_TILE; ++t)
+                        acc[t] += s * ker[t];
+                }
+            }
 
-        #pragma omp parallel for
-        for (auto n = 0; n < size; ++n) {
-            res[n] = 0;
-            const int kmin = (n >= KernelLen - 1) ? n - (KernelLen - 1) : 0;
-            const int kmax = (n < SignalLen - 1) ? n : SignalLen - 1;
-            for (int k = kmin; k <= kmax; k++) {
-                res[n] += signal[k] * kernel[n - k];
-                //--j;
+            for (int t = 0; t < width; ++t) {
+                const int n = n0 + t;
+                const int lo = (n >= KernelLen - 1) ? n - (KernelLen - 1) : 0;
+                const int hi = (n < SignalLen - 1) ? n : SignalLen - 1;
+                // Only the points not already added by the tiled loop
+                const int headEnd = tiled ? std::min(hi, kmin - 1) : hi;
+                for (int k = lo; k <= headEnd; ++k)
+                    acc[t] += signal[k] * kernel[n - k];
+                if (tiled) {
+                    for (int k = std::max(lo, kmax + 1); k <= hi; ++k)
+                        acc[t] += signal[k] * kernel[n - k];
+                }
+                res[n] = acc[t];
             }
         }
     }
@@ -90,28 +149,23 @@ namespace mymath {
 
     // Parameters are like python's np.interp
     // @x: x-coordinates of the interpolated values
+    // @N: number of x, for the array version
     // @xp: The x-coords of the data points
     // @fp: the y-coords of the data points
     // @y: the interpolated values, same shape as x
     // @left: value to return for x < xp[0]
     // @right: value to return for x > xp[last]
-    static inline void interp(const std::vector<double> &x,
+    static inline void interp(const double *x, const int N,
                               const std::vector<double> &xp,
                               const std::vector<double> &yp,
-                              std::vector<double> &y,
+                              double *y,
                               const double left,
                               const double right)
     {
         assert(xp.size() == yp.size());
         assert(std::is_sorted(xp.begin(), xp.end()));
-        y.resize(x.size());
 
         const int M = xp.size();
-        const int N = x.size();
-        if (N == 0) return;
-
-        const auto max = xp.back();
-        const auto min = xp.front();
 
         // #pragma omp parallel for
         for (int i = 0; i < N; ++i) {
@@ -130,6 +184,18 @@ namespace mymath {
         }
     }
 
+    static inline void interp(const std::vector<double> &x,
+                              const std::vector<double> &xp,
+                              const std::vector<double> &yp,
+                              std::vector<double> &y,
+                              const double left,
+                              const double right)
+    {
+        y.resize(x.size());
+        if (x.empty()) return;
+        interp(x.data(), x.size(), xp, yp, y.data(), left, right);
+    }
+
     static inline void interp(const std::vector<double> &x,
                               const std::vector<double> &xp,
                               const std::vector<double> &yp,
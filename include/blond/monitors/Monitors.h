@@ -19,9 +19,14 @@
 #include <blond/input_parameters/RfParameters.h>
 #include <blond/llrf/PhaseLoop.h>
 #include <blond/llrf/LHCNoiseFB.h>
+#include <cstdint>
+#include <map>
 
 
 
+// The writer thread of the monitors
+struct monitor_writer_t;
+
 void *read_1D(std::string fname, std::string dsname,
               std::string type, hsize_t dims[]);
 
@@ -29,7 +34,28 @@ void *read_2D(std::string fname, std::string dsname,
               std::string type, hsize_t dims[]);
 
 
+// The profiles are buffered, fBufferTurns at a time, and written as one
+// chunk of the dataset by a writer thread, see BunchMonitor.
 class API SlicesMonitor {
+private:
+    // Profiles of the turns [first, first + size), one after the other.
+    // The writer thread transposes them to the rows of the dataset.
+    struct buffer_t {
+        int first;
+        int size;
+        int_vector_t int_profiles;
+        std::vector<float> real_profiles;
+        int_vector_t int_transposed;
+        std::vector<float> real_transposed;
+    };
+    buffer_t fBuffers[2];
+    monitor_writer_t *fWriter;
+
+    buffer_t &buffer();
+    void write(buffer_t &b);
+    template <typename T>
+    static void transpose(const std::vector<T> &in, const int rows,
+                          const int columns, std::vector<T> &out);
 public:
     H5::H5File *fFile;
     H5::Group *fGroup;
@@ -37,41 +63,70 @@ public:
     std::string fFileName;
 
     Slices *fSlices;
+    // Number of profiles saved, of fNTurns
     int fITurn;
     int fNTurns;
+    // Number of calls of track(), a profile is saved every fDecimation
+    int fITrack;
+    int fDecimation;
+    int fBufferTurns;
     int fCompressionLevel;
+    // Profiles as floats instead of ints
+    bool fSinglePrecision;
 
     void track();
+    // Hands the buffered profiles to the writer thread
     void write_data();
     void create_data(const int_vector_t dims);
+    // Writes the buffered profiles, waits for the writer and closes the file
     void close();
+    // n_turns is the number of calls of track(), of which every
+    // decimation-th one saves a profile
     SlicesMonitor(std::string filename, int n_turns, Slices *slices,
-                  int compression_level = 9);
+                  int compression_level = 9, int buffer_turns = 100,
+                  int decimation = 1, bool single_precision = false);
+    // The writer thread keeps a pointer to the monitor
+    SlicesMonitor(const SlicesMonitor &) = delete;
+    SlicesMonitor &operator=(const SlicesMonitor &) = delete;
     ~SlicesMonitor();
 };
 
+// The values of every turn are buffered, fBufferTime turns at a time.
+// Tracking fills one buffer while a writer thread compresses and writes
+// the other one to the file, so the tracking threads do not wait for HDF5.
 class API BunchMonitor {
 private:
     typedef float real_t;
     const H5::DataType NATIVE_REAL_T = H5::PredType::NATIVE_FLOAT;
 
-    int_vector_t b_np_alive;
-    std::vector<real_t> b_mean_dt;
-    std::vector<real_t> b_mean_dE;
-    std::vector<real_t> b_sigma_dt;
-    std::vector<real_t> b_sigma_dE;
-    std::vector<real_t> b_epsn_rms;
-    std::vector<real_t> b_bl_gauss;
-    std::vector<double> b_PL_omegaRF;
-    std::vector<real_t> b_PL_phiRF;
-    std::vector<real_t> b_PL_bunch_phase;
-    std::vector<real_t> b_PL_phase_corr;
-    std::vector<real_t> b_PL_omegaRF_corr;
-    std::vector<real_t> b_SL_dphiRF;
-    std::vector<real_t> b_RL_drho;
-    std::vector<real_t> b_LHCnoiseFB_factor;
-    std::vector<real_t> b_LHCnoiseFB_bl;
-    std::vector< std::vector<real_t> > b_LHCnoiseFB_bl_bbb;
+    // The turns [first, first + size)
+    struct buffer_t {
+        int first;
+        int size;
+        int_vector_t np_alive;
+        std::vector<real_t> mean_dt;
+        std::vector<real_t> mean_dE;
+        std::vector<real_t> sigma_dt;
+        std::vector<real_t> sigma_dE;
+        std::vector<real_t> epsn_rms;
+        std::vector<real_t> bl_gauss;
+        std::vector<double> PL_omegaRF;
+        std::vector<real_t> PL_phiRF;
+        std::vector<real_t> PL_bunch_phase;
+        std::vector<real_t> PL_phase_corr;
+        std::vector<real_t> PL_omegaRF_corr;
+        std::vector<real_t> SL_dphiRF;
+        std::vector<real_t> RL_drho;
+        std::vector<real_t> LHCnoiseFB_factor;
+        std::vector<real_t> LHCnoiseFB_bl;
+        std::vector<real_t> LHCnoiseFB_bl_bbb;
+    };
+    buffer_t fBuffers[2];
+    monitor_writer_t *fWriter;
+
+    buffer_t &buffer();
+    int compression(const std::string &dataset) const;
+    void write(const buffer_t &b);
 public:
     H5::H5File *fH5File;
     H5::Group *fH5Group;
@@ -80,7 +135,9 @@ public:
     int fNTurns;
     int fITurn;
     int fBufferTime;
+    // Deflate level of the datasets, fCompressionLevels by name first
     int fCompressionLevel;
+    std::map<std::string, int> fCompressionLevels;
     RfParameters *fRfP;
     Beams *fBeam;
     Slices *fSlices;
@@ -91,14 +148,82 @@ public:
     void init_data(const int dimension);
     void init_buffer();
     void write_buffer();
+    // Hands the buffered turns to the writer thread
     void write_data();
     // void open();
+    // Writes the buffered turns, waits for the writer and closes the file
     void close();
     BunchMonitor(GeneralParameters *GP, RfParameters *RfP, Beams *Beam,
                  std::string filename, int buffer_time = 0,
                  Slices *Slices = NULL, PhaseLoop *PL = NULL,
-                 LHCNoiseFB *noiseFB = NULL, int compression_level = 9);
+                 LHCNoiseFB *noiseFB = NULL, int compression_level = 9,
+                 std::map<std::string, int> compression_levels = {});
+    // The writer thread keeps a pointer to the monitor
+    BunchMonitor(const BunchMonitor &) = delete;
+    BunchMonitor &operator=(const BunchMonitor &) = delete;
     ~BunchMonitor();
 };
 
+// Snapshots of the coordinates of all the particles, or of a random sample
+// of them, every fEvery turns. Snapshot k is the turn k * fEvery of RfP,
+// the turns without a snapshot have turn -1 in the file. The sample is
+// the same particles in all the snapshots. The coordinates are gathered
+// while tracking and written by a writer thread, see BunchMonitor.
+class API PhaseSpaceMonitor {
+private:
+    struct buffer_t {
+        int row;
+        int turn;
+        f_vector_t dt;
+        f_vector_t dE;
+        std::vector<float> real_dt;
+        std::vector<float> real_dE;
+        int_vector_t id;
+    };
+    buffer_t fBuffers[2];
+    monitor_writer_t *fWriter;
+
+    buffer_t &buffer();
+    void write(const buffer_t &b);
+public:
+    // Turn of the last snapshot, -1 before the first one
+    int fLastTurn;
+    H5::H5File *fFile;
+    H5::Group *fGroup;
+    std::string fFileName;
+
+    RfParameters *fRfP;
+    Beams *fBeam;
+    int fEvery;
+    int fNSnapshots;
+    // Indices of the sampled particles in increasing order, all of them
+    // if empty
+    int_vector_t fSample;
+    // dt and dE as floats instead of doubles
+    bool fSinglePrecision;
+    int fCompressionLevel;
+
+    // Call after every turn, the constructor takes the snapshot of the
+    // turn RfP is at
+    void track();
+    // Waits for the writer thread, flushes and closes the file
+    void close();
+
+    // n of the indices [0, size), the same for any number of threads.
+    // Index i is taken if its uniform number of CounterRNG(seed) is among
+    // the n smallest.
+    static int_vector_t sample(const int size, const int n,
+                               const uint64_t seed = 0);
+
+    // n_particles 0 for all of them
+    PhaseSpaceMonitor(GeneralParameters *GP, RfParameters *RfP, Beams *Beam,
+                      std::string filename, int every = 1,
+                      int n_particles = 0, bool single_precision = false,
+                      int compression_level = 0, uint64_t seed = 0);
+    // The writer thread keeps a pointer to the monitor
+    PhaseSpaceMonitor(const PhaseSpaceMonitor &) = delete;
+    PhaseSpaceMonitor &operator=(const PhaseSpaceMonitor &) = delete;
+    ~PhaseSpaceMonitor();
+};
+
 #endif /* INCLUDE_BLOND_MONITORS_H_ */
@@ -0,0 +1,139 @@
+/*
+ * random.h
+ *
+ *  Counter-based random numbers, reproducible in parallel code
+ */
+
+#ifndef INCLUDE_BLOND_RANDOM_H_
+#define INCLUDE_BLOND_RANDOM_H_
+
+#include <blond/configuration.h>
+#include <blond/constants.h>
+#include <blond/openmp.h>
+#include <blond/utilities.h>
+#include <cmath>
+#include <cstdint>
+
+namespace rng {
+
+    // Philox4x32-10 block function, from J. K. Salmon et al., "Parallel
+    // random numbers: as easy as 1, 2, 3", SC11.
+    // Turns a 128-bit counter and a 64-bit key into 128 random bits.
+    static inline void philox4x32(uint32_t ctr[4], const uint32_t key[2])
+    {
+        const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+        const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+        uint32_t k0 = key[0], k1 = key[1];
+
+        for (int round = 0; round < 10; ++round) {
+            const uint64_t p0 = (uint64_t) M0 * ctr[0];
+            const uint64_t p1 = (uint64_t) M1 * ctr[2];
+            const uint32_t c0 = (uint32_t)(p1 >> 32) ^ ctr[1] ^ k0;
+            const uint32_t c2 = (uint32_t)(p0 >> 32) ^ ctr[3] ^ k1;
+            ctr[0] = c0;
+            ctr[1] = (uint32_t) p1;
+            ctr[2] = c2;
+            ctr[3] = (uint32_t) p0;
+            k0 += W0;
+            k1 += W1;
+        }
+    }
+
+    // Double in (0, 1] from 53 of the bits of hi and lo
+    static inline double to_uniform(const uint32_t hi, const uint32_t lo)
+    {
+        const uint64_t x = (((uint64_t) hi << 32) | lo) >> 11;
+        return (x + 1) * (1.0 / 9007199254740992.0);
+    }
+
+    // Random numbers as a pure function of (seed, stream, index).
+    // There is no state to advance: the draw of a particle is fixed by its
+    // index, so parallel loops give the same numbers with any number of
+    // threads and in any order. Different streams of the same seed are
+    // independent, e.g. one stream per quantity or per turn.
+    class API CounterRNG {
+    private:
+        uint32_t fKey[2];
+        uint32_t fStream[2];
+
+    public:
+        CounterRNG(const uint64_t seed = 0, const uint64_t stream = 0)
+        {
+            fKey[0] = (uint32_t) seed;
+            fKey[1] = (uint32_t)(seed >> 32);
+            fStream[0] = (uint32_t) stream;
+            fStream[1] = (uint32_t)(stream >> 32);
+        }
+
+        // Same seed, another stream
+        CounterRNG substream(const uint64_t stream) const
+        {
+            CounterRNG r(*this);
+            r.fStream[0] = (uint32_t) stream;
+            r.fStream[1] = (uint32_t)(stream >> 32);
+            return r;
+        }
+
+        // The 128 random bits of index
+        inline void block(const uint64_t index, uint32_t out[4]) const
+        {
+            out[0] = (uint32_t) index;
+            out[1] = (uint32_t)(index >> 32);
+            out[2] = fStream[0];
+            out[3] = fStream[1];
+            philox4x32(out, fKey);
+        }
+
+        // Two independent uniform numbers in (0, 1]
+        inline void uniform2(const uint64_t index, double &u1,
+                             double &u2) const
+        {
+            uint32_t b[4];
+            block(index, b);
+            u1 = to_uniform(b[0], b[1]);
+            u2 = to_uniform(b[2], b[3]);
+        }
+
+        inline double uniform(const uint64_t index) const
+        {
+            uint32_t b[4];
+            block(index, b);
+            return to_uniform(b[0], b[1]);
+        }
+
+        // Two independent standard normal numbers, with Box-Muller.
+        // Defined out of line, so that no loop inlines and vectorizes
+        // log/sin/cos: the vector and the scalar math functions differ in
+        // the last bits, and a batch split over threads would then depend
+        // on where each chunk starts.
+        void normal2(const uint64_t index, double &n1, double &n2) const;
+
+        // Value index % 2 of the pair index / 2, the sequence of the batch
+        // normal() up to the last bits
+        inline double normal(const uint64_t index) const
+        {
+            double n1, n2;
+            normal2(index / 2, n1, n2);
+            return (index % 2) ? n2 : n1;
+        }
+
+        // out[i] = low + (high - low) * uniform(first + i)
+        void uniform(double *out, const uint n, const uint64_t first = 0,
+                     const double low = 0.0, const double high = 1.0) const
+        {
+            const double width = high - low;
+            #pragma omp parallel for
+            for (int i = 0; i < (int) n; ++i)
+                out[i] = low + width * uniform(first + i);
+        }
+
+        // out[i] = mean + sigma * value (first + i) % 2 of the pair
+        // (first + i) / 2, both numbers of a pair are used. The pairs are
+        // computed in vectorized blocks aligned to the absolute index, so
+        // the batch does not depend on its start or on the threads.
+        void normal(double *out, const uint n, const uint64_t first = 0,
+                    const double mean = 0.0, const double sigma = 1.0) const;
+    };
+}
+
+#endif /* INCLUDE_BLOND_RANDOM_H_ */
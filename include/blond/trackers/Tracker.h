@@ -26,20 +26,20 @@ public:
     int &counter;
     double &length_ratio;
     double &section_length;
-    f_vector_t &t_rev;
+    TurnArray &t_rev;
     int &n_rf;
-    f_vector_t &beta;
+    TurnArray &beta;
     double &charge;
     f_vector_2d_t &harmonic;
     f_vector_2d_t &voltage;
     f_vector_2d_t &phi_noise;
-    f_vector_2d_t &phi_rf;
-    f_vector_t &phi_s;
-    f_vector_2d_t &omega_rf;
-    f_vector_t &eta_0;
-    f_vector_t &eta_1;
-    f_vector_t &eta_2;
-    int_vector_t &sign_eta_0;
+    std::vector<TurnArray> &phi_rf;
+    TurnArray &phi_s;
+    std::vector<TurnArray> &omega_rf;
+    TurnArray &eta_0;
+    TurnArray &eta_1;
+    TurnArray &eta_2;
+    TurnArray &sign_eta_0;
     int &alpha_order;
 
     // double elapsed_time;
@@ -47,7 +47,7 @@ public:
     int_vector_t indices_inside_frame;
     int_vector_t indices_left_outside;
 
-    f_vector_t acceleration_kick;
+    TurnArray acceleration_kick;
     f_vector_t fRfVoltage;
     solver_type solver;
     double dE_max;
@@ -119,9 +119,12 @@ public:
         this->slices = Slices;
         this->totalInducedVoltage = TotalInducedVoltage;
 
-        this->acceleration_kick.resize(rfp->E_increment.size());
-        for (uint i = 0; i < rfp->E_increment.size(); ++i)
-            acceleration_kick[i] = -rfp->E_increment[i];
+        this->acceleration_kick = TurnArray(rfp->E_increment.size(),
+        [RfP](int first, int n, double * out) {
+            RfP->E_increment.get(first, n, out);
+            for (int i = 0; i < n; ++i)
+                out[i] = -out[i];
+        }, rfp->E_increment.block());
 
         if (solver != simple && solver != full) {
             std::cerr << "ERROR: Choice of longitudinal solver not recognized!\n"
@@ -34,6 +34,18 @@ std::vector<int> is_in_separatrix(const GeneralParameters *GP,
                                    const f_vector_t &dE,
                                    const f_vector_t total_voltage = {});
 
+// Sets id to 0 for the particles outside the separatrix, in one pass over
+// dt and dE. With several RF systems, and no total_voltage, the potential of
+// their total voltage is taken.
+void separatrix_losses(const GeneralParameters *GP,
+                       const RfParameters *RfP,
+                       const Beams *Beam,
+                       const double *__restrict dt,
+                       const double *__restrict dE,
+                       int *__restrict id,
+                       const int size,
+                       const f_vector_t &total_voltage = {});
+
 f_vector_t hamiltonian(const GeneralParameters *GP,
                        const RfParameters *RfP,
                        const Beams *Beam,
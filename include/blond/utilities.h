@@ -52,6 +52,16 @@
 
 
 
+// Keeps a function out of the loops that call it, so that they can not
+// vectorize its math functions (see RfParameters::phi_s_turn)
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE
+#endif
+
 #define ALL(c) (c).begin(),(c).end() 
 #define FOR(c, it) for(auto it = c.begin(); it != c.end(); it++)
 
@@ -83,7 +83,8 @@ done
 # -----------------
 
 
-if [ -e ${INSTALL}/include/fftw3.h ] && [ -e ${INSTALL}/lib/libfftw3.dll.a ]; then
+if [ -e ${INSTALL}/include/fftw3.h ] && [ -e ${INSTALL}/lib/libfftw3.dll.a ] \
+    && [ -e ${INSTALL}/lib/libfftw3f.dll.a ]; then
     echo -e "\n\n---- Looks like fftw3 is already installed,"
     if [ "${SKIP_QUESTIONS}" = "true" ] ; then
         echo -e "---- fftw3 installation will be skipped"
@@ -103,6 +104,7 @@ fi
 if [ "${INSTALL_FFTW}" = "true" ] ; then
     echo -e "\n\n---- Installing fftw3"
     cp -l ${LIB}/libfftw3.dll.a ${INSTALL}/lib/
+    cp -l ${LIB}/libfftw3f.dll.a ${INSTALL}/lib/
     cp -l ${INCLUDE}/fftw3.h ${INSTALL}/include/
 
     if [ -e ${INSTALL}/include/fftw3.h ] && [ -e ${INSTALL}/lib/libfftw3.dll.a ]; then
@@ -62,7 +62,8 @@ done
 # -----------------
 
 
-if [ -e ${INSTALL}/include/fftw3.h ] && [ -e ${INSTALL}/lib/libfftw3.la ]; then
+if [ -e ${INSTALL}/include/fftw3.h ] && [ -e ${INSTALL}/lib/libfftw3.la ] \
+   && [ -e ${INSTALL}/lib/libfftw3f.la ]; then
    echo -e "\n\n---- Looks like fftw3 is already installed,"
    if [ "${SKIP_QUESTIONS}" = "true" ] ; then
       echo -e "---- fftw3 installation will be skipped"
@@ -100,6 +101,22 @@ if [ "${INSTALL_FFTW}" = "true" ] ; then
    make &>> $log
    make install &>> $log
 
+   # single precision library (libfftw3f), same options
+   make distclean &>> $log
+   ./configure --disable-alloca \
+               --disable-fortran \
+               --disable-static \
+               --enable-shared \
+               --enable-openmp \
+               --enable-sse2 \
+               --enable-avx \
+               --enable-float \
+               --with-our-malloc \
+               --with-incoming-stack-boundary=2 \
+               --prefix="${INSTALL}" &>> $log
+   make &>> $log
+   make install &>> $log
+
    if [ -e ${INSTALL}/include/fftw3.h ] && [ -e ${INSTALL}/lib/libfftw3.a ]; then
       echo -e "---- fftw3 has been installed successfully\n\n"
    else
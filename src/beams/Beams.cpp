@@ -44,20 +44,61 @@ void Beams::statistics()
     statistics(dE.data(), dt.data(), id.data(), dE.size());
 }
 
+double Beams::mean_dE_in_window(const double dt_min, const double dt_max,
+                                const bool with_statistics)
+{
+    double window_mean_dE;
+    if (with_statistics) {
+        statistics(dE.data(), dt.data(), id.data(), dE.size(), dt_min, dt_max,
+                   &window_mean_dE);
+        return window_mean_dE;
+    }
+
+    const double *__restrict dE = this->dE.data();
+    const double *__restrict dt = this->dt.data();
+    const int *__restrict id = this->id.data();
+    double w_dE = 0.0;
+    int w_n = 0;
+
+    #pragma omp parallel for reduction(+:w_dE, w_n)
+    for (int i = 0; i < n_macroparticles; ++i) {
+        const int in = id[i] * (dt[i] > dt_min && dt[i] < dt_max);
+        w_dE += in * dE[i];
+        w_n += in;
+    }
+
+    return w_n > 0 ? w_dE / w_n : 0.0;
+}
+
 void Beams::statistics(const double *__restrict dE,
                        const double *__restrict dt,
                        const int *__restrict id,
-                       const int size)
+                       const int size,
+                       const double dt_min, const double dt_max,
+                       double *window_mean_dE)
 {
-    double m_dE, m_dt, s_dE, s_dt;
-    m_dt = m_dE = s_dE = s_dt = 0.0;
-    int n = 0;
-
-    #pragma omp parallel for reduction(+:m_dE, m_dt, n)
-    for (int i = 0; i < size; ++i) {
-        m_dE += id[i] * dE[i];
-        m_dt += id[i] * dt[i];
-        n += id[i];
+    double m_dE, m_dt, s_dE, s_dt, w_dE;
+    m_dt = m_dE = s_dE = s_dt = w_dE = 0.0;
+    int n = 0, w_n = 0;
+
+    if (window_mean_dE != NULL) {
+        #pragma omp parallel for reduction(+:m_dE, m_dt, n, w_dE, w_n)
+        for (int i = 0; i < size; ++i) {
+            const int in = id[i] * (dt[i] > dt_min && dt[i] < dt_max);
+            m_dE += id[i] * dE[i];
+            m_dt += id[i] * dt[i];
+            n += id[i];
+            w_dE += in * dE[i];
+            w_n += in;
+        }
+        *window_mean_dE = w_n > 0 ? w_dE / w_n : 0.0;
+    } else {
+        #pragma omp parallel for reduction(+:m_dE, m_dt, n)
+        for (int i = 0; i < size; ++i) {
+            m_dE += id[i] * dE[i];
+            m_dt += id[i] * dt[i];
+            n += id[i];
+        }
     }
 
     mean_dE = m_dE /= n;
@@ -94,10 +135,8 @@ void Beams::losses_energy_cut(const double dE_min, const double dE_max)
 
 void Beams::losses_separatrix(GeneralParameters *GP, RfParameters *RfP)
 {
-    auto index = is_in_separatrix(GP, RfP, this, dt, dE);
-    #pragma omp parallel for
-    for (int i = 0; i < (int) n_macroparticles; i++)
-        id[i] = id[i] * index[i];
+    separatrix_losses(GP, RfP, this, dt.data(), dE.data(), id.data(),
+                      n_macroparticles);
 }
 /*
 void Beams::losses_longitudinal_cut(const double* __restrict dt,
@@ -12,6 +12,7 @@
 #include <iostream>
 #include <blond/vector_math.h>
 #include <blond/math_functions.h>
+#include <blond/random.h>
 
 using namespace mymath;
 using namespace std;
@@ -27,7 +28,8 @@ matched_from_line_density(Beams *beam,
                           string half_option,
                           map<string, f_vector_t> extraVoltageDict,
                           int n_iterations_input,
-                          int seed
+                          int seed,
+                          double sse_tolerance
                          )
 {
     // not setting line_density_opt["exponent"] to null
@@ -117,11 +119,14 @@ matched_from_line_density(Beams *beam,
                                 time_line_den.size() + 1);
         // fit option is already normal
 
-        auto induced_voltage_object = *totVolt;
-        induced_voltage_object.reprocess(&slices);
+        // The impedances are reprocessed for the line density only once,
+        // the iterations move the induced potential along with the profile
+        auto old_slices = totVolt->fSlices;
+        totVolt->reprocess(&slices);
         induced_voltage_length = 1.5 * n_points_line_den;
-        auto induced_voltage = induced_voltage_object.induced_voltage_sum(
+        auto induced_voltage = totVolt->induced_voltage_sum(
                                    beam, induced_voltage_length);
+        totVolt->reprocess(old_slices);
         time_induced_voltage = linspace(time_line_den[0],
                                         time_line_den[0] + (induced_voltage_length - 1)
                                         * line_den_resolution,
@@ -137,6 +142,7 @@ matched_from_line_density(Beams *beam,
 
     double max_profile_pos = 0.;
     f_vector_t time_coord_sep, potential_well_sep;
+    f_vector_t old_potential;
 
     for (int i = 0; i < n_iterations; i++) {
         if (totVolt != nullptr)
@@ -158,7 +164,22 @@ matched_from_line_density(Beams *beam,
                 total_potential[j] += extra_potential[j];
         }
 
-        potential_well_cut(time_coord_array, total_potential,
+        // The profile is matched once the potential does not move any more
+        bool last_iteration = (i == n_iterations - 1);
+        if (i > 0 && old_potential.size() == total_potential.size()) {
+            double sse = 0., norm = 0.;
+            #pragma omp parallel for reduction(+ : sse, norm)
+            for (uint j = 0; j < size; j++) {
+                sse += (total_potential[j] - old_potential[j])
+                       * (total_potential[j] - old_potential[j]);
+                norm += total_potential[j] * total_potential[j];
+            }
+            if (sqrt(sse) <= sse_tolerance * sqrt(norm))
+                last_iteration = true;
+        }
+        old_potential.swap(total_potential);
+
+        potential_well_cut(time_coord_array, old_potential,
                            time_coord_sep, potential_well_sep);
 
         f_vector_t min_positions_potential, max_positions_potential;
@@ -222,15 +243,15 @@ matched_from_line_density(Beams *beam,
                               (max_profile_pos - min_potential_pos);
         }
 
-        if (i != n_iterations - 1) {
-            time_line_den -= (max_profile_pos - min_potential_pos);
+        if (last_iteration)
+            break;
 
-            time_induced_voltage =
-                linspace(time_line_den[0], time_line_den[0]
-                         + (induced_voltage_length - 1) * line_den_resolution,
-                         induced_voltage_length);
-        }
+        time_line_den -= (max_profile_pos - min_potential_pos);
 
+        time_induced_voltage =
+            linspace(time_line_den[0], time_line_den[0]
+                     + (induced_voltage_length - 1) * line_den_resolution,
+                     induced_voltage_length);
     }
 
     int n_points_abel = 10000;
@@ -319,56 +340,42 @@ matched_from_line_density(Beams *beam,
         hamiltonian_coord.resize(n_points_abel, 0.);
         // cout << "line_den_diff_abel: " << line_den_diff_abel;
         // cout << "potential_abel: " << potential_abel;
-        if (half_option == "first" || (half_option == "both" && abel_index == 0)) {
-            for (int i = 0; i < n_points_abel; i++) {
-                f_vector_t integrand(i + 1);
-                for (int j = 0; j < i + 1; j++) {
-                    if (potential_abel[j] - potential_abel[i] <= 0.0)
-                        integrand[j] = 0.0;
-                    else
-                        integrand[j] = line_den_diff_abel[j] / sqrt(potential_abel[j]
-                                       - potential_abel[i]);
-                }
-                if (integrand.size() > 2) {
-                    auto rit = integrand.rbegin();
-                    rit[0] = rit[1] + (rit[1] - rit[2]);
-                } else if (integrand.size() > 1) {
-                    auto rit = integrand.rbegin();
-                    rit[0] = rit[1];
-                } else {
-                    // NOTE can this case ever occur?
-                    integrand = {0};
-                }
 
-                density_function[i] = sqrt(eom_factor_dE) / constant::pi
-                                      * trapezoid(integrand, time_coord_diff);
-                hamiltonian_coord[i] = potential_abel[i];
-            }
-        } else if (half_option == "second" || (half_option == "both" && abel_index == 1)) {
-            for (int i = 0; i < n_points_abel; i++) {
-                f_vector_t integrand;
-                for (uint j = i; j < line_den_diff_abel.size(); j++)
-                    if (potential_abel[j] - potential_abel[i] <= 0.0)
-                        integrand.push_back(0.0);
-                    else
-                        integrand.push_back(line_den_diff_abel[j] / sqrt(potential_abel[j]
-                                            - potential_abel[i]));
-                // cout << "integrand[" << i << "]: " << integrand[0] << "\n";
-
-                if (integrand.size() > 2) {
-                    integrand[0] = integrand[1] + (integrand[2] - integrand[1]);
-                } else if (integrand.size() > 1) {
-                    integrand[0] = integrand[1];
+        // Abel inversion, the trapezoid integral of the integrand from the
+        // edge of the half profile up to each level. The integrand at the
+        // level itself is singular and is extrapolated from its neighbours.
+        const bool first_half = half_option == "first"
+                                || (half_option == "both" && abel_index == 0);
+        const double abel_factor = (first_half ? 1. : -1.)
+                                   * sqrt(eom_factor_dE) / constant::pi;
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (int i = 0; i < n_points_abel; i++) {
+            auto integrand = [&potential_abel, &line_den_diff_abel, i](int j) {
+                const double dU = potential_abel[j] - potential_abel[i];
+                return (dU <= 0.0) ? 0.0 : line_den_diff_abel[j] / sqrt(dU);
+            };
+            const int n = first_half ? i + 1 : n_points_abel - i;
+            // j of the k-th point of the integrand
+            const int j0 = first_half ? 0 : i;
+
+            double psum = 0.;
+            if (n > 1) {
+                double edge, singular;
+                if (first_half) {
+                    edge = integrand(0);
+                    singular = (n > 2) ? integrand(i - 1) + (integrand(i - 1)
+                               - integrand(i - 2)) : integrand(i - 1);
                 } else {
-                    // NOTE can this case ever occur?
-                    integrand = {0};
+                    edge = integrand(n_points_abel - 1);
+                    singular = (n > 2) ? integrand(i + 1) + (integrand(i + 2)
+                               - integrand(i + 1)) : integrand(i + 1);
                 }
-                // cout << "integrand[" << i << "]: " << integrand[0] << "\n";
-                density_function[i] = - sqrt(eom_factor_dE) / constant::pi
-                                      * trapezoid(integrand, time_coord_diff);
-                hamiltonian_coord[i] = potential_abel[i];
+                psum = edge + singular;
+                for (int k = 1; k < n - 1; k++)
+                    psum += 2 * integrand(j0 + k);
             }
-
+            density_function[i] = abel_factor * ((time_coord_diff / 2) * psum);
+            hamiltonian_coord[i] = potential_abel[i];
         }
         // cout << "density_function: " << density_function;
 
@@ -502,23 +509,6 @@ matched_from_line_density(Beams *beam,
     // cout << "beam dE mean: " << mean(beam->dE) << "\n";
     // cout << "beam dE std: " << standard_deviation(beam->dE) << "\n";
 
-    // TODO test this part
-    if (totVolt != nullptr) {
-        auto rfp = totVolt->fSlices->rfp;
-        auto slices = Slices(rfp, beam, time_coord_for_grid.size());
-        slices.n_macroparticles = reconstructed_line_den * beam->n_macroparticles;
-        slices.bin_centers = time_coord_for_grid;
-        slices.edges = linspace(slices.bin_centers[0]
-                                - (slices.bin_centers[1] - slices.bin_centers[0]) / 2,
-                                slices.bin_centers.back()
-                                + (slices.bin_centers[1] - slices.bin_centers[0]) / 2,
-                                slices.bin_centers.size() + 1);
-        // fit option is already normal
-
-        auto induced_voltage_object = *totVolt;
-        induced_voltage_object.reprocess(&slices);
-        induced_voltage_object.induced_voltage_sum(beam);
-    }
     return {hamiltonian_coord,
             density_function,
             time_line_den,
@@ -535,7 +525,8 @@ matched_from_distribution_density(Beams *beam,
                                   TotalInducedVoltage *totVolt,
                                   map<string, f_vector_t> extraVoltageDict,
                                   int n_iterations_input,
-                                  int seed
+                                  int seed,
+                                  int n_points_grid
                                  )
 {
     // NOTE
@@ -566,8 +557,9 @@ matched_from_distribution_density(Beams *beam,
 
     f_vector_t extra_potential, induced_potential;
     f_vector_t line_density, time_coord_low_res, deltaE_coord_array;
-    f_vector_2d_t density_grid;
-    f_vector_2d_t time_grid, deltaE_grid;
+    // The grids are flat, n_points_grid rows of deltaE_coord_array times
+    // n_points_grid columns of time_coord_low_res
+    f_vector_t density_grid;
 
     if (!extraVoltageDict.empty()) {
         auto extra_voltage_time_input = extraVoltageDict["time_array"];
@@ -623,10 +615,7 @@ matched_from_distribution_density(Beams *beam,
         // cout << "max_potential: " << max_potential << "\n";
         // cout << "max_deltaE: " << max_deltaE <<"\n";
 
-        auto H_array_dE0 = potential_well_sep;
-        // FIXME
-        int n_points_grid = 1000;
-        // int n_points_grid = 10;
+        const int n_grid = n_points_grid;
 
         auto potential_well_indexes = arange(0.0, 1.0 * n_points_potential);
         auto grid_indexes = arange(0.0, 1.0 * n_points_grid)
@@ -639,15 +628,6 @@ matched_from_distribution_density(Beams *beam,
                                              potential_well_indexes,
                                              potential_well_sep);
 
-        meshgrid(time_coord_low_res, deltaE_coord_array,
-                 time_grid, deltaE_grid);
-
-        f_vector_2d_t potential_well_grid, trash;
-        meshgrid(potential_well_low_res, potential_well_low_res,
-                 potential_well_grid, trash);
-
-        f_vector_t J_array_dE0(n_points_grid, 0.);
-
         // NOTE so far so good
         // cout << "potential_well_indexes: " << potential_well_indexes;
         // cout << "grid_indexes: " << grid_indexes;
@@ -655,19 +635,37 @@ matched_from_distribution_density(Beams *beam,
         // cout << "deltaE_coord_array: " << deltaE_coord_array;
         // cout << "potential_well_low_res: " << potential_well_low_res;
 
-        for (int j = 0; j < n_points_grid; j++) {
-            auto dE_trajectory = apply_f(H_array_dE0,
-            [eom_factor_dE, &potential_well_low_res, j](double x) {
-                auto num = (potential_well_low_res[j] - x) / eom_factor_dE;
+        // Action of the trajectory through each point of the low resolution
+        // well, 1 / pi * the trapezoid integral of dE over the separatrix.
+        // dE is zero where the potential is above the level, so each level
+        // only sums the points below it, a prefix of the sorted potential.
+        f_vector_t potential_sorted = potential_well_sep;
+        sort(ALL(potential_sorted));
+        const double potential_first = potential_well_sep.front();
+        const double potential_last = potential_well_sep.back();
+
+        f_vector_t J_array_dE0(n_points_grid, 0.);
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (int j = 0; j < n_grid; j++) {
+            const double level = potential_well_low_res[j];
+            auto dE_trajectory = [eom_factor_dE, level](double x) {
+                auto num = (level - x) / eom_factor_dE;
                 return (num < 0.0) ? 0.0 : sqrt(num);
-            });
+            };
+            const int below = lower_bound(ALL(potential_sorted), level)
+                              - potential_sorted.begin();
+            double integral = 0.;
+            for (int k = 0; k < below; k++)
+                integral += dE_trajectory(potential_sorted[k]);
+            integral -= (dE_trajectory(potential_first)
+                         + dE_trajectory(potential_last)) / 2;
             J_array_dE0[j] = (2.0 / (2.*constant::pi))
-                             * trapezoid(dE_trajectory, time_resolution);
+                             * integral * time_resolution;
         }
         // NOTE so far so good
         // cout << "J_array_dE0: " << J_array_dE0;
 
-        H_array_dE0 = potential_well_low_res;
+        auto H_array_dE0 = potential_well_low_res;
         struct node {
             double h, j;
             bool operator<(const node &o) const
@@ -685,28 +683,38 @@ matched_from_distribution_density(Beams *beam,
             J_array_dE0[i] = nodes[i].j;
         }
 
-        f_vector_2d_t H_grid, J_grid;
-
-        for (uint j = 0; j < deltaE_grid.size(); j++)
-            H_grid.push_back(eom_factor_dE * deltaE_grid[j] * deltaE_grid[j]
-                             + potential_well_grid[j]);
-
-        for (auto &row : H_grid)
-            J_grid.push_back(interp(row, H_array_dE0, J_array_dE0, 0.0,
-                                    numeric_limits<double>::infinity()));
+        f_vector_t H_grid(n_grid * n_grid), J_grid(n_grid * n_grid);
+
+        #pragma omp parallel for
+        for (int j = 0; j < n_grid; j++) {
+            const double H_dE = eom_factor_dE * deltaE_coord_array[j]
+                                * deltaE_coord_array[j];
+            double *H_row = &H_grid[j * n_grid];
+            for (int i = 0; i < n_grid; i++)
+                H_row[i] = H_dE + potential_well_low_res[i];
+            interp(H_row, n_grid, H_array_dE0, J_array_dE0, &J_grid[j * n_grid],
+                   0.0, numeric_limits<double>::infinity());
+        }
 
         // almost ok, check H_array_dE0[1], J_array_dE0[1]
         // almost ok, there is a difference in J_grid[0][4], J_grid[last][4]
         // cout << "H_array_dE0: " << H_array_dE0;
         // cout << "J_array_dE0: " << J_array_dE0;
 
-        // cout << "H_grid\n";
-        // for (auto &row : H_grid)
-        //     cout << row;
-
-        // cout << "J_grid\n";
-        // for (auto &row : J_grid)
-        //     cout << row;
+        // Sums the columns of the normalized density grid
+        auto project = [n_grid, &density_grid, &line_density]() {
+            const double density_grid_sum = sum(density_grid);
+            line_density.assign(n_grid, 0.);
+            #pragma omp parallel for
+            for (int i = 0; i < n_grid; i++) {
+                double column = 0.;
+                for (int j = 0; j < n_grid; j++) {
+                    density_grid[j * n_grid + i] /= density_grid_sum;
+                    column += density_grid[j * n_grid + i];
+                }
+                line_density[i] = column;
+            }
+        };
 
         auto density_variable = distribution_opt["density_variable"].s;
         double X0 = 0.;
@@ -738,45 +746,18 @@ matched_from_distribution_density(Beams *beam,
 
                 X0 = 0.5 * (X_low + X_hi);
                 // cout << "X0: " << X0 << "\n";
-                // f_vector_2d_t density_grid;
-                density_grid.clear();
-                if (density_variable == "density_from_J") {
-                    if (distribution_opt["type"].s == "user_input") {
-                        for (auto &row : J_grid)
-                            density_grid.push_back(
-                                distribution_opt["function"].f(
-                                    row, distribution_opt["type"].s,
-                                    X0, distribution_opt["exponent"].d));
-                    } else {
-                        for (auto &row : J_grid)
-                            density_grid.push_back(
-                                distribution_density_function(
-                                    row, distribution_opt["type"].s,
-                                    X0, distribution_opt["exponent"].d));
-                    }
-                } else { // density_variable == "density_from_H"
-                    if (distribution_opt["type"].s == "user_input") {
-                        for (auto &row : H_grid)
-                            density_grid.push_back(
-                                distribution_opt["function"].f(
-                                    row, distribution_opt["type"].s,
-                                    X0, distribution_opt["exponent"].d));
-                    } else {
-                        for (auto &row : H_grid)
-                            density_grid.push_back(
-                                distribution_density_function(
-                                    row, distribution_opt["type"].s,
-                                    X0, distribution_opt["exponent"].d));
-                    }
-                }
+                auto &X_grid = (density_variable == "density_from_J") ?
+                               J_grid : H_grid;
+                if (distribution_opt["type"].s == "user_input")
+                    density_grid = distribution_opt["function"].f(
+                                       X_grid, distribution_opt["type"].s,
+                                       X0, distribution_opt["exponent"].d);
+                else
+                    density_grid = distribution_density_function(
+                                       X_grid, distribution_opt["type"].s,
+                                       X0, distribution_opt["exponent"].d);
 
-                double density_grid_sum = 0;
-                for (auto &row : density_grid) density_grid_sum += sum(row);
-                for (auto &row : density_grid) row /= density_grid_sum;
-                // cout << "density_grid_sum: " << density_grid_sum << "\n";
-                line_density.clear();
-                line_density.resize(density_grid[0].size(), 0);
-                for (auto &row : density_grid) line_density += row;
+                project();
                 // cout << "line_density sum: " << sum(line_density) << "\n";
                 // cout << "line_density min: " << *min_element(ALL(line_density)) << "\n";
                 // cout << "line_density max: " << *max_element(ALL(line_density)) << "\n";
@@ -877,56 +858,36 @@ matched_from_distribution_density(Beams *beam,
 
         }
 
+        auto &X_grid = (density_variable == "density_from_J") ?
+                       J_grid : H_grid;
         if (distribution_opt["type"].s != "user_input_table") {
-            density_grid.clear();
-            if (density_variable == "density_from_J") {
-                if (distribution_opt.find("emittance") != distribution_opt.end()) {
-                    X0 = distribution_opt["emittance"].d / (2 * constant::pi);
-                }
-                for (auto &row : J_grid)
-                    density_grid.push_back(
-                        distribution_density_function(
-                            row, distribution_opt["type"].s,
-                            X0, distribution_opt["exponent"].d));
-            } else { // density_variable == "density_from_H"
-                if (distribution_opt.find("emittance") != distribution_opt.end()) {
-                    auto emittance = distribution_opt["emittance"].d / (2 * constant::pi);
-                    auto H0 = interp({emittance}, J_array_dE0, H_array_dE0);
-                    X0 = H0[0];
-                }
-                for (auto &row : H_grid)
-                    density_grid.push_back(
-                        distribution_density_function(
-                            row, distribution_opt["type"].s,
-                            X0, distribution_opt["exponent"].d));
+            if (distribution_opt.find("emittance") != distribution_opt.end()) {
+                auto emittance = distribution_opt["emittance"].d / (2 * constant::pi);
+                if (density_variable == "density_from_J")
+                    X0 = emittance;
+                else // density_variable == "density_from_H"
+                    X0 = interp({emittance}, J_array_dE0, H_array_dE0)[0];
             }
+            density_grid = distribution_density_function(
+                               X_grid, distribution_opt["type"].s,
+                               X0, distribution_opt["exponent"].d);
         } else {
-            density_grid.clear();
-            if (density_variable == "density_from_J") {
-                for (auto &row : J_grid)
-                    density_grid.push_back(
-                        interp(row, distribution_opt["user_table_action"].v,
-                               distribution_opt["user_table_density"].v));
-            } else { // density_variable == "density_from_H"
-                for (auto &row : H_grid)
-                    density_grid.push_back(
-                        interp(row, distribution_opt["user_table_action"].v,
-                               distribution_opt["user_table_density"].v));
-            }
-        }
-        double density_grid_sum = 0;
-        for (uint i = 0; i < H_grid.size(); i++) {
-            for (uint j = 0; j < H_grid[i].size(); j++)
-                if (H_grid[i][j] > H_array_dE0.back())
-                    density_grid[i][j] = 0;
-            density_grid_sum += sum(density_grid[i]);
+            const auto &action = distribution_opt["user_table_action"].v;
+            const auto &density = distribution_opt["user_table_density"].v;
+            density_grid.resize(X_grid.size());
+            #pragma omp parallel for
+            for (int j = 0; j < n_grid; j++)
+                interp(&X_grid[j * n_grid], n_grid, action, density,
+                       &density_grid[j * n_grid], density.front(),
+                       density.back());
         }
 
-        for (auto &row : density_grid) row /= density_grid_sum;
-
-        line_density.clear();
-        line_density.resize(density_grid[0].size(), 0);
-        for (auto &row : density_grid) line_density += row;
+        const double H_max = H_array_dE0.back();
+        #pragma omp parallel for
+        for (int i = 0; i < n_grid * n_grid; i++)
+            if (H_grid[i] > H_max)
+                density_grid[i] = 0;
+        project();
         line_density /= (sum(line_density) / beam->n_macroparticles);
 
         // continue here
@@ -975,16 +936,9 @@ matched_from_distribution_density(Beams *beam,
 
     //populating the bunch
 
-    f_vector_t density_grid_flat = flatten(density_grid);
-
-    auto indexes = random_choice(arange(0, (int)density_grid_flat.size()),
+    auto indexes = random_choice(arange(0, (int)density_grid.size()),
                                  beam->n_macroparticles,
-                                 density_grid_flat);
-
-
-
-    auto time_grid_flat = flatten(time_grid);
-    auto deltaE_grid_flat = flatten(deltaE_grid);
+                                 density_grid);
 
     const double delta_time_coord = time_coord_low_res[1] - time_coord_low_res[0];
     const double delta_deltaE = deltaE_coord_array[1] - deltaE_coord_array[0];
@@ -993,8 +947,10 @@ matched_from_distribution_density(Beams *beam,
     uniform_real_distribution<double> d(0.0, 1.0);
 
     for (int i = 0; i < beam->n_macroparticles; i++) {
-        beam->dt[i] = time_grid_flat[indexes[i]] + (d(gen) - 0.5) * delta_time_coord;
-        beam->dE[i] = deltaE_grid_flat[indexes[i]] + (d(gen) - 0.5) * delta_deltaE;
+        beam->dt[i] = time_coord_low_res[indexes[i] % n_points_grid]
+                      + (d(gen) - 0.5) * delta_time_coord;
+        beam->dE[i] = deltaE_coord_array[indexes[i] / n_points_grid]
+                      + (d(gen) - 0.5) * delta_deltaE;
     }
 
     // cout << "beam dt mean: " << mean(beam->dt) << "\n";
@@ -1140,7 +1096,8 @@ f_vector_t distribution_density_function(const f_vector_t &action_array,
 {
     f_vector_t ret(action_array.size());
     if (dist_type == "binomial") {
-        for (uint i = 0; i < action_array.size(); i++) {
+        #pragma omp parallel for
+        for (int i = 0; i < (int) action_array.size(); i++) {
             if (action_array[i] > length)
                 ret[i] = 0.;
             else
@@ -1148,7 +1105,8 @@ f_vector_t distribution_density_function(const f_vector_t &action_array,
         }
         return ret;
     } else if (dist_type == "waterbag") {
-        for (uint i = 0; i < action_array.size(); i++) {
+        #pragma omp parallel for
+        for (int i = 0; i < (int) action_array.size(); i++) {
             if (action_array[i] > length)
                 ret[i] = 0.;
             else
@@ -1156,7 +1114,8 @@ f_vector_t distribution_density_function(const f_vector_t &action_array,
         }
         return ret;
     } else if (dist_type == "parabolic_amplitude") {
-        for (uint i = 0; i < action_array.size(); i++) {
+        #pragma omp parallel for
+        for (int i = 0; i < (int) action_array.size(); i++) {
             if (action_array[i] > length)
                 ret[i] = 0.;
             else
@@ -1165,7 +1124,8 @@ f_vector_t distribution_density_function(const f_vector_t &action_array,
         return ret;
     } else if (dist_type == "parabolic_line") {
         exponent = 0.5;
-        for (uint i = 0; i < action_array.size(); i++) {
+        #pragma omp parallel for
+        for (int i = 0; i < (int) action_array.size(); i++) {
             if (action_array[i] > length)
                 ret[i] = 0.;
             else
@@ -1173,9 +1133,9 @@ f_vector_t distribution_density_function(const f_vector_t &action_array,
         }
         return ret;
     } else if (dist_type == "gaussian") {
-        ret = apply_f(action_array, [length](double x) {return exp(-2 * x / length);});
-        // for (uint i = 0; i < action_array.size(); i++)
-        //     ret[i] = exp(-2. * action_array[i] / length);
+        #pragma omp parallel for
+        for (int i = 0; i < (int) action_array.size(); i++)
+            ret[i] = exp(-2 * action_array[i] / length);
     } else {
         cerr << "[distribution_density_function] The dist_type was not recognized\n";
         exit(-1);
@@ -1301,6 +1261,10 @@ void longitudinal_bigaussian(GeneralParameters *GP, RfParameters *RfP,
     Beam->sigma_dE = sigma_dE;
     Beam->sigma_dt = sigma_dt;
 
+    const double dt_offset = (eta0 > 0) ? (phi_s - phi_rf) / omega_rf
+                             : (phi_s - phi_rf - constant::pi) / omega_rf;
+    const rng::CounterRNG generator(seed);
+
     if (seed < 0) {
         f_vector_t random;
         util::read_vector_from_file(random, TEST_FILES "/normal_distribution.dat");
@@ -1315,44 +1279,55 @@ void longitudinal_bigaussian(GeneralParameters *GP, RfParameters *RfP,
             Beam->dE[i] = sigma_dE * r;
         }
     } else {
-        default_random_engine generator(seed);
-        normal_distribution<double> distribution(0.0, 1.0);
+        // The (dt, dE) of particle i are the i-th pair of the generator, so
+        // the beam is the same with any number of threads
+        #pragma omp parallel for
         for (int i = 0; i < Beam->n_macroparticles; ++i) {
-            double r = distribution(generator);
-            if (eta0 > 0)
-                Beam->dt[i] = sigma_dt * r + (phi_s - phi_rf) / omega_rf;
-            else
-                Beam->dt[i] =
-                    sigma_dt * r + (phi_s - phi_rf - constant::pi) / omega_rf;
-            r = distribution(generator);
-            Beam->dE[i] = sigma_dE * r;
+            double r1, r2;
+            generator.normal2(i, r1, r2);
+            Beam->dt[i] = sigma_dt * r1 + dt_offset;
+            Beam->dE[i] = sigma_dE * r2;
         }
     }
 
-    // TODO test this one
     if (reinsertion == true) {
-        auto is_not_in = is_in_separatrix(GP, RfP, Beam, Beam->dt, Beam->dE);
-        for (auto &b : is_not_in) b = 1 - b;
-        int size = accumulate(is_not_in.begin(), is_not_in.end(), 0);
-        default_random_engine generator(seed);
-        normal_distribution<double> distribution(0.0, 1.0);
-
-        while (size != 0) {
-            for (int i = 0; i < size; ++i) {
-                if (is_not_in[i] == false) continue;
-
-                double r = distribution(generator);
-                if (eta0 > 0)
-                    Beam->dt[i] = sigma_dt * r + (phi_s - phi_rf) / omega_rf;
-                else
-                    Beam->dt[i] = sigma_dt * r
-                                  + (phi_s - phi_rf - constant::pi) / omega_rf;
-                r = distribution(generator);
-                Beam->dE[i] = sigma_dE * r;
+        // Only the particles outside the separatrix are drawn again, from
+        // another stream of the generator in every pass, until all are in.
+        // A bunch much larger than the bucket would never get there.
+        const uint64_t max_passes = 1000;
+        auto is_in = is_in_separatrix(GP, RfP, Beam, Beam->dt, Beam->dE);
+        vector<int> rejected;
+        for (int i = 0; i < Beam->n_macroparticles; ++i)
+            if (!is_in[i]) rejected.push_back(i);
+
+        f_vector_t dt, dE;
+        for (uint64_t pass = 1; !rejected.empty(); ++pass) {
+            if (pass > max_passes) {
+                cerr << "ERROR: longitudinal_bigaussian: " << rejected.size()
+                     << " particles still outside of the separatrix after "
+                     << max_passes << " reinsertion passes\n";
+                exit(-1);
+            }
+            const auto stream = generator.substream(pass);
+            const int n = rejected.size();
+            dt.resize(n);
+            dE.resize(n);
+            #pragma omp parallel for
+            for (int k = 0; k < n; ++k) {
+                double r1, r2;
+                stream.normal2(rejected[k], r1, r2);
+                dt[k] = sigma_dt * r1 + dt_offset;
+                dE[k] = sigma_dE * r2;
             }
-            is_not_in = is_in_separatrix(GP, RfP, Beam, Beam->dt, Beam->dE);
-            size = accumulate(is_not_in.begin(), is_not_in.end(), 0);
 
+            is_in = is_in_separatrix(GP, RfP, Beam, dt, dE);
+            int m = 0;
+            for (int k = 0; k < n; ++k) {
+                Beam->dt[rejected[k]] = dt[k];
+                Beam->dE[rejected[k]] = dE[k];
+                if (!is_in[k]) rejected[m++] = rejected[k];
+            }
+            rejected.resize(m);
         }
     }
 }
@@ -37,7 +37,7 @@ Slices::Slices(RfParameters *RfP, Beams *Beam, int n_slices,
     if (direct_slicing) track();
 }
 
-Slices::~Slices() { fft::destroy_plans(); }
+Slices::~Slices() {}
 
 void Slices::set_cuts()
 {
@@ -363,8 +363,14 @@ void Slices::beam_spectrum_generation(int n, bool onlyRFFT)
     fBeamSpectrumFreq = fft::rfftfreq(n, bin_centers[1] - bin_centers[0]);
 
     if (onlyRFFT == false) {
-        auto v = n_macroparticles;
-        fft::rfft(v, fBeamSpectrum, n, Context::n_threads);
+        if (n == (int) n_macroparticles.size()) {
+            fBeamSpectrum.resize(n / 2 + 1);
+            fft::rfft(n_macroparticles.data(), fBeamSpectrum.data(), n,
+                      Context::n_threads);
+        } else {
+            auto v = n_macroparticles;
+            fft::rfft(v, fBeamSpectrum, n, Context::n_threads);
+        }
     }
 }
 
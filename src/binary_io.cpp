@@ -0,0 +1,220 @@
+/*
+ * binary_io.cpp
+ *
+ *  Binary files of doubles, memory-mapped, and parallel text parsing
+ */
+
+#include <blond/binary_io.h>
+#include <blond/openmp.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace binary_io {
+
+    static const char file_magic[8] = {'B', 'L', 'O', 'N', 'D', 'V', 'E', 'C'};
+    static const uint64_t file_version = 1;
+
+    static bool read_header(std::ifstream &in, header_t &header)
+    {
+        in.read(reinterpret_cast<char *>(&header), sizeof(header));
+        return in.gcount() == sizeof(header) &&
+               std::memcmp(header.magic, file_magic, sizeof(file_magic)) == 0;
+    }
+
+    static void check_header(const header_t &header, const size_t length,
+                             const std::string &file)
+    {
+        if (header.version != file_version ||
+                length < sizeof(header_t) + header.size * sizeof(double)) {
+            std::cerr << "[binary_io]: ERROR " << file
+                      << " is not a valid binary file\n";
+            exit(-1);
+        }
+    }
+
+    MappedFile::MappedFile(const std::string &file)
+        : fMap(nullptr), fData(nullptr), fSize(0)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in.good()) {
+            std::cerr << "[binary_io]: ERROR file " << file
+                      << " does not exist\n";
+            exit(-1);
+        }
+        fSize = util::getFileSize(file);
+
+#ifndef WIN32
+        const int fd = open(file.c_str(), O_RDONLY);
+        if (fd >= 0 && fSize > 0) {
+            void *map = mmap(nullptr, fSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (map != MAP_FAILED) {
+                fMap = map;
+                fData = static_cast<const char *>(map);
+                return;
+            }
+        } else if (fd >= 0) {
+            close(fd);
+        }
+#endif
+        fBuffer.resize(fSize);
+        in.read(fBuffer.data(), fSize);
+        fData = fBuffer.data();
+    }
+
+    MappedFile::MappedFile(MappedFile &&other)
+        : fMap(other.fMap), fData(other.fData), fSize(other.fSize),
+          fBuffer(std::move(other.fBuffer))
+    {
+        if (!fMap)
+            fData = fBuffer.data();
+        other.fMap = nullptr;
+        other.fData = nullptr;
+        other.fSize = 0;
+    }
+
+    MappedFile::~MappedFile()
+    {
+#ifndef WIN32
+        if (fMap)
+            munmap(fMap, fSize);
+#endif
+    }
+
+    MappedVector::MappedVector(const std::string &file)
+        : fFile(file), fData(nullptr), fSize(0), fColumns(1)
+    {
+        header_t header;
+        if (fFile.size() >= sizeof(header))
+            std::memcpy(&header, fFile.data(), sizeof(header));
+        if (fFile.size() < sizeof(header) ||
+                std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0) {
+            std::cerr << "[binary_io]: ERROR " << file
+                      << " is not a binary file\n";
+            exit(-1);
+        }
+        check_header(header, fFile.size(), file);
+        fSize = header.size;
+        fColumns = header.columns;
+        fData = reinterpret_cast<const double *>(fFile.data() +
+                sizeof(header_t));
+    }
+
+    bool is_binary(const std::string &file)
+    {
+        header_t header;
+        std::ifstream in(file, std::ios::binary);
+        return in.good() && read_header(in, header);
+    }
+
+    bool write(const std::string &file, const double *v, const size_t n,
+               const size_t columns)
+    {
+        header_t header;
+        std::memcpy(header.magic, file_magic, sizeof(file_magic));
+        header.version = file_version;
+        header.size = n;
+        header.columns = columns;
+
+        std::ofstream out(file, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(v), n * sizeof(double));
+        if (!out.good()) {
+            std::cerr << "[binary_io]: WARNING could not write to "
+                      << file << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // The numbers of text[first, last). Like the line by line parsing of
+    // util::read_vector_from_file, the rest of a line is skipped after
+    // something that is not a number.
+    static void parse(const char *text, const size_t first, const size_t last,
+                      f_vector_t &v)
+    {
+        const char *p = text + first;
+        const char *end = text + last;
+        while (p < end) {
+            if (std::isspace(static_cast<unsigned char>(*p))) {
+                ++p;
+                continue;
+            }
+            char *next;
+            const double x = std::strtod(p, &next);
+            if (next == p) {
+                while (p < end && *p != '\n')
+                    ++p;
+                continue;
+            }
+            v.push_back(x);
+            p = next;
+        }
+    }
+
+    void read_text(f_vector_t &v, const std::string &file)
+    {
+        v.clear();
+        std::ifstream in(file, std::ios::binary);
+        if (!in.good()) {
+            std::cout << "Error: file " << file << " does not exist\n";
+            exit(-1);
+        }
+        std::string text(util::getFileSize(file), '\0');
+        in.read(&text[0], text.size());
+        text.resize(in.gcount());
+        const size_t length = text.size();
+
+        // Parts of whole lines, one per thread
+        const int parts = std::max(1, std::min(omp_get_max_threads(),
+                                               (int)(length >> 16)));
+        std::vector<size_t> bounds(parts + 1, length);
+        bounds[0] = 0;
+        for (int i = 1; i < parts; ++i) {
+            size_t b = std::max(bounds[i - 1], length / parts * i);
+            while (b < length && text[b] != '\n')
+                ++b;
+            bounds[i] = b;
+        }
+
+        std::vector<f_vector_t> values(parts);
+        #pragma omp parallel for schedule(static, 1)
+        for (int i = 0; i < parts; ++i) {
+            values[i].reserve((bounds[i + 1] - bounds[i]) / 8);
+            parse(text.c_str(), bounds[i], bounds[i + 1], values[i]);
+        }
+
+        size_t size = 0;
+        for (const auto &part : values)
+            size += part.size();
+        v.reserve(size);
+        for (const auto &part : values)
+            v.insert(v.end(), part.begin(), part.end());
+    }
+
+    void read(f_vector_t &v, const std::string &file)
+    {
+        if (is_binary(file))
+            v = MappedVector(file).vector();
+        else
+            read_text(v, file);
+    }
+
+    bool convert(const std::string &text_file, const std::string &binary_file,
+                 const size_t columns)
+    {
+        f_vector_t v;
+        read_text(v, text_file);
+        return write(binary_file, v, columns);
+    }
+}
@@ -0,0 +1,288 @@
+/*
+ * checkpoint.cpp
+ *
+ *  Snapshot of the tracking state, to restart a simulation
+ */
+
+#include <blond/binary_io.h>
+#include <blond/checkpoint.h>
+#include <blond/impedances/InducedVoltage.h>
+#include <blond/monitors/Monitors.h>
+#include <blond/openmp.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+// The file is this header, then for every entry its name length, type and
+// number of values, its name and its values, each padded to 8 bytes
+struct checkpoint_header_t {
+    char magic[8];
+    uint64_t version;
+    uint64_t entries;
+};
+
+static const char checkpoint_magic[8] = {'B', 'L', 'O', 'N', 'D', 'C', 'K', 'P'};
+static const uint64_t checkpoint_version = 1;
+
+static size_t padded(const size_t bytes) { return (bytes + 7) / 8 * 8; }
+
+// Bytes per value of the float64, int32 and uint32 types
+static size_t type_size(const uint64_t type) { return type == 0 ? 8 : 4; }
+
+// memcpy, in parallel for the large arrays
+static void parallel_copy(char *dst, const char *src, const size_t bytes)
+{
+    const int chunks = std::min<size_t>(omp_get_max_threads(),
+                                        std::max<size_t>(1, bytes >> 20));
+    #pragma omp parallel for
+    for (int i = 0; i < chunks; ++i) {
+        const size_t first = bytes / chunks * i;
+        const size_t last = (i == chunks - 1) ? bytes : bytes / chunks * (i + 1);
+        std::memcpy(dst + first, src + first, last - first);
+    }
+}
+
+Checkpoint::Checkpoint(std::string filename, int every, RfParameters *RfP,
+                       Beams *Beam, Slices *Slices, PhaseLoop *PL,
+                       LHCNoiseFB *noiseFB, SlicesMonitor *slicesMonitor,
+                       BunchMonitor *bunchMonitor,
+                       TotalInducedVoltage *totalInducedVoltage,
+                       PhaseSpaceMonitor *phaseSpaceMonitor)
+{
+    fFileName = filename;
+    fEvery = every;
+    fRfP = RfP;
+    fBeam = Beam;
+    fSlices = Slices;
+    fPL = PL;
+    fNoiseFB = noiseFB;
+    fSlicesMonitor = slicesMonitor;
+    fBunchMonitor = bunchMonitor;
+    fTotalInducedVoltage = totalInducedVoltage;
+    fPhaseSpaceMonitor = phaseSpaceMonitor;
+
+    add("Beam/dt", fBeam->dt);
+    add("Beam/dE", fBeam->dE);
+    add("Beam/id", fBeam->id);
+    add("Beam/n_macroparticles_lost", fBeam->n_macroparticles_lost);
+
+    add("RfP/counter", fRfP->counter);
+    add("RfP/phi_rf", fRfP->phi_rf);
+    add("RfP/omega_rf", fRfP->omega_rf);
+    add("RfP/dphi_rf", fRfP->dphi_rf);
+    add("RfP/dphi_rf_steering", fRfP->dphi_rf_steering);
+
+    if (fPL)
+        fPL->checkpoint(*this);
+
+    if (fNoiseFB) {
+        add("LHCNoiseFB/x", fNoiseFB->fX);
+        add("LHCNoiseFB/bl_meas", fNoiseFB->fBlMeas);
+        add("LHCNoiseFB/bl_meas_bbb", fNoiseFB->fBlMeasBBB);
+    }
+
+    if (fSlices) {
+        add("Slices/cut_left", fSlices->cut_left);
+        add("Slices/cut_right", fSlices->cut_right);
+        add("Slices/edges", fSlices->edges);
+        add("Slices/bin_centers", fSlices->bin_centers);
+        add("Slices/n_macroparticles", fSlices->n_macroparticles);
+    }
+
+    if (fTotalInducedVoltage) {
+        add("TotalInducedVoltage/counter_turn",
+            fTotalInducedVoltage->fCounterTurn);
+        add("TotalInducedVoltage/induced_voltage",
+            fTotalInducedVoltage->fInducedVoltage);
+        // The wakes of the previous turns
+        add("TotalInducedVoltage/induced_voltage_mem",
+            fTotalInducedVoltage->fInducedVoltageMem);
+    }
+
+    if (fSlicesMonitor) {
+        add("SlicesMonitor/i_turn", fSlicesMonitor->fITurn);
+        add("SlicesMonitor/i_track", fSlicesMonitor->fITrack);
+    }
+    if (fBunchMonitor)
+        add("BunchMonitor/i_turn", fBunchMonitor->fITurn);
+    if (fPhaseSpaceMonitor)
+        add("PhaseSpaceMonitor/last_turn", fPhaseSpaceMonitor->fLastTurn);
+}
+
+Checkpoint::~Checkpoint() {}
+
+template <typename T>
+void Checkpoint::add_scalar(const std::string &name, T &x, type_t type)
+{
+    entry_t e;
+    e.name = name;
+    e.type = type;
+    e.data = [&x]() { return (void *) &x; };
+    e.size = []() { return (size_t) 1; };
+    e.resize = [name](size_t n) {
+        if (n != 1) {
+            std::cerr << "[Checkpoint]: ERROR " << name
+                      << " is not a single value in the snapshot\n";
+            exit(-1);
+        }
+    };
+    fEntries.push_back(e);
+}
+
+template <typename T>
+void Checkpoint::add_vector(const std::string &name, std::vector<T> &v,
+                            type_t type)
+{
+    entry_t e;
+    e.name = name;
+    e.type = type;
+    e.data = [&v]() { return (void *) v.data(); };
+    e.size = [&v]() { return v.size(); };
+    e.resize = [&v](size_t n) { v.resize(n); };
+    fEntries.push_back(e);
+}
+
+void Checkpoint::add(const std::string &name, double &x)
+{
+    add_scalar(name, x, float64);
+}
+
+void Checkpoint::add(const std::string &name, int &x)
+{
+    add_scalar(name, x, int32);
+}
+
+void Checkpoint::add(const std::string &name, uint &x)
+{
+    add_scalar(name, x, uint32);
+}
+
+void Checkpoint::add(const std::string &name, f_vector_t &v)
+{
+    add_vector(name, v, float64);
+}
+
+void Checkpoint::add(const std::string &name, int_vector_t &v)
+{
+    add_vector(name, v, int32);
+}
+
+void Checkpoint::add(const std::string &name, f_vector_2d_t &v)
+{
+    for (uint i = 0; i < v.size(); ++i)
+        add(name + "/" + std::to_string(i), v[i]);
+}
+
+void Checkpoint::add(const std::string &name, TurnArray &a)
+{
+    if (a.lazy()) {
+        add(name + "/turns", a.fWrittenTurns);
+        add(name + "/values", a.fWrittenValues);
+    } else {
+        add(name, a.fValues);
+    }
+}
+
+void Checkpoint::add(const std::string &name, std::vector<TurnArray> &v)
+{
+    for (uint i = 0; i < v.size(); ++i)
+        add(name + "/" + std::to_string(i), v[i]);
+}
+
+void Checkpoint::track()
+{
+    if (fEvery > 0 && fRfP->counter > 0 && fRfP->counter % fEvery == 0)
+        save();
+}
+
+bool Checkpoint::save()
+{
+    const std::string tmp = fFileName + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+
+    checkpoint_header_t header;
+    std::memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+    header.version = checkpoint_version;
+    header.entries = fEntries.size();
+    out.write((const char *) &header, sizeof(header));
+
+    const char zeros[8] = {0};
+    for (auto &e : fEntries) {
+        const uint64_t info[3] = {e.name.size(), (uint64_t) e.type, e.size()};
+        out.write((const char *) info, sizeof(info));
+        out.write(e.name.data(), e.name.size());
+        out.write(zeros, padded(e.name.size()) - e.name.size());
+        const size_t bytes = e.size() * type_size(e.type);
+        out.write((const char *) e.data(), bytes);
+        out.write(zeros, padded(bytes) - bytes);
+    }
+    out.close();
+
+    if (!out.good() || std::rename(tmp.c_str(), fFileName.c_str()) != 0) {
+        std::cerr << "[Checkpoint]: WARNING could not write "
+                  << fFileName << "\n";
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Checkpoint::restore()
+{
+    if (!std::ifstream(fFileName).good())
+        return false;
+
+    binary_io::MappedFile file(fFileName);
+    const char *p = file.data();
+    const char *end = p + file.size();
+
+    auto error = [this](const std::string & what) {
+        std::cerr << "[Checkpoint]: ERROR " << fFileName << ": " << what
+                  << "\n";
+        exit(-1);
+    };
+
+    checkpoint_header_t header;
+    if (file.size() < sizeof(header))
+        error("not a snapshot");
+    std::memcpy(&header, p, sizeof(header));
+    if (std::memcmp(header.magic, checkpoint_magic,
+                    sizeof(checkpoint_magic)) != 0 ||
+            header.version != checkpoint_version)
+        error("not a snapshot");
+    p += sizeof(header);
+
+    struct stored_t {
+        uint64_t type;
+        uint64_t size;
+        const char *data;
+    };
+    std::map<std::string, stored_t> stored;
+    for (uint64_t i = 0; i < header.entries; ++i) {
+        uint64_t info[3];
+        if (p + sizeof(info) > end)
+            error("truncated");
+        std::memcpy(info, p, sizeof(info));
+        p += sizeof(info);
+        const size_t bytes = info[2] * type_size(info[1]);
+        if (p + padded(info[0]) + bytes > end)
+            error("truncated");
+        const std::string name(p, info[0]);
+        p += padded(info[0]);
+        stored[name] = {info[1], info[2], p};
+        p += padded(bytes);
+    }
+
+    for (auto &e : fEntries) {
+        auto it = stored.find(e.name);
+        if (it == stored.end() || it->second.type != (uint64_t) e.type)
+            error(e.name + " is missing or has another type");
+        e.resize(it->second.size);
+        parallel_copy((char *) e.data(), it->second.data,
+                      it->second.size * type_size(e.type));
+    }
+    return true;
+}
@@ -0,0 +1,418 @@
+/*
+ * fft.cpp
+ *
+ *  Process-wide fftw plan registry and fft length selection
+ */
+
+#include <blond/fft.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+namespace fft {
+
+    template <typename T>
+    static std::shared_ptr<void> fftw_buffer(const size_t bytes)
+    {
+        return std::shared_ptr<void>(fftw_traits<T>::malloc(bytes),
+                                     fftw_traits<T>::free);
+    }
+
+    static std::string single_wisdom_file(const std::string &file)
+    {
+        return file + ".single";
+    }
+
+    // Holds the slot of a thread, gives it back when the thread exits
+    struct SlotGuard {
+        uint slot;
+        SlotGuard() : slot(PlanRegistry::instance().acquire_slot()) {}
+        ~SlotGuard() { PlanRegistry::instance().release_slot(slot); }
+    };
+
+    uint plan_slot()
+    {
+        // The slots are handed out in one place, a static of the header
+        // would count per translation unit
+        thread_local SlotGuard guard;
+        return guard.slot;
+    }
+
+    PlanRegistry &PlanRegistry::instance()
+    {
+        // Initialization of a local static is thread-safe since c++11
+        static PlanRegistry registry;
+        return registry;
+    }
+
+    PlanRegistry::~PlanRegistry() { clear(); }
+
+    template <>
+    std::map<PlanRegistry::plan_key_t, fft_plan_t> &
+    PlanRegistry::plans<double>() { return fPlans; }
+
+    template <>
+    std::map<PlanRegistry::plan_key_t, fftf_plan_t> &
+    PlanRegistry::plans<float>() { return fPlansSingle; }
+
+    template <typename T>
+    basic_fft_plan_t<T> PlanRegistry::get(uint n, fft_type_t type,
+                                          uint threads, uint flags,
+                                          uint howmany, uint slot)
+    {
+        typedef std::complex<T> complex_type;
+
+        std::lock_guard<std::mutex> lock(fMutex);
+
+        auto &cache = plans<T>();
+        const plan_key_t key(n, type, threads, flags, howmany, slot);
+        auto it = cache.find(key);
+        if (it != cache.end())
+            return it->second;
+
+        // std::cout << "I have to create a new plan :(\n";
+        basic_fft_plan_t<T> plan;
+        plan.n = n;
+        plan.type = type;
+        plan.threads = threads;
+        plan.flags = flags;
+        plan.howmany = howmany;
+
+        if (howmany > 1 && type != IRFFT) {
+            std::cerr << "[fft::PlanRegistry]: ERROR "
+                      << "Batched plans are only supported for irfft\n";
+            exit(-1);
+        }
+
+        if (type == IRFFT && howmany > 1) {
+            plan.in = fftw_buffer<T>(sizeof(complex_type) * (n / 2 + 1) * howmany);
+            plan.out = fftw_buffer<T>(sizeof(T) * n * howmany);
+            plan.p = init_irfft_many<T>(n, howmany,
+                                        static_cast<complex_type *>(plan.in.get()),
+                                        static_cast<T *>(plan.out.get()),
+                                        flags, threads);
+        } else if (type == FFT || type == IFFT) {
+            plan.in = fftw_buffer<T>(sizeof(complex_type) * n);
+            plan.out = fftw_buffer<T>(sizeof(complex_type) * n);
+            plan.p = init_fft<T>(n, static_cast<complex_type *>(plan.in.get()),
+                                 static_cast<complex_type *>(plan.out.get()),
+                                 type == FFT ? FFTW_FORWARD : FFTW_BACKWARD,
+                                 flags, threads);
+        } else if (type == RFFT) {
+            plan.in = fftw_buffer<T>(sizeof(T) * n);
+            plan.out = fftw_buffer<T>(sizeof(complex_type) * (n / 2 + 1));
+            plan.p = init_rfft<T>(n, static_cast<T *>(plan.in.get()),
+                                  static_cast<complex_type *>(plan.out.get()),
+                                  flags, threads);
+        } else if (type == IRFFT) {
+            plan.in = fftw_buffer<T>(sizeof(complex_type) * (n / 2 + 1));
+            plan.out = fftw_buffer<T>(sizeof(T) * n);
+            plan.p = init_irfft<T>(n, static_cast<complex_type *>(plan.in.get()),
+                                   static_cast<T *>(plan.out.get()),
+                                   flags, threads);
+        } else {
+            std::cerr << "[fft::PlanRegistry]: ERROR "
+                      << "Wrong fft type!\n";
+            exit(-1);
+        }
+
+        // FFTW_WISDOM_ONLY without the wisdom, nothing to keep
+        if (plan.p == NULL)
+            return plan;
+
+        cache[key] = plan;
+
+        if (!(flags & FFTW_ESTIMATE) && !fWisdomFile.empty())
+            export_wisdom_unlocked();
+
+        return plan;
+    }
+
+    template API fft_plan_t PlanRegistry::get<double>(uint, fft_type_t, uint,
+            uint, uint, uint);
+    template API fftf_plan_t PlanRegistry::get<float>(uint, fft_type_t, uint,
+            uint, uint, uint);
+
+    void PlanRegistry::clear()
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        // The fftw plans are gone after this, the buffers are released
+        // with the last copy of the plan
+        for (auto &i : fPlans)
+            fftw_destroy_plan(i.second.p);
+        for (auto &i : fPlansSingle)
+            fftwf_destroy_plan(i.second.p);
+        fPlans.clear();
+        fPlansSingle.clear();
+    }
+
+    uint PlanRegistry::acquire_slot()
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        if (fFreeSlots.empty())
+            return fNextSlot++;
+        const uint slot = fFreeSlots.back();
+        fFreeSlots.pop_back();
+        return slot;
+    }
+
+    template <typename T>
+    void PlanRegistry::erase_slot(uint slot)
+    {
+        auto &cache = plans<T>();
+        for (auto i = cache.begin(); i != cache.end();) {
+            if (std::get<5>(i->first) == slot) {
+                fftw_traits<T>::destroy_plan(i->second.p);
+                i = cache.erase(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    void PlanRegistry::release_slot(uint slot)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        erase_slot<double>(slot);
+        erase_slot<float>(slot);
+        fFreeSlots.push_back(slot);
+    }
+
+    uint PlanRegistry::size()
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        return fPlans.size() + fPlansSingle.size();
+    }
+
+    void PlanRegistry::set_flags(uint flags)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fFlags = flags;
+    }
+
+    uint PlanRegistry::flags()
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        return fFlags;
+    }
+
+    bool PlanRegistry::set_wisdom_file(const std::string &file)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fWisdomFile = file;
+        // A missing file is fine, it is created with the first export
+        fftwf_import_wisdom_from_filename(single_wisdom_file(file).c_str());
+        return fftw_import_wisdom_from_filename(file.c_str()) != 0;
+    }
+
+    bool PlanRegistry::export_wisdom()
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        return export_wisdom_unlocked();
+    }
+
+    bool PlanRegistry::export_wisdom_unlocked()
+    {
+        if (fWisdomFile.empty())
+            return false;
+        bool ok = fftw_export_wisdom_to_filename(fWisdomFile.c_str()) != 0;
+        if (!fPlansSingle.empty())
+            ok &= fftwf_export_wisdom_to_filename(
+                      single_wisdom_file(fWisdomFile).c_str()) != 0;
+        if (!ok) {
+            std::cerr << "[fft::PlanRegistry]: WARNING "
+                      << "could not write wisdom to " << fWisdomFile << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    SizeSelector &SizeSelector::instance()
+    {
+        static SizeSelector selector;
+        return selector;
+    }
+
+    SizeSelector::SizeSelector()
+    {
+        fSmooth235 = mymath::smooth_numbers({2, 3, 5});
+
+        // 2,3,5,7-smooth lengths, and the same times 11
+        fSmoothFFTW = mymath::smooth_numbers({2, 3, 5, 7});
+        const uint size = fSmoothFFTW.size();
+        const uint limit = std::numeric_limits<int>::max() / 11;
+        for (uint i = 0; i < size && fSmoothFFTW[i] <= limit; ++i)
+            fSmoothFFTW.push_back(11 * fSmoothFFTW[i]);
+        std::sort(fSmoothFFTW.begin(), fSmoothFFTW.end());
+    }
+
+    // The first length of the table greater than target, 0 if none
+    static uint next_in_table(const std::vector<uint> &table, uint target)
+    {
+        auto it = std::upper_bound(table.begin(), table.end(), target);
+        return (it == table.end()) ? 0 : *it;
+    }
+
+    uint SizeSelector::size(uint target)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+
+        if (fPolicy == smallest_235)
+            return next_in_table(fSmooth235, target);
+        if (fPolicy == smallest_fftw)
+            return next_in_table(fSmoothFFTW, target);
+
+        auto it = fFastest.find(target);
+        if (it != fFastest.end())
+            return it->second;
+
+        // The next power of two is always fast, longer lengths are not
+        // worth trying
+        unsigned long long limit = 1;
+        while (limit <= target)
+            limit *= 2;
+
+        const uint measured = fTimings.size();
+        uint best = 0;
+        double bestTime = std::numeric_limits<double>::max();
+        for (auto i = std::upper_bound(fSmoothFFTW.begin(), fSmoothFFTW.end(),
+                                       target);
+                i != fSmoothFFTW.end() && *i <= limit; ++i) {
+            const double t = timing_unlocked(*i);
+            if (t < bestTime) {
+                bestTime = t;
+                best = *i;
+            }
+        }
+
+        if (fTimings.size() > measured && !fTimingsFile.empty())
+            export_timings_unlocked();
+
+        fFastest[target] = best;
+        return best;
+    }
+
+    void SizeSelector::set_policy(size_policy_t policy)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fPolicy = policy;
+    }
+
+    size_policy_t SizeSelector::policy()
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        return fPolicy;
+    }
+
+    double SizeSelector::timing(uint n)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        return timing_unlocked(n);
+    }
+
+    // Seconds per call of f, with enough repetitions to fill a
+    // millisecond, the best of three
+    template <typename F>
+    static double seconds_per_call(F f)
+    {
+        auto run = [&f](const uint reps) {
+            auto start = std::chrono::steady_clock::now();
+            for (uint i = 0; i < reps; ++i)
+                f();
+            std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+            return elapsed.count();
+        };
+
+        uint reps = 1;
+        double elapsed;
+        while ((elapsed = run(reps)) < 1e-3 && reps < (1u << 20))
+            reps *= 2;
+        double best = elapsed / reps;
+        for (int trial = 0; trial < 2; ++trial)
+            best = std::min(best, run(reps) / reps);
+        return best;
+    }
+
+    double SizeSelector::timing_unlocked(uint n)
+    {
+        auto it = fTimings.find(n);
+        if (it != fTimings.end())
+            return it->second;
+
+        // The plan that rfft() uses, with one thread as only the relative
+        // speed of the lengths matters
+        auto plan = find_preserving_plan<double>(n, RFFT, 1);
+        std::fill((double *) plan.in.get(), (double *) plan.in.get() + n, 1.0);
+
+        const double best = seconds_per_call([&plan]() {
+            fftw_execute(plan.p);
+        });
+        fTimings[n] = best;
+        return best;
+    }
+
+    static double measure_direct_speedup()
+    {
+        // A signal and a kernel of a typical profile and wake, around
+        // the crossover of the two methods
+        const uint s = 256, k = 256;
+        const uint n = SizeSelector::instance().size(s + k - 1);
+        std::vector<double> signal(s, 1.0), kernel(k, 0.5), res(s + k - 1);
+
+        const double direct = seconds_per_call([&]() {
+            mymath::convolution(signal.data(), s, kernel.data(), k,
+                                res.data());
+        }) / (2.0 * s * k);
+        const double fft = SizeSelector::instance().timing(n) /
+                           (2.5 * n * std::log2((double) n));
+        return fft / direct;
+    }
+
+    double Convolution::direct_speedup()
+    {
+        // Initialization of a local static is thread-safe since c++11
+        static const double speedup = measure_direct_speedup();
+        return speedup;
+    }
+
+    bool SizeSelector::set_timings_file(const std::string &file)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fTimingsFile = file;
+        fFastest.clear();
+
+        // A missing file is fine, it is created with the first export
+        std::ifstream in(file);
+        if (!in.is_open())
+            return false;
+        uint n;
+        double seconds;
+        while (in >> n >> seconds)
+            fTimings[n] = seconds;
+        return true;
+    }
+
+    bool SizeSelector::export_timings()
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        return export_timings_unlocked();
+    }
+
+    bool SizeSelector::export_timings_unlocked()
+    {
+        if (fTimingsFile.empty())
+            return false;
+        std::ofstream out(fTimingsFile);
+        if (!out.is_open()) {
+            std::cerr << "[fft::SizeSelector]: WARNING "
+                      << "could not write timings to " << fTimingsFile << "\n";
+            return false;
+        }
+        out << std::scientific;
+        out.precision(6);
+        for (const auto &t : fTimings)
+            out << t.first << " " << t.second << "\n";
+        return true;
+    }
+}
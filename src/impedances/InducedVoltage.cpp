@@ -35,9 +35,48 @@ void linear_interp_kick(
     }
 }
 
+// Induced voltage of impedances acting on a beam spectrum, computed in
+// the precision of the spectrum. The nRows impedances are stored row after
+// row, their voltages are summed into res (n_slices points) and copied to
+// the rows of saved, if given. in and voltages are work arrays.
+template <typename T>
+static void impedance_voltage(const complex_t *imped,
+                              const std::complex<T> *spectrum,
+                              const uint nRows, const uint nFreq,
+                              const uint nFFT, const double factor,
+                              f_vector_t &res, double *saved,
+                              std::vector<std::complex<T>> &in,
+                              std::vector<T> &voltages)
+{
+    in.resize(nRows * nFreq);
+
+    #pragma omp parallel for collapse(2)
+    for (int i = 0; i < (int) nRows; ++i) {
+        for (int j = 0; j < (int) nFreq; ++j)
+            in[i * nFreq + j] =
+                std::complex<T>(imped[i * nFreq + j]) * spectrum[j];
+    }
+
+    voltages.resize(nRows * nFFT);
+    fft::irfft_many(in.data(), voltages.data(), nFFT, nRows,
+                    Context::n_threads, factor);
+
+    const int nSlices = res.size();
+    for (uint i = 0; i < nRows; ++i) {
+        const T *row = &voltages[i * nFFT];
+        #pragma omp parallel for
+        for (int j = 0; j < nSlices; ++j) {
+            res[j] += row[j];
+            if (saved)
+                saved[i * nSlices + j] = row[j];
+        }
+    }
+}
+
 InducedVoltageTime::InducedVoltageTime(Slices *slices,
                                        const std::vector<Intensity *> &WakeList,
-                                       time_or_freq TimeOrFreq)
+                                       time_or_freq TimeOrFreq,
+                                       fft::precision_t precision)
 {
     // Induced voltage derived from the sum of
     // several wake fields (time domain).*
@@ -59,12 +98,31 @@ InducedVoltageTime::InducedVoltageTime(Slices *slices,
     sum_wakes(fTimeArray);
 
     fCut = fTimeArray.size() + fSlices->n_slices - 1;
-    fShape = mymath::next_regular(fCut);
+    fShape = fft::good_size(fCut);
 
     fTimeOrFreq = TimeOrFreq;
+    fPrecision = precision;
+
+    fft::Convolution::conv_method_t method;
+    switch (fTimeOrFreq) {
+        case time_domain:
+            method = fft::Convolution::direct_method;
+            break;
+        case freq_domain:
+            method = fft::Convolution::fft_method;
+            break;
+        case auto_domain:
+            method = fft::Convolution::auto_method;
+            break;
+        default:
+            std::cerr << "Error: Only freq_domain, time_domain or auto_domain "
+                      << "are allowed\n";
+            exit(-1);
+    }
+    fConvolution = fft::Convolution(fTotalWake, method, fPrecision);
 }
 
-InducedVoltageTime::~InducedVoltageTime() { fft::destroy_plans(); }
+InducedVoltageTime::~InducedVoltageTime() {}
 
 inline void InducedVoltageTime::track(Beams *beam)
 {
@@ -99,7 +157,9 @@ void InducedVoltageTime::reprocess(Slices *newSlices)
     sum_wakes(fTimeArray);
 
     fCut = fTimeArray.size() + fSlices->n_slices - 1;
-    fShape = mymath::next_regular(fCut);
+    fShape = fft::good_size(fCut);
+
+    fConvolution.set_kernel(fTotalWake);
 }
 
 f_vector_t InducedVoltageTime::induced_voltage_generation(Beams *beam,
@@ -112,27 +172,8 @@ f_vector_t InducedVoltageTime::induced_voltage_generation(Beams *beam,
     const double factor = -beam->charge * constant::e * beam->intensity
                           / beam->n_macroparticles;
 
-    if (fTimeOrFreq == freq_domain) {
-        auto in1 = fSlices->n_macroparticles;
-        auto in2 = fTotalWake;
-
-        fft::convolution_with_ffts(in1, in2, inducedVoltage);
-        inducedVoltage *= factor;
-
-    } else if (fTimeOrFreq == time_domain) {
-
-        inducedVoltage.resize(fTotalWake.size() + fSlices->n_slices - 1);
-
-        mymath::convolution(fTotalWake.data(), fTotalWake.size(),
-                            fSlices->n_macroparticles.data(),
-                            fSlices->n_macroparticles.size(),
-                            inducedVoltage.data());
-        inducedVoltage *= factor;
-
-    } else {
-        std::cerr << "Error: Only freq_domain or time_domain are allowed\n";
-        exit(-1);
-    }
+    fConvolution.convolve(fSlices->n_macroparticles, inducedVoltage);
+    inducedVoltage *= factor;
 
     fInducedVoltage = inducedVoltage;
     fInducedVoltage.resize((uint)fSlices->n_slices);
@@ -149,7 +190,8 @@ InducedVoltageFreq::InducedVoltageFreq(Slices *slices,
                                        freq_res_option_t freq_res_option,
                                        uint NTurnsMem,
                                        bool recalculationImpedance,
-                                       bool saveIndividualVoltages)
+                                       bool saveIndividualVoltages,
+                                       fft::precision_t precision)
 {
     fNTurnsMem = NTurnsMem;
     fSlices = slices;
@@ -160,6 +202,8 @@ InducedVoltageFreq::InducedVoltageFreq(Slices *slices,
     auto timeResolution = (fSlices->bin_centers[1] - fSlices->bin_centers[0]);
     fRecalculationImpedance = recalculationImpedance;
     fFreqResOption = freq_res_option;
+    fSaveIndividualVoltages = saveIndividualVoltages;
+    fPrecision = precision;
 
     if (fNTurnsMem == 0) {
 
@@ -183,7 +227,7 @@ InducedVoltageFreq::InducedVoltageFreq(Slices *slices,
                     exit(-1);
                     break;
             }
-            fNFFTSampling = mymath::next_regular(a);
+            fNFFTSampling = fft::good_size(a);
 
             if ((int) fNFFTSampling < fSlices->n_slices) {
                 std::cerr << "The input frequency resolution step is too big, "
@@ -195,7 +239,7 @@ InducedVoltageFreq::InducedVoltageFreq(Slices *slices,
                           << "you might consider changing the input in order "
                           "to have\n"
                           << "a finer resolution\n";
-                fNFFTSampling = mymath::next_regular(fSlices->n_slices);
+                fNFFTSampling = fft::good_size(fSlices->n_slices);
             }
         }
 
@@ -204,32 +248,16 @@ InducedVoltageFreq::InducedVoltageFreq(Slices *slices,
         fFreqArray = fft::rfftfreq(fNFFTSampling, timeResolution);
         sum_impedances(fFreqArray);
 
-        fSaveIndividualVoltages = saveIndividualVoltages;
         if (fSaveIndividualVoltages) {
-            // Do I really need to store the length??
-            uint length = fImpedanceSourceList.size();
-            fMatrixSaveIndividualImpedances =
-                complex_vector_t(length * fFreqArray.size(), 0);
             fMatrixSaveIndividualVoltages =
-                f_vector_t(length * fSlices->n_slices, 0);
-            for (uint i = 0; i < length; ++i) {
-                const uint row_width =
-                    fImpedanceSourceList[i]->fImpedance.size();
-                for (uint j = 0; j < row_width; ++j) {
-                    fMatrixSaveIndividualImpedances[i * row_width + j] =
-                        fImpedanceSourceList[i]->fImpedance[j];
-                }
-            }
+                f_vector_t(fImpedanceSourceList.size() * fSlices->n_slices, 0);
         }
 
     } else {
         fNTurnsMem = NTurnsMem;
         fLenArrayMem = (fNTurnsMem + 1) * fSlices->n_slices;
         fLenArrayMemExt = (fNTurnsMem + 2) * fSlices->n_slices;
-        fNPointsFFT = mymath::next_regular(fLenArrayMemExt);
-        fFreqArrayMem = fft::rfftfreq(fNPointsFFT, timeResolution);
-        fTotalImpedanceMem =
-            complex_vector_t(fFreqArrayMem.size(), complex_t(0, 0));
+        impedance_memory(fft::good_size(fLenArrayMemExt));
 
         fTimeArrayMem.reserve((fNTurnsMem + 1) * fSlices->n_slices);
         const double factor = fSlices->edges.back() - fSlices->edges.front();
@@ -239,15 +267,25 @@ InducedVoltageFreq::InducedVoltageFreq(Slices *slices,
                 fTimeArrayMem.push_back(fSlices->bin_centers[j] + factor * i);
             }
         }
-
-        for (const auto &impObj : fImpedanceSourceList) {
-            impObj->imped_calc(fFreqArrayMem);
-            fTotalImpedanceMem += impObj->fImpedance;
-        }
     }
 }
 
-InducedVoltageFreq::~InducedVoltageFreq() { fft::destroy_plans(); }
+InducedVoltageFreq::~InducedVoltageFreq() {}
+
+void InducedVoltageFreq::impedance_memory(uint nPointsFFT)
+{
+    auto timeResolution = (fSlices->bin_centers[1] - fSlices->bin_centers[0]);
+
+    fNPointsFFT = nPointsFFT;
+    fFreqArrayMem = fft::rfftfreq(fNPointsFFT, timeResolution);
+    fTotalImpedanceMem =
+        complex_vector_t(fFreqArrayMem.size(), complex_t(0, 0));
+
+    for (const auto &impObj : fImpedanceSourceList) {
+        impObj->imped_calc(fFreqArrayMem);
+        fTotalImpedanceMem += impObj->fImpedance;
+    }
+}
 
 void InducedVoltageFreq::track(Beams *beam)
 {
@@ -266,9 +304,20 @@ void InducedVoltageFreq::sum_impedances(f_vector_t &freq_array)
 
     fTotalImpedance.resize(freq_array.size());
     std::fill(fTotalImpedance.begin(), fTotalImpedance.end(), complex_t(0, 0));
-    for (const auto &i : fImpedanceSourceList) {
-        i->imped_calc(freq_array);
-        fTotalImpedance += i->fImpedance;
+
+    // Source-major matrix, row i holds the impedance of source i
+    const uint nFreq = freq_array.size();
+    if (fSaveIndividualVoltages)
+        fMatrixSaveIndividualImpedances.resize(
+            fImpedanceSourceList.size() * nFreq);
+
+    for (uint i = 0; i < fImpedanceSourceList.size(); ++i) {
+        auto source = fImpedanceSourceList[i];
+        source->imped_calc(freq_array);
+        fTotalImpedance += source->fImpedance;
+        if (fSaveIndividualVoltages)
+            std::copy(source->fImpedance.begin(), source->fImpedance.end(),
+                      fMatrixSaveIndividualImpedances.begin() + i * nFreq);
     }
 }
 
@@ -297,7 +346,7 @@ void InducedVoltageFreq::reprocess(Slices *newSlices)
                 exit(-1);
                 break;
         }
-        fNFFTSampling = mymath::next_regular(a);
+        fNFFTSampling = fft::good_size(a);
 
         if ((int) fNFFTSampling < fSlices->n_slices) {
             std::cerr
@@ -308,7 +357,7 @@ void InducedVoltageFreq::reprocess(Slices *newSlices)
                     << "FFT is corrected in order to sample the whole bunch (and\n"
                     << "you might consider changing the input in order to have\n"
                     << "a finer resolution\n";
-            fNFFTSampling = mymath::next_regular(fSlices->n_slices);
+            fNFFTSampling = fft::good_size(fSlices->n_slices);
         }
     }
 
@@ -330,71 +379,56 @@ f_vector_t InducedVoltageFreq::induced_voltage_generation(Beams *beam,
     if (fRecalculationImpedance)
         sum_impedances(fFreqArray);
 
-    fSlices->beam_spectrum_generation(fNFFTSampling);
+    // In single precision only the frequencies are needed from the
+    // slices, the spectrum is computed here in float
+    const bool single = (fPrecision == fft::single_precision);
+    fSlices->beam_spectrum_generation(fNFFTSampling, single);
     const auto n = fImpedanceSourceList.size();
-    const auto factor = -beam->charge * constant::e * beam->ratio *
-                        fSlices->fBeamSpectrumFreq[1] * 2 *
-                        (fSlices->fBeamSpectrum.size() - 1);
-
-    if (fSaveIndividualVoltages) {
-
-        for (uint i = 0; i < n; ++i) {
-            f_vector_t res;
-            complex_vector_t in(fSlices->fBeamSpectrum.size());
-
-            for (uint j = 0; j < in.size(); ++j) {
-                in[j] = fMatrixSaveIndividualImpedances[j * n + i] *
-                        fSlices->fBeamSpectrum[j];
-            }
-
-            fft::irfft(in, res, 0, Context::n_threads);
-
-            assert((int)res.size() >= fSlices->n_slices);
-
-            res.resize(fSlices->n_slices);
-            res *= factor;
 
-            for (int j = 0; j < fSlices->n_slices; ++j) {
-                fMatrixSaveIndividualVoltages[j * n + i] = res[j];
-            }
-        }
-
-        fInducedVoltage.clear();
-        fInducedVoltage.resize(fSlices->fBeamSpectrum.size());
-        for (uint i = 0; i < fSlices->fBeamSpectrum.size(); ++i) {
-            double sum = 0.0;
-            for (uint j = 0; j < n; ++j) {
-                sum += fMatrixSaveIndividualVoltages[i * n + j];
-            }
-            fInducedVoltage[i] = sum;
-        }
-
-        return f_vector_t();
+    const uint nFreq = fNFFTSampling / 2 + 1;
+    const uint nFFT = 2 * (nFreq - 1);
+    const int nSlices = fSlices->n_slices;
+    assert((int)nFFT >= nSlices);
 
+    const auto factor = -beam->charge * constant::e * beam->ratio *
+                        fSlices->fBeamSpectrumFreq[1] * nFFT;
+
+    // With individual voltages all the sources are done in one batch,
+    // the rows of the impedance and voltage matrices are the sources
+    const uint nRows = fSaveIndividualVoltages ? n : 1;
+    const complex_t *imped = fSaveIndividualVoltages
+                             ? fMatrixSaveIndividualImpedances.data()
+                             : fTotalImpedance.data();
+    double *saved = fSaveIndividualVoltages
+                    ? fMatrixSaveIndividualVoltages.data()
+                    : nullptr;
+
+    fInducedVoltage.assign(nSlices, 0.0);
+
+    if (single) {
+        auto &w = fWorkSingle;
+        w.profile.assign(fSlices->n_macroparticles.begin(),
+                         fSlices->n_macroparticles.end());
+        fft::rfft(w.profile, w.spectrum, fNFFTSampling, Context::n_threads);
+        impedance_voltage(imped, w.spectrum.data(), nRows, nFreq, nFFT,
+                          factor, fInducedVoltage, saved, w.in, w.voltages);
     } else {
-        f_vector_t res;
-        complex_vector_t in(fSlices->fBeamSpectrum.size());
-        for (uint j = 0; j < in.size(); ++j) {
-            in[j] = fTotalImpedance[j] * fSlices->fBeamSpectrum[j];
-        }
-
-        fft::irfft(in, res, 0, Context::n_threads);
-        assert((int)res.size() >= fSlices->n_slices);
-
-        res.resize(fSlices->n_slices);
-        res *= factor;
-
-        fInducedVoltage = res;
+        auto &w = fWorkDouble;
+        impedance_voltage(imped, fSlices->fBeamSpectrum.data(), nRows, nFreq,
+                          nFFT, factor, fInducedVoltage, saved, w.in,
+                          w.voltages);
+    }
 
-        if (length > 0) {
-            if (length > res.size())
-                res.resize(length, 0);
-            else
-                res.resize(length);
-        }
+    f_vector_t res = fInducedVoltage;
 
-        return res;
+    if (length > 0) {
+        if (length > res.size())
+            res.resize(length, 0);
+        else
+            res.resize(length);
     }
+
+    return res;
 }
 
 TotalInducedVoltage::TotalInducedVoltage(Beams *beam, Slices *slices,
@@ -406,14 +440,77 @@ TotalInducedVoltage::TotalInducedVoltage(Beams *beam, Slices *slices,
     fSlices = slices;
     fInducedVoltageList = InducedVoltageList;
     fNTurnsMemory = NTurnsMemory;
+    fRevTimeArray = RevTimeArray;
     fInducedVoltage = f_vector_t();
     fTimeArray = fSlices->bin_centers;
+
+    if (fNTurnsMemory > 0) {
+        if (fRevTimeArray.empty()) {
+            std::cerr << "[TotalInducedVoltage] Error: the revolution time "
+                      << "array is needed for the multi-turn memory\n";
+            exit(-1);
+        }
+
+        for (auto &v : fInducedVoltageList) {
+            auto freq = dynamic_cast<InducedVoltageFreq *>(v);
+            if (freq != nullptr && freq->fNTurnsMem > 0)
+                fMemoryList.push_back(freq);
+            else
+                fNoMemoryList.push_back(v);
+        }
+
+        if (fMemoryList.empty()) {
+            std::cerr << "[TotalInducedVoltage] Error: the multi-turn memory "
+                      << "needs an InducedVoltageFreq with NTurnsMem > 0\n";
+            exit(-1);
+        }
+
+        fTimeResolution = fSlices->bin_centers[1] - fSlices->bin_centers[0];
+
+        // The window has to hold the whole memory plus the samples that
+        // are rotated out of it during the longest revolution period,
+        // otherwise they would wrap around on top of the memory
+        const double maxRevTime =
+            *std::max_element(fRevTimeArray.begin(), fRevTimeArray.end());
+        const uint maxShift = std::ceil(maxRevTime / fTimeResolution);
+
+        uint lenArrayMemExt = 0;
+        for (const auto &m : fMemoryList) {
+            fLenArrayMem = std::max(fLenArrayMem, m->fLenArrayMem);
+            lenArrayMemExt = std::max(lenArrayMemExt, m->fLenArrayMemExt);
+            fNPointsFFT = std::max(fNPointsFFT, m->fNPointsFFT);
+        }
+        lenArrayMemExt = std::max(lenArrayMemExt, fLenArrayMem + maxShift);
+        if (fNPointsFFT < lenArrayMemExt)
+            fNPointsFFT = fft::good_size(lenArrayMemExt);
+
+        fTotalImpedanceMem =
+            complex_vector_t(fNPointsFFT / 2 + 1, complex_t(0, 0));
+        for (auto &m : fMemoryList) {
+            if (m->fNPointsFFT != fNPointsFFT)
+                m->impedance_memory(fNPointsFFT);
+            fTotalImpedanceMem += m->fTotalImpedanceMem;
+        }
+
+        fInducedVoltageMem = f_vector_t(fNPointsFFT, 0);
+    }
 }
 
-TotalInducedVoltage::~TotalInducedVoltage() { fft::destroy_plans(); }
+TotalInducedVoltage::~TotalInducedVoltage() {}
 
 void TotalInducedVoltage::track(Beams *beam)
 {
+    // The memory holds the wakes of fBeam, it can not kick an other beam
+    if (fNTurnsMemory > 0) {
+        if (beam != fBeam) {
+            std::cerr << "[TotalInducedVoltage] Error: with the multi-turn "
+                      << "memory only the beam of the constructor can be "
+                      << "tracked\n";
+            exit(-1);
+        }
+        track_memory();
+        return;
+    }
 
     this->induced_voltage_sum(beam);
     auto v = this->fInducedVoltage * beam->charge;
@@ -423,9 +520,106 @@ void TotalInducedVoltage::track(Beams *beam)
                        beam->n_macroparticles);
 }
 
-void TotalInducedVoltage::track_memory() {}
+void TotalInducedVoltage::shift_memory(complex_vector_t &spectrum,
+        double revTime)
+{
+    // Shifts the memory window by one revolution period, v(t) -> v(t + T),
+    // with a phase rotation in frequency space. The window is circular, so
+    // the samples that leave it from the front, together with the ones
+    // older than the memory length, are cleared before the rotation.
+    const double shift = revTime / fTimeResolution;
+    const double lastSample = fLenArrayMem + shift;
+    const int n = fNPointsFFT;
 
-void TotalInducedVoltage::track_ghosts_particles(Beams *ghostBeam) {}
+    #pragma omp parallel for
+    for (int i = 0; i < n; ++i) {
+        if (i < shift || i >= lastSample)
+            fInducedVoltageMem[i] = 0.0;
+    }
+
+    fft::rfft(fInducedVoltageMem, spectrum, fNPointsFFT, Context::n_threads);
+
+    // exp(2 pi j f T) with f = k / (n dt), evaluated by recurrence.
+    // Every block starts from an exact phasor so that the rounding
+    // error does not build up along the spectrum
+    const int size = spectrum.size();
+    const double dphi = 2 * constant::pi * shift / n;
+    const int block = 64;
+
+    #pragma omp parallel for
+    for (int b = 0; b < size; b += block) {
+        const complex_t w = std::polar(1.0, dphi);
+        complex_t phasor = std::polar(1.0, dphi * b);
+        const int end = std::min(b + block, size);
+        for (int k = b; k < end; ++k) {
+            spectrum[k] *= phasor;
+            phasor *= w;
+        }
+    }
+}
+
+void TotalInducedVoltage::track_memory()
+{
+    // Method to calculate the induced voltage taking into account the
+    // wakes of the previous turns, and to kick the beam with it
+    const uint turn = std::min(fCounterTurn, (uint) fRevTimeArray.size() - 1);
+    auto &spectrum = fWorkSpectrum;
+    shift_memory(spectrum, fRevTimeArray[turn]);
+
+    // Contribution of the current turn, the profile padded with zeros
+    const uint nSlices = fSlices->n_slices;
+    fWorkProfile.resize(fNPointsFFT);
+    std::copy_n(fSlices->n_macroparticles.begin(), nSlices,
+                fWorkProfile.begin());
+    std::fill(fWorkProfile.begin() + nSlices, fWorkProfile.end(), 0.0);
+    fWorkProfileSpectrum.resize(fNPointsFFT / 2 + 1);
+    fft::rfft(fWorkProfile.data(), fWorkProfileSpectrum.data(), fNPointsFFT,
+              Context::n_threads);
+
+    // Same normalisation as InducedVoltageFreq, df * n = 1 / dt
+    const double factor = -fBeam->charge * constant::e * fBeam->ratio
+                          / fTimeResolution;
+
+    const int size = spectrum.size();
+    #pragma omp parallel for
+    for (int k = 0; k < size; ++k)
+        spectrum[k] += factor * fTotalImpedanceMem[k]
+                       * fWorkProfileSpectrum[k];
+
+    fft::irfft(spectrum.data(), fInducedVoltageMem.data(), fNPointsFFT,
+               Context::n_threads);
+
+    fInducedVoltage.assign(fInducedVoltageMem.begin(),
+                           fInducedVoltageMem.begin() + nSlices);
+
+    // Summed in place, the += of vector_math returns a copy
+    for (auto &v : fNoMemoryList) {
+        v->induced_voltage_generation(fBeam);
+        for (uint i = 0; i < nSlices; ++i)
+            fInducedVoltage[i] += v->fInducedVoltage[i];
+    }
+
+    fWorkKick.resize(nSlices);
+    const double charge = fBeam->charge;
+    for (uint i = 0; i < nSlices; ++i)
+        fWorkKick[i] = fInducedVoltage[i] * charge;
+
+    linear_interp_kick(fBeam->dt.data(), fBeam->dE.data(), fWorkKick.data(),
+                       fSlices->bin_centers.data(), nSlices,
+                       fBeam->n_macroparticles);
+
+    fCounterTurn++;
+}
+
+void TotalInducedVoltage::track_ghosts_particles(Beams *ghostBeam)
+{
+    // Kicks the ghost particles with the voltage of the last tracked turn
+    auto v = fInducedVoltage * ghostBeam->charge;
+
+    linear_interp_kick(ghostBeam->dt.data(), ghostBeam->dE.data(), v.data(),
+                       fSlices->bin_centers.data(), fSlices->n_slices,
+                       ghostBeam->n_macroparticles);
+}
 
 void TotalInducedVoltage::reprocess(Slices *newSlices)
 {
@@ -7,6 +7,8 @@
 
 #include <blond/constants.h>
 #include <blond/input_parameters/GeneralParameters.h>
+#include <algorithm>
+#include <iostream>
 #include <numeric>
 #include <blond/vector_math.h>
 #include <blond/utilities.h>
@@ -18,10 +20,87 @@ GeneralParameters::GeneralParameters(
     const particle_t _particle2, ftype user_mass_2, ftype user_charge_2,
     const int number_of_sections)
 {
+    set_particles(_particle, user_mass, user_charge, _particle2, user_mass_2,
+                  user_charge_2);
+    n_sections = number_of_sections;
+    n_turns = _n_turns;
+    turn_block = 0;
+    for (const auto &p : _momentum)
+        momentum.push_back(TurnArray(p));
+    alpha_order = _alpha_order - 1;
+    alpha = _alpha;
+    ring_length = _ring_length;
 
+    generate();
+}
+
+GeneralParameters::GeneralParameters(
+    const int _n_turns, f_vector_t &_ring_length, f_vector_2d_t &_alpha,
+    const int _alpha_order, const f_vector_t &momentum_turns,
+    f_vector_2d_t &momentum_program, const particle_t _particle,
+    const uint _turn_block, ftype user_mass, ftype user_charge,
+    const particle_t _particle2, ftype user_mass_2, ftype user_charge_2,
+    const int number_of_sections)
+{
+    set_particles(_particle, user_mass, user_charge, _particle2, user_mass_2,
+                  user_charge_2);
+    n_sections = number_of_sections;
+    n_turns = _n_turns;
+    turn_block = std::max(_turn_block, 1u);
+    alpha_order = _alpha_order - 1;
+    alpha = _alpha;
+    ring_length = _ring_length;
+
+    if (momentum_turns.size() < 2 || momentum_turns.front() != 0 ||
+            momentum_turns.back() != n_turns ||
+            !std::is_sorted(ALL(momentum_turns)) ||
+            (int) momentum_program.size() != n_sections) {
+        std::cerr << "ERROR: The momentum program must be given for every "
+                  << "section, at increasing turns from 0 to n_turns!\n";
+        exit(-1);
+    }
+    for (const auto &p : momentum_program) {
+        if (p.size() != momentum_turns.size()) {
+            std::cerr << "ERROR: The momentum program must have one value "
+                      << "per program turn!\n";
+            exit(-1);
+        }
+    }
+    fProgramTurns = momentum_turns;
+    fProgramMomentum = momentum_program;
+
+    for (int i = 0; i < n_sections; ++i)
+        momentum.push_back(TurnArray(n_turns + 1,
+        [this, i](int first, int n, double * out) {
+            momentum_block(i, first, n, out);
+        }, turn_block));
+
+    generate();
+}
+
+GeneralParameters::~GeneralParameters() {}
+
+void GeneralParameters::advance(const int turn)
+{
+    if (turn_block == 0)
+        return;
+
+    for (auto *arrays : {&momentum, &beta, &gamma, &energy, &kin_energy,
+                         &eta_0, &eta_1, &eta_2})
+        for (auto &a : *arrays)
+            a.advance(turn);
+    cycle_time.advance(turn);
+    f_rev.advance(turn);
+    omega_rev.advance(turn);
+    t_rev.advance(turn);
+}
+
+void GeneralParameters::set_particles(
+    const particle_t _particle, ftype user_mass, ftype user_charge,
+    const particle_t _particle2, ftype user_mass_2, ftype user_charge_2)
+{
     particle = _particle;
     particle_2 = _particle2;
-    n_sections = number_of_sections;
 
     if (particle == proton) {
         mass = constant::m_p * constant::c * constant::c / constant::e;
@@ -52,12 +131,24 @@ GeneralParameters::GeneralParameters(
         std::cerr << "ERROR: Second particle type not recognized!\n";
         exit(-1);
     }
+}
 
-    n_turns = _n_turns;
-    momentum = _momentum;
-    alpha_order = _alpha_order - 1;
-    alpha = _alpha;
-    ring_length = _ring_length;
+// A per-turn array, f of the momentum of every turn of a section
+template <typename F>
+TurnArray GeneralParameters::momentum_function(const int section, F f)
+{
+    return TurnArray(n_turns + 1,
+    [this, section, f](int first, int n, double * out) {
+        momentum_block(section, first, n, out);
+        #pragma omp parallel for
+        for (int j = 0; j < n; ++j)
+            out[j] = f(out[j]);
+    }, turn_block);
+}
+
+// Builds the per-turn arrays, stored or lazy depending on turn_block
+void GeneralParameters::generate()
+{
     ring_circumference = std::accumulate(ALL(ring_length), 0.0);
     ring_radius = ring_circumference / (2 * constant::pi);
 
@@ -67,36 +158,63 @@ GeneralParameters::GeneralParameters(
         // Danilo told me we could skip this for now
     }
 
-    gamma.resize(n_sections, f_vector_t(n_turns + 1));
-    beta.resize(n_sections, f_vector_t(n_turns + 1));
-    energy.resize(n_sections, f_vector_t(n_turns + 1));
-    kin_energy.resize(n_sections, f_vector_t(n_turns + 1));
-
     const ftype masssq = mass * mass;
+    const ftype _mass = mass;
+    const int size = n_turns + 1;
 
     for (int i = 0; i < n_sections; ++i) {
-        for (int j = 0; j < n_turns + 1; ++j) {
-            const ftype momentumsq = momentum[i][j] * momentum[i][j];
-            beta[i][j] = std::sqrt(1 / (1 + (masssq / momentumsq)));
-            gamma[i][j] = std::sqrt(1 + (momentumsq / masssq));
-            energy[i][j] = std::sqrt(masssq + momentumsq);
-            kin_energy[i][j] = energy[i][j] - mass;
-        }
+        beta.push_back(momentum_function(i, [masssq](double p) {
+            const ftype momentumsq = p * p;
+            return std::sqrt(1 / (1 + (masssq / momentumsq)));
+        }));
+        gamma.push_back(momentum_function(i, [masssq](double p) {
+            const ftype momentumsq = p * p;
+            return std::sqrt(1 + (momentumsq / masssq));
+        }));
+        energy.push_back(momentum_function(i, [masssq](double p) {
+            return std::sqrt(masssq + p * p);
+        }));
+        kin_energy.push_back(momentum_function(i, [masssq, _mass](double p) {
+            return std::sqrt(masssq + p * p) - _mass;
+        }));
     }
 
-    t_rev.resize(n_turns + 1, 0);
+    t_rev = TurnArray(size, [this](int first, int n, double * out) {
+        t_rev_block(first, n, out);
+    }, turn_block);
 
-    for (int i = 0; i < n_sections; ++i)
-        t_rev += ring_length[i] / constant::c / beta[i];
-
-    cycle_time.resize(n_turns);
-    cycle_time[0] = 0;
-    for (int i = 1; i < n_turns; ++i)
-        cycle_time[i] = t_rev[i] + cycle_time[i - 1];
+    if (turn_block > 0) {
+        // The sum of the revolution periods up to every block
+        fCycleTimeBlocks.assign(1, 0.0);
+        f_vector_t t(turn_block);
+        double time = 0;
+        for (int first = 1; first < n_turns; first += turn_block) {
+            const int n = std::min((int) turn_block, n_turns - first);
+            t_rev_block(first, n, t.data());
+            for (int j = 0; j < n; ++j) {
+                time = t[j] + time;
+                if ((first + j) % turn_block == 0)
+                    fCycleTimeBlocks.push_back(time);
+            }
+        }
+    }
+    cycle_time = TurnArray(n_turns, [this](int first, int n, double * out) {
+        cycle_time_block(first, n, out);
+    }, turn_block);
 
-    f_rev = 1.0 / t_rev;
+    f_rev = TurnArray(size, [this](int first, int n, double * out) {
+        t_rev_block(first, n, out);
+        #pragma omp parallel for
+        for (int j = 0; j < n; ++j)
+            out[j] = 1.0 / out[j];
+    }, turn_block);
 
-    omega_rev = 2. * constant::pi * f_rev;
+    omega_rev = TurnArray(size, [this](int first, int n, double * out) {
+        t_rev_block(first, n, out);
+        #pragma omp parallel for
+        for (int j = 0; j < n; ++j)
+            out[j] = (1.0 / out[j]) * (2. * constant::pi);
+    }, turn_block);
 
     if (alpha_order > 3) {
         dprintf(
@@ -104,53 +222,151 @@ GeneralParameters::GeneralParameters(
             "order");
         alpha_order = 3;
     }
-    eta_0.resize(n_sections, f_vector_t(n_turns + 1));
-    eta_1.resize(n_sections, f_vector_t(n_turns + 1));
-    eta_2.resize(n_sections, f_vector_t(n_turns + 1));
     eta_generation();
 }
 
-GeneralParameters::~GeneralParameters() {}
+// Momentum of the turns [first, first + n) of a section
+void GeneralParameters::momentum_block(int section, int first, int n,
+                                       double *out) const
+{
+    if (fProgramTurns.empty()) {
+        // The momentum of every turn is stored
+        momentum[section].get(first, n, out);
+        return;
+    }
+
+    const auto &turns = fProgramTurns;
+    const auto &p = fProgramMomentum[section];
+    const int last = turns.size() - 1;
+    #pragma omp parallel for
+    for (int j = 0; j < n; ++j) {
+        const double turn = first + j;
+        int k = std::upper_bound(ALL(turns), turn) - turns.begin();
+        k = std::max(1, std::min(k, last));
+        out[j] = p[k - 1] + (p[k] - p[k - 1]) * (turn - turns[k - 1]) /
+                 (turns[k] - turns[k - 1]);
+    }
+}
+
+void GeneralParameters::t_rev_block(int first, int n, double *out) const
+{
+    const ftype masssq = mass * mass;
+    f_vector_t p(n);
+    std::fill_n(out, n, 0.0);
+    for (int i = 0; i < n_sections; ++i) {
+        momentum_block(i, first, n, p.data());
+        const double factor = ring_length[i] / constant::c;
+        const double *__restrict momentum = p.data();
+        #pragma omp parallel for
+        for (int j = 0; j < n; ++j) {
+            const ftype momentumsq = momentum[j] * momentum[j];
+            out[j] += factor / std::sqrt(1 / (1 + (masssq / momentumsq)));
+        }
+    }
+}
+
+void GeneralParameters::cycle_time_block(int first, int n,
+        double *out) const
+{
+    // Sum of the revolution periods from the start of the block of first
+    // turn, or from turn 0 when all of them are stored
+    const int block = turn_block > 0 ? first / turn_block : 0;
+    const int start = block * turn_block;
+    double time = turn_block > 0 ? fCycleTimeBlocks[block] : 0;
+    if (start >= first)
+        out[0] = time;
+    if (first + n - start - 1 <= 0)
+        return;
+
+    f_vector_t t(first + n - start - 1);
+    t_rev_block(start + 1, t.size(), t.data());
+    for (uint j = 0; j < t.size(); ++j) {
+        time = t[j] + time;
+        const int turn = start + 1 + j;
+        if (turn >= first)
+            out[turn - first] = time;
+    }
+}
 
 void GeneralParameters::eta_generation()
 {
-    _eta0();
-    if (alpha_order > 0)
-        _eta1();
-    if (alpha_order > 1)
-        _eta2();
+    const int size = n_turns + 1;
+    auto zeros = [](int first, int n, double * out) {
+        std::fill_n(out, n, 0.0);
+    };
+    for (int i = 0; i < n_sections; ++i) {
+        eta_0.push_back(TurnArray(size,
+        [this, i](int first, int n, double * out) {
+            _eta0(i, first, n, out);
+        }, turn_block));
+
+        TurnArray::generator_t eta1 = zeros, eta2 = zeros;
+        if (alpha_order > 0)
+            eta1 = [this, i](int first, int n, double * out) {
+            _eta1(i, first, n, out);
+        };
+        if (alpha_order > 1)
+            eta2 = [this, i](int first, int n, double * out) {
+            _eta2(i, first, n, out);
+        };
+        eta_1.push_back(TurnArray(size, eta1, turn_block));
+        eta_2.push_back(TurnArray(size, eta2, turn_block));
+    }
     if (alpha_order > 2)
         dprintf(
             "WARNING: Momentum compaction factor is implemented only up to 2nd "
             "order");
 }
 
-void GeneralParameters::_eta0()
+void GeneralParameters::_eta0(int i, int first, int n, double *out) const
 {
-    for (int i = 0; i < n_sections; ++i)
-        for (int j = 0; j < n_turns + 1; ++j)
-            eta_0[i][j] = alpha[i][0] - 1 / (gamma[i][j] * gamma[i][j]);
+    const ftype masssq = mass * mass;
+    const ftype alpha0 = alpha[i][0];
+    momentum_block(i, first, n, out);
+    #pragma omp parallel for
+    for (int j = 0; j < n; ++j) {
+        const ftype momentumsq = out[j] * out[j];
+        const ftype gamma = std::sqrt(1 + (momentumsq / masssq));
+        out[j] = alpha0 - 1 / (gamma * gamma);
+    }
 }
 
-void GeneralParameters::_eta1()
+void GeneralParameters::_eta1(int i, int first, int n, double *out) const
 {
-    for (int i = 0; i < n_sections; ++i)
-        for (int j = 0; j < n_turns + 1; ++j)
-            eta_1[i][j] =
-                3 * beta[i][j] * beta[i][j] / (2 * gamma[i][j] * gamma[i][j]) +
-                alpha[i][1] - alpha[i][0] * eta_0[i][j];
+    const ftype masssq = mass * mass;
+    const ftype alpha0 = alpha[i][0];
+    const ftype alpha1 = alpha[i][1];
+    momentum_block(i, first, n, out);
+    #pragma omp parallel for
+    for (int j = 0; j < n; ++j) {
+        const ftype momentumsq = out[j] * out[j];
+        const ftype beta = std::sqrt(1 / (1 + (masssq / momentumsq)));
+        const ftype gamma = std::sqrt(1 + (momentumsq / masssq));
+        const ftype eta_0 = alpha0 - 1 / (gamma * gamma);
+        out[j] = 3 * beta * beta / (2 * gamma * gamma) +
+                 alpha1 - alpha0 * eta_0;
+    }
 }
 
-void GeneralParameters::_eta2()
+void GeneralParameters::_eta2(int i, int first, int n, double *out) const
 {
-    for (int i = 0; i < n_sections; ++i)
-        for (int j = 0; j < n_turns + 1; ++j) {
-            const ftype betasq = beta[i][j] * beta[i][j];
-            ftype gammasq = gamma[i][j] * gamma[i][j];
-            eta_1[i][j] = -betasq * (5 * betasq - 1) / (2 * gammasq) +
-                          alpha[i][2] - 2 * alpha[i][0] * alpha[i][1] +
-                          alpha[i][1] / gammasq +
-                          alpha[i][0] * alpha[i][0] * eta_0[i][j] -
-                          3 * betasq * alpha[i][0] / (2 * gammasq);
-        }
+    const ftype masssq = mass * mass;
+    const ftype alpha0 = alpha[i][0];
+    const ftype alpha1 = alpha[i][1];
+    const ftype alpha2 = alpha[i][2];
+    momentum_block(i, first, n, out);
+    #pragma omp parallel for
+    for (int j = 0; j < n; ++j) {
+        const ftype momentumsq = out[j] * out[j];
+        const ftype beta = std::sqrt(1 / (1 + (masssq / momentumsq)));
+        const ftype gamma = std::sqrt(1 + (momentumsq / masssq));
+        const ftype eta_0 = alpha0 - 1 / (gamma * gamma);
+        const ftype betasq = beta * beta;
+        ftype gammasq = gamma * gamma;
+        out[j] = -betasq * (5 * betasq - 1) / (2 * gammasq) +
+                 alpha2 - 2 * alpha0 * alpha1 +
+                 alpha1 / gammasq +
+                 alpha0 * alpha0 * eta_0 -
+                 3 * betasq * alpha0 / (2 * gammasq);
+    }
 }
@@ -65,38 +65,7 @@ f_vector_t RfParameters::calc_phi_s(RfParameters *rfp,
     f_vector_t out(n_turns + 1);
     // double eta0 = rf_params->eta0;
     if (acc_sys == RfParameters::acc_sys_t::as_single) {
-
-        f_vector_t denergy = rfp->E_increment;
-        denergy.push_back(rfp->E_increment.back());
-
-        f_vector_t acceleration_ratio(n_turns + 1);
-        for (int i = 0; i < n_turns + 1; ++i)
-            acceleration_ratio[i] =
-                denergy[i] / (rfp->charge * rfp->voltage[rfp->section_index][i]);
-
-        for (int i = 0; i < n_turns + 1; ++i)
-            if (acceleration_ratio[i] > 1 || acceleration_ratio[i] < -1)
-                dprintf("Warning!!! Acceleration is not possible (momentum "
-                        "increment "
-                        "is too big or voltage too low) at index %d\n",
-                        i);
-
-        for (int i = 0; i < n_turns + 1; ++i)
-            out[i] = asin(acceleration_ratio[i]);
-
-        // double *eta0_middle_points = new double[n_turns +1];
-        for (int i = 0; i < n_turns; ++i) {
-            double middle = (rfp->eta_0[i] + rfp->eta_0[i + 1]) / 2;
-            if (middle > 0)
-                out[i] = constant::pi - out[i];
-            else
-                out[i] = constant::pi + out[i];
-        }
-        if (rfp->eta_0[n_turns] > 0)
-            out[n_turns] = constant::pi - out[n_turns];
-        else
-            out[n_turns] = constant::pi + out[n_turns];
-
+        rfp->calc_phi_s(0, n_turns + 1, out.data());
         return out;
 
     } else if (acc_sys == RfParameters::acc_sys_t::all) {
@@ -108,10 +77,13 @@ f_vector_t RfParameters::calc_phi_s(RfParameters *rfp,
          */
 
         f_vector_t transition_phase_offset(n_turns + 1);
+        const f_vector_t eta_0 = rfp->eta_0.vector();
+        const f_vector_t E_increment = rfp->E_increment.vector();
 
+        #pragma omp parallel for
         for (int i = 0; i < n_turns + 1; ++i) {
             out[i] = 0;
-            if (rfp->eta_0[i] > 0)
+            if (eta_0[i] > 0)
                 transition_phase_offset[i] = constant::pi;
             else
                 transition_phase_offset[i] = 0;
@@ -120,6 +92,8 @@ f_vector_t RfParameters::calc_phi_s(RfParameters *rfp,
         mymath::linspace(phase_array.data(), -constant::pi * 1.2,
                          constant::pi * 1.2, 1000);
 
+        // The turns are independent
+        #pragma omp parallel for schedule(dynamic, 64)
         for (int i = 0; i < n_turns; ++i) {
             f_vector_t totalrf(1000, 0); // = { };
             for (int j = 0; j < n_rf; ++j) {
@@ -140,7 +114,7 @@ f_vector_t RfParameters::calc_phi_s(RfParameters *rfp,
             double potential_well[1000] = {0};
             f_vector_t f(1000);
             for (int k = 0; k < 1000; ++k) {
-                f[k] = totalrf[k] - rfp->E_increment[i] / rfp->charge;
+                f[k] = totalrf[k] - E_increment[i] / rfp->charge;
             }
 
             auto trap = mymath::cum_trapezoid(f.data(),
@@ -178,3 +152,65 @@ f_vector_t RfParameters::calc_phi_s(RfParameters *rfp,
         out.resize(n_turns, 0.);
     return out;
 }
+
+
+void RfParameters::calc_phi_s(const int first, const int n, double *out) const
+{
+    // The energy increment of the last turn is the one of the turn before,
+    // the slippage factor is averaged with the next turn but in the last
+    // turn
+    f_vector_t denergy(n);
+    const int m = std::min(n, n_turns - first);
+    E_increment.get(first, m, denergy.data());
+    if (m < n)
+        E_increment.get(n_turns - 1, 1, &denergy[m]);
+
+    const int n_eta = std::min(n + 1, n_turns + 1 - first);
+    f_vector_t eta(n_eta);
+    eta_0.get(first, n_eta, eta.data());
+
+    // The acceleration ratio first, to warn in the order of the turns
+    const double *v = &voltage[section_index][first];
+    const double q = charge;
+    #pragma omp parallel for
+    for (int j = 0; j < n; ++j)
+        out[j] = denergy[j] / (q * v[j]);
+
+    for (int j = 0; j < n; ++j)
+        if (out[j] > 1 || out[j] < -1)
+            dprintf("Warning!!! Acceleration is not possible (momentum "
+                    "increment "
+                    "is too big or voltage too low) at index %d\n",
+                    first + j);
+
+    const int turns = n_turns;
+    #pragma omp parallel for
+    for (int j = 0; j < n; ++j) {
+        const double middle =
+            first + j < turns ? (eta[j] + eta[j + 1]) / 2 : eta[j];
+        out[j] = phi_s_turn(out[j], middle);
+    }
+}
+
+
+NOINLINE double RfParameters::phi_s_turn(const double acceleration_ratio,
+        const double eta)
+{
+    const double phi = asin(acceleration_ratio);
+    if (eta > 0)
+        return constant::pi - phi;
+    else
+        return constant::pi + phi;
+}
+
+
+NOINLINE double RfParameters::Qs_turn(const double harmonic,
+                                      const double charge,
+                                      const double voltage, const double eta,
+                                      const double phi_s, const double beta,
+                                      const double energy)
+{
+    return std::sqrt(harmonic * charge * voltage
+                     * std::abs(eta * std::cos(phi_s)) /
+                     (2 * constant::pi * beta * beta * energy));
+}
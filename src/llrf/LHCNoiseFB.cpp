@@ -79,10 +79,14 @@ void LHCNoiseFB::track() {
 
 // TODO check the conditions in this function
 double LHCNoiseFB::fwhm_interpolation(uint_vector_t index, double half_height) {
+    return fwhm_interpolation(index[0], index.back(), half_height);
+}
+
+double LHCNoiseFB::fwhm_interpolation(int first, int last,
+                                      double half_height) {
     auto Slice = Context::Slice;
     const auto time_resolution = Slice->bin_centers[1] - Slice->bin_centers[0];
 
-    const int first = index[0];
     const int prev = first > 0 ? first - 1 : Slice->n_slices - 1;
     const auto left =
         Slice->bin_centers[first] -
@@ -90,7 +94,6 @@ double LHCNoiseFB::fwhm_interpolation(uint_vector_t index, double half_height) {
             (Slice->n_macroparticles[first] - Slice->n_macroparticles[prev]) *
             time_resolution;
 
-    const int last = index.back();
     auto right = 0.0;
     if (last < Slice->n_slices - 1) {
         right = Slice->bin_centers[last] +
@@ -169,36 +172,51 @@ void LHCNoiseFB::fwhm_multi_bunch() {
     for (uint i = 0; i < bucket_min.size(); ++i)
         bucket_max[i] = bucket_min[i] + 2 * constant::pi / omega_rf;
 
-    // Bunch-by-bunch FWHM bunch length
-    for (uint i = 0; i < fBunchPattern.size(); ++i) {
-        uint_vector_t bind;
-        for (int j = 0; j < Slice->n_slices; ++j) {
-            if ((Slice->bin_centers[j] - bucket_min[i]) *
-                    (Slice->bin_centers[j] - bucket_max[i]) < 0)
-                bind.push_back(j);
-        }
+    // The slices are uniform, so the bins with their center inside a
+    // bucket are found directly from the bucket limits
+    const int n_slices = Slice->n_slices;
+    const auto &bin_centers = Slice->bin_centers;
+    const auto &profile = Slice->n_macroparticles;
+    const double center0 = bin_centers[0];
+    const double bin_width = bin_centers[1] - bin_centers[0];
 
+    // Bunch-by-bunch FWHM bunch length
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int) fBunchPattern.size(); ++i) {
+        const double lo = std::min(bucket_min[i], bucket_max[i]);
+        const double hi = std::max(bucket_min[i], bucket_max[i]);
+
+        // First and last bin strictly inside (lo, hi). The estimates are
+        // corrected against the bin centers to be exact.
+        int first = std::ceil((lo - center0) / bin_width);
+        first = std::max(0, std::min(first, n_slices));
+        while (first > 0 && bin_centers[first - 1] > lo) --first;
+        while (first < n_slices && bin_centers[first] <= lo) ++first;
+
+        int last = std::floor((hi - center0) / bin_width);
+        last = std::max(-1, std::min(last, n_slices - 1));
+        while (last < n_slices - 1 && bin_centers[last + 1] < hi) ++last;
+        while (last >= 0 && bin_centers[last] >= hi) --last;
+
+        // Two passes over the bucket's bins: the maximum, then the
+        // first and last bins above half of it
         double hheight = 0;
-        for (const auto& j : bind) {
-            if (Slice->n_macroparticles[j] > hheight)
-                hheight = Slice->n_macroparticles[j];
-        }
-
+        for (int j = first; j <= last; ++j)
+            hheight = std::max(hheight, profile[j]);
         hheight = hheight / 2;
 
-        uint_vector_t index;
-        auto k = 0;
-        for (const auto &j : bind) {
-            if (Slice->n_macroparticles[j] > hheight)
-                index.push_back(bind[k]);
-            k++;
+        int above_first = last + 1, above_last = -1;
+        for (int j = first; j <= last; ++j) {
+            if (profile[j] > hheight) {
+                above_first = std::min(above_first, j);
+                above_last = j;
+            }
         }
-        // std::cout << "index size = " << index.size() << "\n";
-        if (index.empty()) {
+        if (above_last < 0) {
             // std::cerr << "[LHCNoiseFB] ERROR! index vector should have at least one element\n";
             continue;
         }
-        fBlMeasBBB[i] = fwhm_interpolation(index, hheight);
+        fBlMeasBBB[i] = fwhm_interpolation(above_first, above_last, hheight);
     }
 
     fBlMeas = mymath::mean(fBlMeasBBB.data(), fBlMeasBBB.size());
@@ -5,6 +5,7 @@
  *      Author: kiliakis
  */
 
+#include <blond/checkpoint.h>
 #include <blond/constants.h>
 #include <blond/llrf/PhaseLoop.h>
 #include <blond/math_functions.h>
@@ -29,38 +30,53 @@ void PhaseLoop::beam_phase()
 
     double omega_rf = RfP->omega_rf[RfP->section_index][RfP->counter];
     double phi_rf = RfP->phi_rf[RfP->section_index][RfP->counter];
-    // Convolve with window function
-    //
-    double *base = new double[Slice->n_slices];
-    double *array = new double[Slice->n_slices];
-
-    #pragma omp parallel for
-    for (int i = 0; i < (int)Slice->n_slices; ++i) {
-        const double a = alpha * Slice->bin_centers[i];
-        base[i] = std::exp(a) * Slice->n_macroparticles[i];
-    }
-
-    #pragma omp parallel for
-    for (int i = 0; i < (int)Slice->n_slices; ++i) {
-        const double a = omega_rf * Slice->bin_centers[i] + phi_rf;
-        array[i] = base[i] * std::sin(a);
-    }
-    double scoeff =
-        mymath::trapezoid(array, Slice->bin_centers.data(), Slice->n_slices);
 
-    #pragma omp parallel for
-    for (int i = 0; i < (int)Slice->n_slices; ++i) {
-        const double a = omega_rf * Slice->bin_centers[i] + phi_rf;
-        array[i] = base[i] * std::cos(a);
+    const int n = Slice->n_slices;
+    const double *t = Slice->bin_centers.data();
+    const double *profile = Slice->n_macroparticles.data();
+    const double *window = window_function();
+
+    // Convolve with window function, and integrate the sine and cosine
+    // components with the trapezoid rule, both in one pass.
+    // sum_i (f[i] + f[i-1]) * (t[i] - t[i-1]) / 2 is regrouped per point
+    // as f[i] * (t[i+1] - t[i-1]) / 2, where the ends have a single
+    // interval. The common 1/2 cancels in the ratio of the sums.
+    double scoeff = 0.0;
+    double ccoeff = 0.0;
+    #pragma omp parallel for reduction(+ : scoeff, ccoeff)
+    for (int i = 0; i < n; ++i) {
+        const double dt = t[std::min(i + 1, n - 1)] - t[std::max(i - 1, 0)];
+        const double w = window[i] * profile[i] * dt;
+        double s, c;
+        mymath::fast_sincos(omega_rf * t[i] + phi_rf, s, c);
+        scoeff += w * s;
+        ccoeff += w * c;
     }
 
-    double ccoeff =
-        mymath::trapezoid(array, Slice->bin_centers.data(), Slice->n_slices);
-
     phi_beam = std::atan(scoeff / ccoeff) + constant::pi;
+}
 
-    delete[] base;
-    delete[] array;
+const double *PhaseLoop::window_function()
+{
+    auto Slice = Context::Slice;
+    const int n = Slice->n_slices;
+    const double *t = Slice->bin_centers.data();
+
+    const bool valid = (window_alpha == alpha) &&
+                       ((int) window.size() == n) &&
+                       (n == 0 || (window_first == t[0] &&
+                                   window_last == t[n - 1]));
+
+    if (!valid) {
+        window_alpha = alpha;
+        window_first = n > 0 ? t[0] : 0;
+        window_last = n > 0 ? t[n - 1] : 0;
+        window.resize(n);
+        #pragma omp parallel for
+        for (int i = 0; i < n; ++i)
+            window[i] = std::exp(alpha * t[i]);
+    }
+    return window.data();
 }
 
 void PhaseLoop::phase_difference()
@@ -76,9 +92,9 @@ void PhaseLoop::phase_difference()
     // Possibility to add RF phase noise through the PL
     if (RFnoise != NULL) {
         if (noiseFB != NULL) {
-            dphi += noiseFB->fX * RFnoise->fDphi[counter];
+            dphi += noiseFB->fX * RFnoise->dphi(counter);
         } else {
-            dphi += RFnoise->fDphi[counter];
+            dphi += RFnoise->dphi(counter);
         }
     }
 }
@@ -96,9 +112,10 @@ void PhaseLoop::radial_steering_from_freq()
         reference / GP->ring_radius;
 
     for (int i = 0; i < RfP->n_rf; ++i) {
-        RfP->omega_rf[i][counter] += radial_steering_domega_rf *
-                                     RfP->harmonic[i][counter] /
-                                     RfP->harmonic[0][counter];
+        RfP->omega_rf[i].set(counter, RfP->omega_rf[i][counter] +
+                             radial_steering_domega_rf *
+                             RfP->harmonic[i][counter] /
+                             RfP->harmonic[0][counter]);
     }
 
     // Update the RF phase of all systems for the next turn
@@ -112,7 +129,8 @@ void PhaseLoop::radial_steering_from_freq()
 
     // Total phase offset
     for (int i = 0; i < RfP->n_rf; ++i) {
-        RfP->phi_rf[i][counter] += RfP->dphi_rf_steering[i];
+        RfP->phi_rf[i].set(counter, RfP->phi_rf[i][counter] +
+                           RfP->dphi_rf_steering[i]);
     }
 }
 
@@ -125,17 +143,10 @@ void PhaseLoop::radial_difference()
 
     // Radial difference between beam and design orbit.*
     uint counter = RfP->counter;
-    uint n = 0;
-    double sum = 0;
-    // double array[GP->n_turns];
-    for (int i = 0; i < GP->n_turns; ++i) {
-        if (Beam->dt[i] > Slice->bin_centers.front() &&
-                Beam->dt[i] < Slice->bin_centers.back()) {
-            sum += Beam->dE[i];
-            n++;
-        }
-    }
-    auto average_dE = n > 0 ? sum / n : 0.0;
+    // Mean energy of the alive particles inside the slicing window
+    auto average_dE = Beam->mean_dE_in_window(Slice->bin_centers.front(),
+                      Slice->bin_centers.back(),
+                      beam_statistics);
     // std::cout << "average_dE : " << average_dE << "\n";
     drho =
         GP->alpha[0][0] * GP->ring_radius * average_dE /
@@ -155,8 +166,9 @@ void PhaseLoop::default_track()
     // uint turns = GP->n_turns;
     // Update the RF frequency of all systems for the next turn
     for (int i = 0; i < RfP->n_rf; ++i) {
-        RfP->omega_rf[i][counter] +=
-            domega_rf * RfP->harmonic[i][counter] / RfP->harmonic[0][counter];
+        RfP->omega_rf[i].set(counter, RfP->omega_rf[i][counter] +
+                             domega_rf * RfP->harmonic[i][counter] /
+                             RfP->harmonic[0][counter]);
     }
 
     // Update the RF phase of all systems for the next turn
@@ -170,10 +182,20 @@ void PhaseLoop::default_track()
 
     // Total phase offset
     for (int i = 0; i < RfP->n_rf; ++i) {
-        RfP->phi_rf[i][counter] += RfP->dphi_rf[i];
+        RfP->phi_rf[i].set(counter, RfP->phi_rf[i][counter] +
+                           RfP->dphi_rf[i]);
     }
 }
 
+void PhaseLoop::checkpoint(Checkpoint &c)
+{
+    c.add("PL/domega_rf", domega_rf);
+    c.add("PL/drho", drho);
+    c.add("PL/phi_beam", phi_beam);
+    c.add("PL/dphi", dphi);
+    c.add("PL/reference", reference);
+}
+
 LHC::LHC(f_vector_t PL_gain, double SL_gain, double window_coefficient,
          PhaseNoise *phaseNoise, LHCNoiseFB *LHCNoiseFB, uint _delay)
 {
@@ -208,6 +230,12 @@ LHC::LHC(f_vector_t PL_gain, double SL_gain, double window_coefficient,
 
 LHC::~LHC() {}
 
+void LHC::checkpoint(Checkpoint &c)
+{
+    PhaseLoop::checkpoint(c);
+    c.add("PL/lhc_y", lhc_y);
+}
+
 void LHC::track()
 {
     /*
@@ -319,6 +347,18 @@ PSB::PSB(f_vector_t PL_gain, f_vector_t _RL_gain, double _PL_period,
 
 PSB::~PSB() {}
 
+void PSB::checkpoint(Checkpoint &c)
+{
+    PhaseLoop::checkpoint(c);
+    c.add("PL/PL_counter", PL_counter);
+    c.add("PL/dphi_av", dphi_av);
+    c.add("PL/dphi_av_prev", dphi_av_prev);
+    c.add("PL/drho_prev", drho_prev);
+    c.add("PL/t_accum", t_accum);
+    c.add("PL/domega_PL", domega_PL);
+    c.add("PL/domega_RL", domega_RL);
+}
+
 void PSB::track()
 {
     /*
@@ -19,6 +19,16 @@ void PhaseNoise::spectrum_to_phase_noise(f_vector_t &t, f_vector_t &dphi,
         const f_vector_t &ReS,
         PhaseNoise::transform_t transform)
 {
+    spectrum_to_phase_noise(t, dphi, freq_array, ReS, transform, fSeed1,
+                            fSeed2);
+}
+
+void PhaseNoise::spectrum_to_phase_noise(f_vector_t &t, f_vector_t &dphi,
+        const f_vector_t &freq_array,
+        const f_vector_t &ReS,
+        PhaseNoise::transform_t transform,
+        int seed1, int seed2)
+{
 
     // Resolution in time domain
     const auto ReSLen = ReS.size();
@@ -44,7 +54,7 @@ void PhaseNoise::spectrum_to_phase_noise(f_vector_t &t, f_vector_t &dphi,
     f_vector_t r1(nt);
     f_vector_t r2(nt);
 
-    if (fSeed1 < 0 || fSeed2 < 0) {
+    if (seed1 < 0 || seed2 < 0) {
         f_vector_t random;
         // std::string home = util::GETENV("TEST_FILES");
         util::read_vector_from_file(random, TEST_FILES "/normal_distribution.dat");
@@ -53,10 +63,10 @@ void PhaseNoise::spectrum_to_phase_noise(f_vector_t &t, f_vector_t &dphi,
             r2[i] = random[(2 * i + 1) % random.size()];
         }
     } else {
-        std::default_random_engine gen(fSeed1);
+        std::default_random_engine gen(seed1);
         std::uniform_real_distribution<> dist(0, 1);
         for (auto &v : r1) v = dist(gen);
-        gen.seed(fSeed2);
+        gen.seed(seed2);
         for (auto &v : r2) v = dist(gen);
     }
 
@@ -150,8 +160,9 @@ f_vector_t PhaseNoise::spectrum_generation(int k, int nt, double df, double ampl
         f_vector_t freq,
         predistortion_t predistortion)
 {
-    int nmin = std::floor(fFMin * fFs[k] / df);
-    int nmax = std::ceil(fFMax * fFs[k] / df);
+    const double f_s = fs(k);
+    int nmin = std::floor(fFMin * f_s / df);
+    int nmax = std::ceil(fFMax * f_s / df);
     int nf = nt / 2 + 1;
 
     f_vector_t spectrum;
@@ -199,7 +210,7 @@ f_vector_t PhaseNoise::spectrum_generation(int k, int nt, double df, double ampl
         f_vector_t frel(&freq[nmin], &freq[nmax + 1]);
 
         std::transform(frel.begin(), frel.end(), frel.begin(),
-                       std::bind2nd(std::divides<double>(), fFs[k]));
+                       std::bind2nd(std::divides<double>(), f_s));
 
         // truncate center freqs
         auto f1 = [](double x) { return x > 0.999 ? 0.999 : x; };
@@ -245,10 +256,141 @@ f_vector_t PhaseNoise::spectrum_generation(int k, int nt, double df, double ampl
     // << "\n";
 }
 
+double PhaseNoise::dphi(uint turn)
+{
+    if (!fStreaming)
+        return fDphi[turn];
+
+    const uint n = n_windows();
+    if (n == 0)
+        return 0.0;
+
+    // The last window also has the turns up to fNTurns
+    const uint w = std::min(turn / fCorr, n - 1);
+    auto it = fWindows.find(w);
+    if (it == fWindows.end()) {
+        // Keep the previous window, for the turns that look back
+        for (auto j = fWindows.begin(); j != fWindows.end();) {
+            if (j->first + 1 < w || j->first > w)
+                j = fWindows.erase(j);
+            else
+                ++j;
+        }
+        it = fWindows.insert(std::make_pair(w, take_window(w))).first;
+    }
+
+    // Half of the window is read, time to start on the next one
+    if (w + 1 < n && (int) w + 1 != fPrefetchAsked
+            && turn - w * fCorr >= fCorr / 2)
+        prefetch(w + 1);
+
+    return it->second[turn - w * fCorr];
+}
+
+double PhaseNoise::fs(uint turn) const
+{
+    double f_s;
+    fFs.get(turn, 1, &f_s);
+    return f_s;
+}
+
+void PhaseNoise::prefetch(uint i)
+{
+    fPrefetchAsked = i;
+    if (!fPrefetchThread.joinable())
+        fPrefetchThread = std::thread(&PhaseNoise::prefetch_loop, this);
+
+    std::lock_guard<std::mutex> lock(fPrefetchMutex);
+    if (fPrefetchReady == (int) i)
+        return;
+    fPrefetchWanted = i;
+    fPrefetchCv.notify_all();
+}
+
+void PhaseNoise::prefetch_loop()
+{
+    // The thread has its own fft plans, and generate_window() reads the
+    // ramp with get(), so it does not race with the tracking thread
+    std::unique_lock<std::mutex> lock(fPrefetchMutex);
+    while (true) {
+        fPrefetchCv.wait(lock, [this]() {
+            return fPrefetchStop || fPrefetchWanted >= 0;
+        });
+        if (fPrefetchStop)
+            return;
+
+        const uint i = fPrefetchWanted;
+        lock.unlock();
+        auto noise_dphi = generate_window(i);
+        lock.lock();
+
+        fPrefetched = std::move(noise_dphi);
+        fPrefetchReady = i;
+        // An other window may have been asked for in the meantime
+        if (fPrefetchWanted == (int) i)
+            fPrefetchWanted = -1;
+        fPrefetchCv.notify_all();
+    }
+}
+
+f_vector_t PhaseNoise::take_window(uint i)
+{
+    std::unique_lock<std::mutex> lock(fPrefetchMutex);
+    // The window may be on its way
+    fPrefetchCv.wait(lock, [this, i]() {
+        return fPrefetchWanted != (int) i;
+    });
+    if (fPrefetchReady == (int) i) {
+        fPrefetchReady = -1;
+        return std::move(fPrefetched);
+    }
+    lock.unlock();
+
+    // Not asked for in advance, e.g. after a jump back
+    return generate_window(i);
+}
+
+void PhaseNoise::stop_prefetch()
+{
+    {
+        std::lock_guard<std::mutex> lock(fPrefetchMutex);
+        fPrefetchStop = true;
+        fPrefetchCv.notify_all();
+    }
+    if (fPrefetchThread.joinable())
+        fPrefetchThread.join();
+}
+
+void PhaseNoise::fill_dphi()
+{
+    if (fStreaming)
+        return;
+
+    // The windows are independent, every thread uses its own fft plans.
+    // generate_window() reads f_rev with get(), which does not move the
+    // window of a lazy GeneralParameters.
+    const uint n = n_windows();
+    #pragma omp parallel for schedule(dynamic)
+    for (uint i = 0; i < n; ++i) {
+        auto noise_dphi = generate_window(i);
+
+        // Fill phase noise array
+        const uint k = i * fCorr;
+        const uint kmax = i < n - 1 ? (i + 1) * fCorr : fNTurns + 1;
+        std::copy(noise_dphi.begin(), noise_dphi.begin() + kmax - k,
+                  fDphi.begin() + k);
+    }
+
+    // Same seeds as after generating the windows one after the other
+    fSeed1 += 239 * n;
+    fSeed2 += 158 * n;
+}
+
 PSBPhaseNoiseInjection::PSBPhaseNoiseInjection(
     double delta_f, uint corr_time, double fmin, double fmax,
     double initial_amplitude, int seed1, int seed2,
-    predistortion_t predistortion, rescale_ampl_t rescale_amplitude)
+    predistortion_t predistortion, rescale_ampl_t rescale_amplitude,
+    bool streaming)
 {
     auto RfP = Context::RfP;
     auto GP = Context::GP;
@@ -262,76 +404,87 @@ PSBPhaseNoiseInjection::PSBPhaseNoiseInjection(
     fSeed1 = seed1;
     fSeed2 = seed2;
     fNTurns = GP->n_turns;
-    fDphi.resize(fNTurns + 1, 0);
+    fStreaming = streaming;
+    if (!fStreaming)
+        fDphi.resize(fNTurns + 1, 0);
     fRescaleAmpl = rescale_amplitude;
 
-    fFs.resize(RfP->omega_s0.size());
-    std::transform(RfP->omega_s0.begin(), RfP->omega_s0.end(), fFs.begin(),
-                   std::bind2nd(std::divides<double>(), 2 * constant::pi));
+    // In streaming mode only the turns of the windows are needed
+    auto f_s = [RfP](int first, int n, double *out) {
+        RfP->omega_s0.get(first, n, out);
+        for (int j = 0; j < n; ++j)
+            out[j] /= 2 * constant::pi;
+    };
+    fFs = TurnArray(RfP->omega_s0.size(), f_s, fStreaming ? fCorr : 0);
 }
 
-PSBPhaseNoiseInjection::~PSBPhaseNoiseInjection() { fft::destroy_plans(); }
+PSBPhaseNoiseInjection::~PSBPhaseNoiseInjection() { stop_prefetch(); }
+
+void PSBPhaseNoiseInjection::generate() { fill_dphi(); }
 
-void PSBPhaseNoiseInjection::generate()
+f_vector_t PSBPhaseNoiseInjection::generate_window(uint i)
 {
     auto GP = Context::GP;
 
-    for (uint i = 0; i < fNTurns / fCorr; ++i) {
-
-        // Scale amplitude to keep area (phase noise amplitude) constant
-        uint k = i * fCorr; // Current time step
-        double f_max = GP->f_rev[k] / 2;
-        double f_s0 = fFs[k];
-
-        int n_points_pos_f_incl_zero = (int)(f_max / fDeltaF) + 2;
-        int nt = 2 * (n_points_pos_f_incl_zero - 1);
-        nt = mymath::next_regular(nt);
-        n_points_pos_f_incl_zero = nt / 2 + 1;
-        double df = f_max / (n_points_pos_f_incl_zero - 1);
-
-        double ampl = 0.0;
-        if (fRescaleAmpl == rescale_ampl_t::with_sync_freq)
-            ampl = fAi * fFs[0] / f_s0;
-        else if (fRescaleAmpl == rescale_ampl_t::no_scaling)
-            ampl = fAi;
-        else {
-            std::cerr << "ERROR: Illegal Value\n"
-                      << "fRescaleAmpl should be one of "
-                      << "with_sync_freq or no_scaling\n";
-        }
-
-        f_vector_t freq(n_points_pos_f_incl_zero);
-        mymath::linspace(freq.data(), 0, f_max, n_points_pos_f_incl_zero);
-
-        auto spectrum =
-            spectrum_generation(k, nt, df, ampl, freq, fPredistortion);
+    // Scale amplitude to keep area (phase noise amplitude) constant
+    uint k = i * fCorr; // Current time step
+    double f_rev;
+    GP->f_rev.get(k, 1, &f_rev);
+    double f_max = f_rev / 2;
+    double f_s0 = fs(k);
+
+    int n_points_pos_f_incl_zero = (int)(f_max / fDeltaF) + 2;
+    int nt = 2 * (n_points_pos_f_incl_zero - 1);
+    nt = fft::good_size(nt);
+    n_points_pos_f_incl_zero = nt / 2 + 1;
+    double df = f_max / (n_points_pos_f_incl_zero - 1);
+
+    double ampl = 0.0;
+    if (fRescaleAmpl == rescale_ampl_t::with_sync_freq)
+        ampl = fAi * fs(0) / f_s0;
+    else if (fRescaleAmpl == rescale_ampl_t::no_scaling)
+        ampl = fAi;
+    else {
+        std::cerr << "ERROR: Illegal Value\n"
+                  << "fRescaleAmpl should be one of "
+                  << "with_sync_freq or no_scaling\n";
+    }
 
-        f_vector_t noise_t, noise_dphi;
-        spectrum_to_phase_noise(noise_t, noise_dphi, freq, spectrum);
+    f_vector_t freq(n_points_pos_f_incl_zero);
+    mymath::linspace(freq.data(), 0, f_max, n_points_pos_f_incl_zero);
 
-        fSeed1 += 239;
-        fSeed2 += 158;
+    auto spectrum =
+        spectrum_generation(k, nt, df, ampl, freq, fPredistortion);
 
-        // Fill phase noise array
+    f_vector_t noise_t, noise_dphi;
+    spectrum_to_phase_noise(noise_t, noise_dphi, freq, spectrum,
+                            transform_t::transform_none,
+                            fSeed1 + 239 * i, fSeed2 + 158 * i);
 
-        const uint kmax =
-            i < fNTurns / fCorr - 1 ? (i + 1) * fCorr : fNTurns + 1;
-
-        std::copy(noise_dphi.begin(), noise_dphi.begin() + kmax - k,
-                  fDphi.begin() + k);
+    // auto rms_noise =
+    //     mymath::standard_deviation(noise_dphi.data(), noise_dphi.size());
+    // std::cout << "RF noise for time step " << noise_t[1]
+    //           << " s (iter " << i << ") has r.m.s phase "
+    //           << rms_noise << " rad (" << rms_noise * 180 / constant::pi
+    //           << " deg)\n";
+    return noise_dphi;
+}
 
-        auto rms_noise =
-            mymath::standard_deviation(noise_dphi.data(), noise_dphi.size());
-        // std::cout << "RF noise for time step " << noise_t[1]
-        //           << " s (iter " << i << ") has r.m.s phase "
-        //           << rms_noise << " rad (" << rms_noise * 180 / constant::pi
-        //           << " deg)\n";
-    }
+// Kept out of the loop over the turns, a vectorized cos would give other
+// last bits than the scalar one (see RfParameters::phi_s_turn)
+NOINLINE static double synchrotron_frequency(const double circumference,
+        const double harmonic, const double voltage, const double eta,
+        const double phi_s, const double energy)
+{
+    return constant::c / circumference *
+           std::sqrt(harmonic * voltage * std::abs(eta * std::cos(phi_s)) /
+                     (2 * constant::pi * energy));
 }
 
 LHCFlatSpectrum::LHCFlatSpectrum(uint time_points, uint corr_time, double fmin,
                                  double fmax, double initial_amplitude, int seed1,
-                                 int seed2, predistortion_t predistortion)
+                                 int seed2, predistortion_t predistortion,
+                                 bool streaming)
 {
     auto RfP = Context::RfP;
     auto GP = Context::GP;
@@ -345,7 +498,9 @@ LHCFlatSpectrum::LHCFlatSpectrum(uint time_points, uint corr_time, double fmin,
     fSeed1 = seed1;
     fSeed2 = seed2;
     fNTurns = GP->n_turns;
-    fDphi.resize(fNTurns + 1, 0);
+    fStreaming = streaming;
+    if (!fStreaming)
+        fDphi.resize(fNTurns + 1, 0);
 
     if (fPredistortion != predistortion_t::predistortion_none) {
         // Overwrite frequencies
@@ -358,65 +513,58 @@ LHCFlatSpectrum::LHCFlatSpectrum(uint time_points, uint corr_time, double fmin,
         exit(-1);
     }
 
-    // Synchrotron frequency array
-    auto phis =  RfP->calc_phi_s(RfP, RfParameters::acc_sys_t::as_single);
-
-    fFs.resize(phis.size());
-
-    for (uint i = 0; i < fFs.size(); ++i) {
-        fFs[i] =
-            constant::c / GP->ring_circumference *
-            std::sqrt(RfP->harmonic[RfP->section_index][i]
-                      * RfP->voltage[RfP->section_index][i] *
-                      std::abs(RfP->eta_0[i] * std::cos(phis[i])) /
-                      (2 * constant::pi * RfP->energy[i]));
-    }
+    // Synchrotron frequency array, in streaming mode only the turns of the
+    // windows are needed. The batch and the streaming noise use the same
+    // frequencies, as every turn goes through synchrotron_frequency().
+    const double circumference = GP->ring_circumference;
+    auto f_s = [RfP, circumference](int first, int n, double *out) {
+        f_vector_t phis(n), eta(n), energy(n);
+        RfP->calc_phi_s(first, n, phis.data());
+        RfP->eta_0.get(first, n, eta.data());
+        RfP->energy.get(first, n, energy.data());
+        const double *h = &RfP->harmonic[RfP->section_index][first];
+        const double *v = &RfP->voltage[RfP->section_index][first];
+        for (int j = 0; j < n; ++j)
+            out[j] = synchrotron_frequency(circumference, h[j], v[j],
+                                           eta[j], phis[j], energy[j]);
+    };
+    fFs = TurnArray(RfP->n_turns + 1, f_s, fStreaming ? fCorr : 0);
 }
 
-LHCFlatSpectrum::~LHCFlatSpectrum() { fft::destroy_plans(); }
+LHCFlatSpectrum::~LHCFlatSpectrum() { stop_prefetch(); }
 
-void LHCFlatSpectrum::generate()
-{
+void LHCFlatSpectrum::generate() { fill_dphi(); }
 
+f_vector_t LHCFlatSpectrum::generate_window(uint i)
+{
     auto GP = Context::GP;
 
-    for (uint i = 0; i < fNTurns / fCorr; ++i) {
-
-        // Scale amplitude to keep area (phase noise amplitude) constant
-        int k = i * fCorr; // Current time step
-        auto ampl = fAi * fFs[0] / fFs[k];
-
-        // Calculate the frequency step
-        int nf = fNt / 2 + 1; // #points in frequency domain
-        double df = GP->f_rev[k] / fNt;
-
-        f_vector_t freq(nf);
-        mymath::linspace(freq.data(), 0, nf * df, nf);
-
-        auto spectrum =
-            spectrum_generation(k, fNt, df, ampl, freq, fPredistortion);
-
-        f_vector_t noise_t, noise_dphi;
-        spectrum_to_phase_noise(noise_t, noise_dphi, freq, spectrum);
-
-        // spectrum_to_phase_noise();
-        fSeed1 += 239;
-        fSeed2 += 158;
-
-        // Fill phase noise array
-
-        const uint kmax =
-            i < fNTurns / fCorr - 1 ? (i + 1) * fCorr : fNTurns + 1;
-
-        for (uint i = 0; i < kmax - k; ++i)
-            fDphi[i + k] = noise_dphi[i];
-
-        auto rms_noise =
-            mymath::standard_deviation(noise_dphi.data(), noise_dphi.size());
-
-        // std::cout << "RF noise for time step " << noise_t[1]
-        //           << " s (iter " << i << ") has r.m.s phase "
-        //           << rms_noise << " rad (" << rms_noise * 180 / constant::pi
-        //           << " deg)\n";
-    }
+    // Scale amplitude to keep area (phase noise amplitude) constant
+    int k = i * fCorr; // Current time step
+    auto ampl = fAi * fs(0) / fs(k);
+
+    // Calculate the frequency step
+    int nf = fNt / 2 + 1; // #points in frequency domain
+    double f_rev;
+    GP->f_rev.get(k, 1, &f_rev);
+    double df = f_rev / fNt;
+
+    f_vector_t freq(nf);
+    mymath::linspace(freq.data(), 0, nf * df, nf);
+
+    auto spectrum =
+        spectrum_generation(k, fNt, df, ampl, freq, fPredistortion);
+
+    f_vector_t noise_t, noise_dphi;
+    spectrum_to_phase_noise(noise_t, noise_dphi, freq, spectrum,
+                            transform_t::transform_none,
+                            fSeed1 + 239 * i, fSeed2 + 158 * i);
+
+    // auto rms_noise =
+    //     mymath::standard_deviation(noise_dphi.data(), noise_dphi.size());
+    // std::cout << "RF noise for time step " << noise_t[1]
+    //           << " s (iter " << i << ") has r.m.s phase "
+    //           << rms_noise << " rad (" << rms_noise * 180 / constant::pi
+    //           << " deg)\n";
+    return noise_dphi;
 }
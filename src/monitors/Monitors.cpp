@@ -6,15 +6,28 @@
  */
 
 #include <blond/monitors/Monitors.h>
+#include <blond/math_functions.h>
+#include <blond/openmp.h>
+#include <blond/random.h>
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 using namespace H5;
 
+// Unless it is built thread-safe, HDF5 must not be called from two threads
+// at once: all the calls of the monitors take this lock
+static std::mutex hdf5_mutex;
+
 
 void *read_2D(std::string fname, std::string dsname,
               std::string type, hsize_t dims[])
 {
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
     auto file_id = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
     H5T_class_t class_id;
     size_t type_size;
@@ -42,6 +55,7 @@ void *read_2D(std::string fname, std::string dsname,
 void *read_1D(std::string fname, std::string dsname,
               std::string type, hsize_t dims[])
 {
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
     auto file_id = H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
     H5T_class_t class_id;
     size_t type_size;
@@ -66,77 +80,244 @@ void *read_1D(std::string fname, std::string dsname,
     return res;
 }
 
+// Writes the buffers handed to it on its own thread, while the monitor
+// fills the other one. Buffer n, of the two buffers n % 2, is written once
+// handed > n and can be filled again once written > n. The mutex is only
+// there for the threads to sleep on: the writer on wake, the tracking
+// thread on done.
+struct monitor_writer_t {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::atomic<int> handed{0};
+    std::atomic<int> written{0};
+    std::atomic<bool> stop{false};
+
+    // write(i) writes the buffer i
+    monitor_writer_t(std::function<void(int)> write)
+    {
+        thread = std::thread([this, write]() {
+            while (true) {
+                const int n = written.load(std::memory_order_relaxed);
+                if (n < handed.load(std::memory_order_acquire)) {
+                    write(n % 2);
+                    written.store(n + 1, std::memory_order_release);
+                    { std::lock_guard<std::mutex> lock(mutex); }
+                    done.notify_all();
+                    continue;
+                }
+                if (stop.load(std::memory_order_acquire))
+                    break;
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() {
+                    return stop.load() || written.load() < handed.load();
+                });
+            }
+        });
+    }
+
+    // The buffer to fill
+    int buffer() const { return handed.load(std::memory_order_relaxed) % 2; }
+
+    // Hands the filled buffer to the thread. Returns once the next one is
+    // free, that is right away unless the thread is a whole buffer behind.
+    void hand()
+    {
+        const int n = handed.load(std::memory_order_relaxed) + 1;
+        handed.store(n, std::memory_order_release);
+        { std::lock_guard<std::mutex> lock(mutex); }
+        wake.notify_one();
+        if (written.load(std::memory_order_acquire) >= n - 1)
+            return;
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this, n]() { return written.load() >= n - 1; });
+    }
+
+    // Returns once the handed buffers are written
+    void wait()
+    {
+        const int n = handed.load(std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this, n]() { return written.load() >= n; });
+    }
+
+    // Writes the handed buffers and stops the thread
+    ~monitor_writer_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop.store(true, std::memory_order_release);
+        }
+        wake.notify_one();
+        thread.join();
+    }
+};
+
+
 SlicesMonitor::SlicesMonitor(std::string filename, int n_turns, Slices *slices,
-                             int compression_level)
+                             int compression_level, int buffer_turns,
+                             int decimation, bool single_precision)
 {
     fFileName = filename;
-    fNTurns = n_turns;
     fSlices = slices;
     fITurn = 0;
-    fFile = new H5File(fFileName, H5F_ACC_TRUNC);
-    fGroup = new Group(fFile->createGroup("Slices"));
+    fITrack = 0;
     fCompressionLevel = compression_level;
+    fDecimation = std::max(1, decimation);
+    // A profile of the calls 0, fDecimation, 2 * fDecimation, ...
+    fNTurns = (n_turns + fDecimation - 1) / fDecimation;
+    fBufferTurns = std::max(1, std::min(buffer_turns, fNTurns));
+    fSinglePrecision = single_precision;
+    {
+        std::lock_guard<std::mutex> lock(hdf5_mutex);
+        fFile = new H5File(fFileName, H5F_ACC_TRUNC);
+        fGroup = new Group(fFile->createGroup("Slices"));
+    }
+    create_data({fSlices->n_slices, fNTurns});
+
+    for (auto &b : fBuffers) {
+        b.first = 0;
+        b.size = 0;
+        if (fSinglePrecision)
+            b.real_profiles.resize(fBufferTurns * fSlices->n_slices);
+        else
+            b.int_profiles.resize(fBufferTurns * fSlices->n_slices);
+    }
+    fWriter = new monitor_writer_t([this](int i) { write(fBuffers[i]); });
+}
+
+SlicesMonitor::buffer_t &SlicesMonitor::buffer()
+{
+    return fBuffers[fWriter->buffer()];
 }
 
 SlicesMonitor::~SlicesMonitor()
 {
+    close();
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
     delete fFile;
     delete fGroup;
 }
 
 void SlicesMonitor::track()
 {
-    if (fITurn == 0)
-        create_data({fSlices->n_slices, fNTurns});
-    write_data();
+    if (fITrack++ % fDecimation != 0 || fITurn >= fNTurns ||
+            fWriter == NULL)
+        return;
+
+    // A jump of the turns after a restart starts the next buffer
+    if (buffer().size > 0 && fITurn != buffer().first + buffer().size)
+        write_data();
+    auto &b = buffer();
+    if (b.size == 0)
+        b.first = fITurn;
+
+    const int n_slices = fSlices->n_slices;
+    const double *profile = fSlices->n_macroparticles.data();
+    if (fSinglePrecision) {
+        float *out = &b.real_profiles[b.size * n_slices];
+        for (int i = 0; i < n_slices; i++)
+            out[i] = profile[i];
+    } else {
+        int *out = &b.int_profiles[b.size * n_slices];
+        for (int i = 0; i < n_slices; i++)
+            out[i] = profile[i];
+    }
+    b.size++;
     fITurn++;
+
+    // The last profile is in the file when track() returns
+    if (b.size == fBufferTurns || fITurn == fNTurns)
+        write_data();
+    if (fITurn == fNTurns)
+        fWriter->wait();
 }
 
 
 void SlicesMonitor::write_data()
 {
+    if (fWriter == NULL || buffer().size == 0)
+        return;
+    fWriter->hand();
+    buffer().size = 0;
+}
+
+
+// Runs on the writer thread. The buffer holds one profile after the other,
+// the dataset one slice per row.
+void SlicesMonitor::write(buffer_t &b)
+{
+    const int n_slices = fSlices->n_slices;
+    if (fSinglePrecision)
+        transpose(b.real_profiles, b.size, n_slices, b.real_transposed);
+    else
+        transpose(b.int_profiles, b.size, n_slices, b.int_transposed);
+
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
     auto dataset = fGroup->openDataSet("n_macroparticles");
     hsize_t offset[2], count[2], stride[2], block[2];
-    const uint size = fSlices->n_macroparticles.size();
-    count[0] = size;
-    count[1] = 1;
+    count[0] = n_slices;
+    count[1] = b.size;
     offset[0] = 0;
-    offset[1] = fITurn;
+    offset[1] = b.first;
     stride[0] = stride[1] = 1;
     block[0] = block[1] = 1;
     DataSpace memspace(2, count, NULL);
     auto dataspace = dataset.getSpace();
     dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
 
-    auto temp = new int[size][1];
-    for (uint i = 0; i < size; i++)
-        temp[i][0] = fSlices->n_macroparticles[i];
+    if (fSinglePrecision)
+        dataset.write(b.real_transposed.data(), PredType::NATIVE_FLOAT,
+                      memspace, dataspace);
+    else
+        dataset.write(b.int_transposed.data(), PredType::NATIVE_INT,
+                      memspace, dataspace);
+}
 
-    dataset.write(temp, PredType::NATIVE_INT, memspace, dataspace);
-    delete[] temp;
 
+template <typename T>
+void SlicesMonitor::transpose(const std::vector<T> &in, const int rows,
+                              const int columns, std::vector<T> &out)
+{
+    out.resize(rows * columns);
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < columns; j++)
+            out[j * rows + i] = in[i * columns + j];
 }
 
 
 void SlicesMonitor::create_data(const int_vector_t dims)
 {
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
     hsize_t dim[2], chunk[2];
     dim[0] = dims[0];
     dim[1] = dims[1];
     chunk[0] = dims[0];
-    chunk[1] = 1;
+    chunk[1] = fBufferTurns;
     DataSpace dataspace(2, dim);
     DSetCreatPropList plist;
     plist.setChunk(2, chunk);
-    plist.setDeflate(fCompressionLevel);
+    if (fCompressionLevel > 0)
+        plist.setDeflate(fCompressionLevel);
     auto dset = DataSet(fGroup->createDataSet("n_macroparticles",
-                        PredType::NATIVE_INT,
+                        fSinglePrecision ? PredType::NATIVE_FLOAT
+                        : PredType::NATIVE_INT,
                         dataspace, plist));
 }
 
 
 void SlicesMonitor::close()
 {
+    if (fWriter == NULL)
+        return;
+
+    write_data();
+    delete fWriter;
+    fWriter = NULL;
+
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
+    fFile->flush(H5F_SCOPE_GLOBAL);
     fGroup->close();
     fFile->close();
 }
@@ -147,7 +328,8 @@ void SlicesMonitor::close()
 BunchMonitor::BunchMonitor(GeneralParameters *GP, RfParameters *RfP, Beams *Beam,
                            std::string filename, int buffer_time,
                            Slices *Slices, PhaseLoop *PL, LHCNoiseFB *noiseFB,
-                           int compression_level)
+                           int compression_level,
+                           std::map<std::string, int> compression_levels)
 {
     fFileName = filename;
     fNTurns = GP->n_turns;
@@ -158,9 +340,13 @@ BunchMonitor::BunchMonitor(GeneralParameters *GP, RfParameters *RfP, Beams *Beam
     fSlices = Slices;
     fNoiseFB = noiseFB;
     fPL = PL;
-    fH5File = new H5File(fFileName, H5F_ACC_TRUNC);
-    fH5Group = new Group(fH5File->createGroup("Beam"));
     fCompressionLevel = compression_level;
+    fCompressionLevels = compression_levels;
+    {
+        std::lock_guard<std::mutex> lock(hdf5_mutex);
+        fH5File = new H5File(fFileName, H5F_ACC_TRUNC);
+        fH5Group = new Group(fH5File->createGroup("Beam"));
+    }
 
 
     if (fSlices != NULL && fSlices->fit_option == Slices::fit_t::gaussian)
@@ -172,10 +358,18 @@ BunchMonitor::BunchMonitor(GeneralParameters *GP, RfParameters *RfP, Beams *Beam
 
     init_buffer();
 
+    fWriter = new monitor_writer_t([this](int i) { write(fBuffers[i]); });
+
     track();
 }
 
 
+BunchMonitor::buffer_t &BunchMonitor::buffer()
+{
+    return fBuffers[fWriter->buffer()];
+}
+
+
 BunchMonitor::~BunchMonitor()
 {
     close();
@@ -188,400 +382,456 @@ void BunchMonitor::track()
     if (fITurn <= fNTurns)
         write_buffer();
     fITurn++;
-    if (fITurn > 0 && fITurn % fBufferTime == 0) {
+    if (buffer().size == fBufferTime)
         write_data();
-        // init_buffer();
-    }
 }
 
 
-void BunchMonitor::init_data(int dimension)
+int BunchMonitor::compression(const std::string &dataset) const
 {
-    int_vector_t intV(dimension);
-    std::vector<real_t> realV(dimension);
-    std::vector<double> doubleV(dimension);
-
-    hsize_t dim[1], chunk[1];
-    dim[0] = dimension;
-    chunk[0] = 1000;
-
-    DataSpace dataspace(1, dim);
-    DSetCreatPropList plist;
-    plist.setDeflate(fCompressionLevel);
-    plist.setChunk(1, chunk);
-
-    fBeam->statistics();
-
-
-    auto dataset = fH5Group->createDataSet("n_macroparticles_alive",
-                                           PredType::NATIVE_INT,
-                                           dataspace, plist);
-    intV[0] = fBeam->n_macroparticles_alive();
-    dataset.write(intV.data(), PredType::NATIVE_INT);
-
-
-    dataset = fH5Group->createDataSet("mean_dt",
-                                      NATIVE_REAL_T,
-                                      dataspace, plist);
-    realV[0] = fBeam->mean_dt;
-    dataset.write(realV.data(), NATIVE_REAL_T);
-
-
-    dataset = fH5Group->createDataSet("mean_dE",
-                                      NATIVE_REAL_T,
-                                      dataspace, plist);
-    realV[0] = fBeam->mean_dE;
-    dataset.write(realV.data(), NATIVE_REAL_T);
-
-
-
-    dataset = fH5Group->createDataSet("sigma_dt",
-                                      NATIVE_REAL_T,
-                                      dataspace, plist);
-    realV[0] = fBeam->sigma_dt;
-    dataset.write(realV.data(), NATIVE_REAL_T);
-
-
-    dataset = fH5Group->createDataSet("sigma_dE",
-                                      NATIVE_REAL_T,
-                                      dataspace, plist);
-    realV[0] = fBeam->sigma_dE;
-    dataset.write(realV.data(), NATIVE_REAL_T);
-
-
-    dataset = fH5Group->createDataSet("epsn_rms_l",
-                                      NATIVE_REAL_T,
-                                      dataspace, plist);
-    realV[0] = fBeam->epsn_rms_l;
-    dataset.write(realV.data(), NATIVE_REAL_T);
+    auto it = fCompressionLevels.find(dataset);
+    return it == fCompressionLevels.end() ? fCompressionLevel : it->second;
+}
 
 
-    if (fGaussian) {
-        dataset = fH5Group->createDataSet("bunch_length_gaussian",
-                                          NATIVE_REAL_T,
-                                          dataspace, plist);
-        realV[0] = fSlices->bl_gauss;
-        dataset.write(realV.data(), NATIVE_REAL_T);
-    }
+void BunchMonitor::init_data(int dimension)
+{
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
+
+    // Not written yet turns read as 0
+    auto create = [this, dimension](const std::string & name,
+    const DataType & type, const hsize_t columns) {
+        hsize_t dim[2], chunk[2];
+        dim[0] = dimension;
+        dim[1] = columns;
+        chunk[0] = 1000;
+        chunk[1] = 1;
+        const int rank = columns == 0 ? 1 : 2;
+
+        DataSpace dataspace(rank, dim);
+        DSetCreatPropList plist;
+        plist.setChunk(rank, chunk);
+        if (compression(name) > 0)
+            plist.setDeflate(compression(name));
+        fH5Group->createDataSet(name, type, dataspace, plist);
+    };
+
+    create("n_macroparticles_alive", PredType::NATIVE_INT, 0);
+    create("mean_dt", NATIVE_REAL_T, 0);
+    create("mean_dE", NATIVE_REAL_T, 0);
+    create("sigma_dt", NATIVE_REAL_T, 0);
+    create("sigma_dE", NATIVE_REAL_T, 0);
+    create("epsn_rms_l", NATIVE_REAL_T, 0);
 
+    if (fGaussian)
+        create("bunch_length_gaussian", NATIVE_REAL_T, 0);
 
     if (fPL != NULL) {
-        dataset = fH5Group->createDataSet("PL_omegaRF",
-                                          PredType::NATIVE_DOUBLE,
-                                          dataspace, plist);
-        doubleV[0] = fRfP->omega_rf[0][0];
-        dataset.write(doubleV.data(), PredType::NATIVE_DOUBLE);
-
-
-        dataset = fH5Group->createDataSet("PL_phiRF",
-                                          NATIVE_REAL_T,
-                                          dataspace, plist);
-        realV[0] = fRfP->phi_rf[0][0];
-        dataset.write(realV.data(), NATIVE_REAL_T);
-
-
-        dataset = fH5Group->createDataSet("PL_bunch_phase",
-                                          NATIVE_REAL_T,
-                                          dataspace, plist);
-        realV[0] = fPL->phi_beam;
-        dataset.write(realV.data(), NATIVE_REAL_T);
-
-
-        dataset = fH5Group->createDataSet("PL_phase_corr",
-                                          NATIVE_REAL_T,
-                                          dataspace, plist);
-        realV[0] = fPL->dphi;
-        dataset.write(realV.data(), NATIVE_REAL_T);
+        create("PL_omegaRF", PredType::NATIVE_DOUBLE, 0);
+        create("PL_phiRF", NATIVE_REAL_T, 0);
+        create("PL_bunch_phase", NATIVE_REAL_T, 0);
+        create("PL_phase_corr", NATIVE_REAL_T, 0);
+        create("PL_omegaRF_corr", NATIVE_REAL_T, 0);
+        create("SL_dphiRF", NATIVE_REAL_T, 0);
+        create("RL_drho", NATIVE_REAL_T, 0);
+    }
 
+    if (fNoiseFB != NULL) {
+        create("LHC_noise_FB_factor", NATIVE_REAL_T, 0);
+        create("LHC_noise_FB_bl", NATIVE_REAL_T, 0);
+        if (!fNoiseFB->fBlMeasBBB.empty())
+            create("LHC_noise_FB_bl_bbb", NATIVE_REAL_T,
+                   fNoiseFB->fBlMeasBBB.size());
+    }
+}
 
-        dataset = fH5Group->createDataSet("PL_omegaRF_corr",
-                                          NATIVE_REAL_T,
-                                          dataspace, plist);
-        realV[0] = fPL->domega_rf;
-        dataset.write(realV.data(), NATIVE_REAL_T);
 
+// Runs on the writer thread
+void BunchMonitor::write(const buffer_t &b)
+{
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
 
-        dataset = fH5Group->createDataSet("SL_dphiRF",
-                                          NATIVE_REAL_T,
-                                          dataspace, plist);
-        realV[0] = fRfP->dphi_rf[0];
-        dataset.write(realV.data(), NATIVE_REAL_T);
+    hsize_t offset[2], count[2], stride[2], block[2];
+    count[0] = b.size;
+    offset[0] = b.first;
+    offset[1] = 0;
+    stride[0] = stride[1] = 1;
+    block[0] = block[1] = 1;
 
+    auto write_1d = [&](const std::string & name, const void *data,
+    const DataType & type) {
+        DataSpace memspace(1, count, NULL);
+        auto dataset = fH5Group->openDataSet(name);
+        auto dataspace = dataset.getSpace();
+        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride,
+                                  block);
+        dataset.write(data, type, memspace, dataspace);
+    };
+
+    write_1d("n_macroparticles_alive", b.np_alive.data(),
+             PredType::NATIVE_INT);
+    write_1d("mean_dt", b.mean_dt.data(), NATIVE_REAL_T);
+    write_1d("mean_dE", b.mean_dE.data(), NATIVE_REAL_T);
+    write_1d("sigma_dt", b.sigma_dt.data(), NATIVE_REAL_T);
+    write_1d("sigma_dE", b.sigma_dE.data(), NATIVE_REAL_T);
+    write_1d("epsn_rms_l", b.epsn_rms.data(), NATIVE_REAL_T);
 
-        dataset = fH5Group->createDataSet("RL_drho",
-                                          NATIVE_REAL_T,
-                                          dataspace, plist);
-        realV[0] = fPL->drho;
-        dataset.write(realV.data(), NATIVE_REAL_T);
+    if (fGaussian)
+        write_1d("bunch_length_gaussian", b.bl_gauss.data(), NATIVE_REAL_T);
 
+    if (fPL != NULL) {
+        write_1d("PL_omegaRF", b.PL_omegaRF.data(), PredType::NATIVE_DOUBLE);
+        write_1d("PL_phiRF", b.PL_phiRF.data(), NATIVE_REAL_T);
+        write_1d("PL_bunch_phase", b.PL_bunch_phase.data(), NATIVE_REAL_T);
+        write_1d("PL_phase_corr", b.PL_phase_corr.data(), NATIVE_REAL_T);
+        write_1d("PL_omegaRF_corr", b.PL_omegaRF_corr.data(), NATIVE_REAL_T);
+        write_1d("SL_dphiRF", b.SL_dphiRF.data(), NATIVE_REAL_T);
+        write_1d("RL_drho", b.RL_drho.data(), NATIVE_REAL_T);
     }
 
-
     if (fNoiseFB != NULL) {
-        dataset = fH5Group->createDataSet("LHC_noise_FB_factor",
-                                          NATIVE_REAL_T,
-                                          dataspace, plist);
-        realV[0] = fNoiseFB->fX;
-        dataset.write(realV.data(), NATIVE_REAL_T);
-
-
-        dataset = fH5Group->createDataSet("LHC_noise_FB_bl",
-                                          NATIVE_REAL_T,
-                                          dataspace, plist);
-        realV[0] = fNoiseFB->fBlMeas;
-        dataset.write(realV.data(), NATIVE_REAL_T);
-
-        if (!fNoiseFB->fBlMeasBBB.empty()) {
-            hsize_t dim[2], chunk[2];
-            dim[1] = fNoiseFB->fBlMeasBBB.size();
-            dim[0] = dimension;
-            chunk[0] = 1000;
-            chunk[1] = 1;
-
-            DataSpace dataspace(2, dim);
-            DSetCreatPropList plist;
-            plist.setChunk(2, chunk);
-            plist.setDeflate(fCompressionLevel);
+        write_1d("LHC_noise_FB_factor", b.LHCnoiseFB_factor.data(),
+                 NATIVE_REAL_T);
+        write_1d("LHC_noise_FB_bl", b.LHCnoiseFB_bl.data(), NATIVE_REAL_T);
 
-            dataset = fH5Group->createDataSet("LHC_noise_FB_bl_bbb",
-                                              NATIVE_REAL_T,
-                                              dataspace, plist);
-
-            // realV = fNoiseFB->fBlMeasBBB;
-            realV = std::vector<real_t>(fNoiseFB->fBlMeasBBB.begin(),
-                                        fNoiseFB->fBlMeasBBB.end());
-            dataset.write(realV.data(), NATIVE_REAL_T);
+        if (!b.LHCnoiseFB_bl_bbb.empty()) {
+            count[1] = b.LHCnoiseFB_bl_bbb.size() / fBufferTime;
+            DataSpace memspace(2, count, NULL);
+            auto dataset = fH5Group->openDataSet("LHC_noise_FB_bl_bbb");
+            auto dataspace = dataset.getSpace();
+            dataspace.selectHyperslab(H5S_SELECT_SET, count,
+                                      offset, stride, block);
+            dataset.write(b.LHCnoiseFB_bl_bbb.data(), NATIVE_REAL_T,
+                          memspace, dataspace);
         }
     }
-
 }
 
-// TODO error when chosing buffer_time == 1,2
+
 void BunchMonitor::write_data()
 {
-    // const int rank = dims.size();
-    hsize_t offset[1], count[1], stride[1], block[1];
-    count[0] = fBufferTime;
-    offset[0] = fITurn - fBufferTime;
-    stride[0] = 1;
-    block[0] = 1;
-    DataSpace memspace(1, count, NULL);
-    // std::cout << fITurn << "\n";
-    auto dataset = fH5Group->openDataSet("n_macroparticles_alive");
-    auto dataspace = dataset.getSpace();
-    dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-    dataset.write(b_np_alive.data(), PredType::NATIVE_INT,
-                  memspace, dataspace);
-
-
-    dataset = fH5Group->openDataSet("mean_dt");
-    dataspace = dataset.getSpace();
-    dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-    dataset.write(b_mean_dt.data(), NATIVE_REAL_T,
-                  memspace, dataspace);
+    if (fWriter == NULL || buffer().size == 0)
+        return;
 
-
-    dataset = fH5Group->openDataSet("mean_dE");
-    dataspace = dataset.getSpace();
-    dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-    dataset.write(b_mean_dE.data(), NATIVE_REAL_T,
-                  memspace, dataspace);
-
-
-    dataset = fH5Group->openDataSet("sigma_dt");
-    dataspace = dataset.getSpace();
-    dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-    dataset.write(b_sigma_dt.data(), NATIVE_REAL_T,
-                  memspace, dataspace);
+    fWriter->hand();
+    buffer().size = 0;
+}
 
 
-    dataset = fH5Group->openDataSet("sigma_dE");
-    dataspace = dataset.getSpace();
-    dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-    dataset.write(b_sigma_dE.data(), NATIVE_REAL_T,
-                  memspace, dataspace);
+// void BunchMonitor::open(){}
+void BunchMonitor::init_buffer()
+{
+    for (auto &b : fBuffers) {
+        b.first = 0;
+        b.size = 0;
+        b.np_alive.resize(fBufferTime);
+        b.mean_dt.resize(fBufferTime);
+        b.mean_dE.resize(fBufferTime);
+        b.sigma_dt.resize(fBufferTime);
+        b.sigma_dE.resize(fBufferTime);
+        b.epsn_rms.resize(fBufferTime);
+
+        if (fGaussian)
+            b.bl_gauss.resize(fBufferTime);
+
+        if (fPL != NULL) {
+            b.PL_omegaRF.resize(fBufferTime);
+            b.PL_phiRF.resize(fBufferTime);
+            b.PL_bunch_phase.resize(fBufferTime);
+            b.PL_phase_corr.resize(fBufferTime);
+            b.PL_omegaRF_corr.resize(fBufferTime);
+            b.SL_dphiRF.resize(fBufferTime);
+            b.RL_drho.resize(fBufferTime);
+        }
+        if (fNoiseFB != NULL) {
+            b.LHCnoiseFB_factor.resize(fBufferTime);
+            b.LHCnoiseFB_bl.resize(fBufferTime);
+            b.LHCnoiseFB_bl_bbb.resize(fBufferTime *
+                                       fNoiseFB->fBlMeasBBB.size());
+        }
+    }
+}
 
 
-    dataset = fH5Group->openDataSet("epsn_rms_l");
-    dataspace = dataset.getSpace();
-    dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-    dataset.write(b_epsn_rms.data(), NATIVE_REAL_T,
-                  memspace, dataspace);
-
-    if (fGaussian) {
-        dataset = fH5Group->openDataSet("bunch_length_gaussian");
-        dataspace = dataset.getSpace();
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-        dataset.write(b_bl_gauss.data(), NATIVE_REAL_T,
-                      memspace, dataspace);
+void BunchMonitor::write_buffer()
+{
+    // A full buffer, or a jump of the turns after a restart, starts the
+    // next buffer
+    if (buffer().size > 0 && (buffer().size == fBufferTime
+                              || fITurn != buffer().first + buffer().size))
+        write_data();
+    auto &b = buffer();
+    if (b.size == 0)
+        b.first = fITurn;
+    const int i = b.size++;
+
+    b.np_alive[i] = fBeam->n_macroparticles_alive();
+    b.mean_dt[i] = fBeam->mean_dt;
+    b.mean_dE[i] = fBeam->mean_dE;
+    b.sigma_dt[i] = fBeam->sigma_dt;
+    b.sigma_dE[i] = fBeam->sigma_dE;
+    b.epsn_rms[i] = fBeam->epsn_rms_l;
 
-    }
+    if (fGaussian)
+        b.bl_gauss[i] = fSlices->bl_gauss;
 
     if (fPL != NULL) {
-        dataset = fH5Group->openDataSet("PL_omegaRF");
-        dataspace = dataset.getSpace();
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-        dataset.write(b_PL_omegaRF.data(), PredType::NATIVE_DOUBLE,
-                      memspace, dataspace);
+        b.PL_omegaRF[i] = fRfP->omega_rf[0][fITurn];
+        b.PL_phiRF[i] = fRfP->phi_rf[0][fITurn];
+        b.PL_bunch_phase[i] = fPL->phi_beam;
+        b.PL_phase_corr[i] = fPL->dphi;
+        b.PL_omegaRF_corr[i] = fPL->domega_rf;
+        b.SL_dphiRF[i] = fRfP->dphi_rf[0];
+        b.RL_drho[i] = fPL->drho;
+    }
 
-        dataset = fH5Group->openDataSet("PL_phiRF");
-        dataspace = dataset.getSpace();
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-        dataset.write(b_PL_phiRF.data(), NATIVE_REAL_T,
-                      memspace, dataspace);
+    if (fNoiseFB != NULL) {
+        b.LHCnoiseFB_factor[i] = fNoiseFB->fX;
+        b.LHCnoiseFB_bl[i] = fNoiseFB->fBlMeas;
+        const auto &bbb = fNoiseFB->fBlMeasBBB;
+        std::copy(bbb.begin(), bbb.end(),
+                  b.LHCnoiseFB_bl_bbb.begin() + i * bbb.size());
+    }
+}
 
-        dataset = fH5Group->openDataSet("PL_bunch_phase");
-        dataspace = dataset.getSpace();
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-        dataset.write(b_PL_bunch_phase.data(), NATIVE_REAL_T,
-                      memspace, dataspace);
+void BunchMonitor::close()
+{
+    if (fWriter == NULL)
+        return;
 
-        dataset = fH5Group->openDataSet("PL_phase_corr");
-        dataspace = dataset.getSpace();
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-        dataset.write(b_PL_phase_corr.data(), NATIVE_REAL_T,
-                      memspace, dataspace);
+    // The turns after the last full buffer too
+    write_data();
+    delete fWriter;
+    fWriter = NULL;
 
-        dataset = fH5Group->openDataSet("PL_omegaRF_corr");
-        dataspace = dataset.getSpace();
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-        dataset.write(b_PL_omegaRF_corr.data(), NATIVE_REAL_T,
-                      memspace, dataspace);
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
+    fH5File->flush(H5F_SCOPE_GLOBAL);
+    fH5Group->close();
+    fH5File->close();
+    delete fH5Group;
+    delete fH5File;
+    fH5Group = NULL;
+    fH5File = NULL;
+}
 
 
-        dataset = fH5Group->openDataSet("SL_dphiRF");
-        dataspace = dataset.getSpace();
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-        dataset.write(b_SL_dphiRF.data(), NATIVE_REAL_T,
-                      memspace, dataspace);
 
-        dataset = fH5Group->openDataSet("RL_drho");
-        dataspace = dataset.getSpace();
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-        dataset.write(b_RL_drho.data(), NATIVE_REAL_T,
-                      memspace, dataspace);
+PhaseSpaceMonitor::PhaseSpaceMonitor(GeneralParameters *GP, RfParameters *RfP,
+                                     Beams *Beam, std::string filename,
+                                     int every, int n_particles,
+                                     bool single_precision,
+                                     int compression_level, uint64_t seed)
+{
+    fFileName = filename;
+    fRfP = RfP;
+    fBeam = Beam;
+    fEvery = std::max(1, every);
+    fNSnapshots = GP->n_turns / fEvery + 1;
+    fSinglePrecision = single_precision;
+    fCompressionLevel = compression_level;
+    fLastTurn = -1;
+
+    const int size = fBeam->n_macroparticles;
+    if (n_particles > 0 && n_particles < size)
+        fSample = sample(size, n_particles, seed);
+    const int n = fSample.empty() ? size : fSample.size();
+
+    {
+        std::lock_guard<std::mutex> lock(hdf5_mutex);
+        fFile = new H5File(fFileName, H5F_ACC_TRUNC);
+        fGroup = new Group(fFile->createGroup("PhaseSpace"));
+
+        hsize_t dim[2], chunk[2];
+        dim[0] = fNSnapshots;
+        dim[1] = n;
+        chunk[0] = 1;
+        chunk[1] = std::min(n, 1 << 20);
+        DataSpace dataspace(2, dim);
+        DSetCreatPropList plist;
+        plist.setChunk(2, chunk);
+        if (fCompressionLevel > 0)
+            plist.setDeflate(fCompressionLevel);
+        const DataType &real = fSinglePrecision ? PredType::NATIVE_FLOAT
+                               : PredType::NATIVE_DOUBLE;
+        fGroup->createDataSet("dt", real, dataspace, plist);
+        fGroup->createDataSet("dE", real, dataspace, plist);
+        fGroup->createDataSet("id", PredType::NATIVE_INT, dataspace, plist);
+
+        const int none = -1;
+        DSetCreatPropList turn_plist;
+        turn_plist.setFillValue(PredType::NATIVE_INT, &none);
+        fGroup->createDataSet("turn", PredType::NATIVE_INT,
+                              DataSpace(1, dim), turn_plist);
+
+        int_vector_t index = fSample;
+        if (index.empty())
+            index = mymath::arange(0, size);
+        auto dataset = fGroup->createDataSet("index", PredType::NATIVE_INT,
+                                             DataSpace(1, &dim[1]));
+        dataset.write(index.data(), PredType::NATIVE_INT);
     }
 
-    if (fNoiseFB != NULL) {
-        dataset = fH5Group->openDataSet("LHC_noise_FB_factor");
-        dataspace = dataset.getSpace();
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-        dataset.write(b_LHCnoiseFB_factor.data(), NATIVE_REAL_T,
-                      memspace, dataspace);
-
-
-        dataset = fH5Group->openDataSet("LHC_noise_FB_bl");
-        dataspace = dataset.getSpace();
-        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset, stride, block);
-        dataset.write(b_LHCnoiseFB_bl.data(), NATIVE_REAL_T,
-                      memspace, dataspace);
-
+    for (auto &b : fBuffers) {
+        if (fSinglePrecision) {
+            b.real_dt.resize(n);
+            b.real_dE.resize(n);
+        } else {
+            b.dt.resize(n);
+            b.dE.resize(n);
+        }
+        b.id.resize(n);
+    }
+    fWriter = new monitor_writer_t([this](int i) { write(fBuffers[i]); });
 
-        // TODO: Particularly test this part
-        if (!fNoiseFB->fBlMeasBBB.empty()) {
+    // The snapshot of the current turn, usually turn 0
+    track();
+}
 
-            hsize_t offset[2], count[2], stride[2], block[2];
-            const uint size = fNoiseFB->fBlMeasBBB.size();
-            count[0] = 1;
-            count[1] = size;
-            offset[0] = fITurn;
-            offset[1] = 0;
-            stride[0] = stride[1] = 1;
-            block[0] = block[1] = 1;
 
-            DataSpace memspace(2, count, NULL);
+PhaseSpaceMonitor::~PhaseSpaceMonitor()
+{
+    close();
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
+    delete fGroup;
+    delete fFile;
+}
 
-            real_t *temp = new real_t[fBufferTime * size];
-            for (int i = 0; i < fBufferTime; i++)
-                for (uint j = 0; j < size; j++)
-                    temp[i * size + j] = b_LHCnoiseFB_bl_bbb[i][j];
 
+PhaseSpaceMonitor::buffer_t &PhaseSpaceMonitor::buffer()
+{
+    return fBuffers[fWriter->buffer()];
+}
 
-            dataset = fH5Group->openDataSet("LHC_noise_FB_bl_bbb");
-            dataspace = dataset.getSpace();
-            dataspace.selectHyperslab(H5S_SELECT_SET, count,
-                                      offset, stride, block);
-            dataset.write(temp, NATIVE_REAL_T,
-                          memspace, dataspace);
 
-            delete[] temp;
+int_vector_t PhaseSpaceMonitor::sample(const int size, const int n,
+                                       const uint64_t seed)
+{
+    if (n >= size)
+        return mymath::arange(0, size);
+
+    // The candidates below a threshold a bit above n / size, in index
+    // order, then the n smallest of them
+    const rng::CounterRNG generator(seed);
+    const int parts = std::max(1, std::min(omp_get_max_threads(),
+                                           size >> 16));
+    double threshold = std::min(1.0, (n + 4 * std::sqrt(n) + 16) / size);
+    std::vector<std::pair<double, int>> candidates;
+    while (true) {
+        std::vector<std::vector<std::pair<double, int>>> found(parts);
+        #pragma omp parallel for schedule(static, 1)
+        for (int p = 0; p < parts; p++) {
+            const int last = (p == parts - 1) ? size
+                             : (int)((long long) size * (p + 1) / parts);
+            for (int i = (int)((long long) size * p / parts); i < last; i++) {
+                const double u = generator.uniform(i);
+                if (u <= threshold)
+                    found[p].push_back({u, i});
+            }
         }
-
+        candidates.clear();
+        for (const auto &f : found)
+            candidates.insert(candidates.end(), f.begin(), f.end());
+        if ((int) candidates.size() >= n)
+            break;
+        threshold = std::min(1.0, 2 * threshold);
     }
 
+    std::nth_element(candidates.begin(), candidates.begin() + n,
+                     candidates.end());
+    int_vector_t index(n);
+    for (int i = 0; i < n; i++)
+        index[i] = candidates[i].second;
+    std::sort(index.begin(), index.end());
+    return index;
 }
 
 
-// void BunchMonitor::open(){}
-void BunchMonitor::init_buffer()
+void PhaseSpaceMonitor::track()
 {
-    b_np_alive.resize(fBufferTime);
-    b_mean_dt.resize(fBufferTime);
-    b_mean_dE.resize(fBufferTime);
-    b_sigma_dt.resize(fBufferTime);
-    b_sigma_dE.resize(fBufferTime);
-    b_epsn_rms.resize(fBufferTime);
-
-    if (fGaussian)
-        b_bl_gauss.resize(fBufferTime);
-
-    if (fPL != NULL) {
-        b_PL_omegaRF.resize(fBufferTime);
-        b_PL_phiRF.resize(fBufferTime);
-        b_PL_bunch_phase.resize(fBufferTime);
-        b_PL_phase_corr.resize(fBufferTime);
-        b_PL_omegaRF_corr.resize(fBufferTime);
-        b_SL_dphiRF.resize(fBufferTime);
-        b_RL_drho.resize(fBufferTime);
-    }
-    if (fNoiseFB != NULL) {
-        b_LHCnoiseFB_factor.resize(fBufferTime);
-        b_LHCnoiseFB_bl.resize(fBufferTime);
-        if (!fNoiseFB->fBlMeasBBB.empty())
-            b_LHCnoiseFB_bl_bbb.resize(fBufferTime);
+    const int turn = fRfP->counter;
+    if (fWriter == NULL || turn % fEvery != 0 || turn == fLastTurn
+            || turn / fEvery >= fNSnapshots)
+        return;
+    fLastTurn = turn;
+
+    auto &b = buffer();
+    b.row = turn / fEvery;
+    b.turn = turn;
+
+    const double *dt = fBeam->dt.data();
+    const double *dE = fBeam->dE.data();
+    const int *id = fBeam->id.data();
+    const int *index = fSample.data();
+    const int n = b.id.size();
+    const bool all = fSample.empty();
+    if (fSinglePrecision) {
+        #pragma omp parallel for
+        for (int i = 0; i < n; i++) {
+            const int j = all ? i : index[i];
+            b.real_dt[i] = dt[j];
+            b.real_dE[i] = dE[j];
+            b.id[i] = id[j];
+        }
+    } else {
+        #pragma omp parallel for
+        for (int i = 0; i < n; i++) {
+            const int j = all ? i : index[i];
+            b.dt[i] = dt[j];
+            b.dE[i] = dE[j];
+            b.id[i] = id[j];
+        }
     }
-
+    fWriter->hand();
 }
 
 
-void BunchMonitor::write_buffer()
+// Runs on the writer thread
+void PhaseSpaceMonitor::write(const buffer_t &b)
 {
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
 
-    int i = fITurn % fBufferTime;
-
-    b_np_alive[i] = fBeam->n_macroparticles_alive();
-    b_mean_dt[i] = fBeam->mean_dt;
-    b_mean_dE[i] = fBeam->mean_dE;
-    b_sigma_dt[i] = fBeam->sigma_dt;
-    b_sigma_dE[i] = fBeam->sigma_dE;
-    b_epsn_rms[i] = fBeam->epsn_rms_l;
-
-    if (fGaussian)
-        b_bl_gauss[i] = fSlices->bl_gauss;
+    hsize_t offset[2], count[2];
+    count[0] = 1;
+    count[1] = b.id.size();
+    offset[0] = b.row;
+    offset[1] = 0;
+    DataSpace memspace(2, count, NULL);
 
-    if (fPL != NULL) {
-        b_PL_omegaRF[i] = fRfP->omega_rf[0][fITurn];
-        b_PL_phiRF[i] = fRfP->phi_rf[0][fITurn];
-        b_PL_bunch_phase[i] = fPL->phi_beam;
-        b_PL_phase_corr[i] = fPL->dphi;
-        b_PL_omegaRF_corr[i] = fPL->domega_rf;
-        b_SL_dphiRF[i] = fRfP->dphi_rf[0];
-        b_RL_drho[i] = fPL->drho;
+    auto write_row = [&](const std::string & name, const void *data,
+    const DataType & type) {
+        auto dataset = fGroup->openDataSet(name);
+        auto dataspace = dataset.getSpace();
+        dataspace.selectHyperslab(H5S_SELECT_SET, count, offset);
+        dataset.write(data, type, memspace, dataspace);
+    };
+
+    if (fSinglePrecision) {
+        write_row("dt", b.real_dt.data(), PredType::NATIVE_FLOAT);
+        write_row("dE", b.real_dE.data(), PredType::NATIVE_FLOAT);
+    } else {
+        write_row("dt", b.dt.data(), PredType::NATIVE_DOUBLE);
+        write_row("dE", b.dE.data(), PredType::NATIVE_DOUBLE);
     }
+    write_row("id", b.id.data(), PredType::NATIVE_INT);
 
-    if (fNoiseFB != NULL) {
-        b_LHCnoiseFB_factor[i] = fNoiseFB->fX;
-        b_LHCnoiseFB_bl[i] = fNoiseFB->fBlMeas;
-        if (!fNoiseFB->fBlMeasBBB.empty())
-            b_LHCnoiseFB_bl_bbb[i] =
-                std::vector<real_t> (fNoiseFB->fBlMeasBBB.begin(),
-                                     fNoiseFB->fBlMeasBBB.end());
-        // b_LHCnoiseFB_bl_bbb[i] = fNoiseFB->fBlMeasBBB;
-    }
+    auto dataset = fGroup->openDataSet("turn");
+    auto dataspace = dataset.getSpace();
+    DataSpace one(1, count);
+    dataspace.selectHyperslab(H5S_SELECT_SET, count, offset);
+    dataset.write(&b.turn, PredType::NATIVE_INT, one, dataspace);
 }
 
-void BunchMonitor::close()
+
+void PhaseSpaceMonitor::close()
 {
-    fH5Group->close();
-    fH5File->close();
+    if (fWriter == NULL)
+        return;
+
+    delete fWriter;
+    fWriter = NULL;
+
+    std::lock_guard<std::mutex> lock(hdf5_mutex);
+    fFile->flush(H5F_SCOPE_GLOBAL);
+    fGroup->close();
+    fFile->close();
 }
@@ -0,0 +1,62 @@
+/*
+ * random.cpp
+ *
+ *  Counter-based random numbers, reproducible in parallel code
+ */
+
+#include <algorithm>
+#include <blond/random.h>
+
+namespace rng {
+
+    void CounterRNG::normal2(const uint64_t index, double &n1,
+                             double &n2) const
+    {
+        double u1, u2;
+        uniform2(index, u1, u2);
+        const double r = std::sqrt(-2.0 * std::log(u1));
+        const double phi = 2.0 * constant::pi * u2;
+        n1 = r * std::cos(phi);
+        n2 = r * std::sin(phi);
+    }
+
+    void CounterRNG::normal(double *out, const uint n, const uint64_t first,
+                            const double mean, const double sigma) const
+    {
+        if (n == 0)
+            return;
+
+        // Pairs per block, a multiple of any vector width, so that every
+        // pair goes through the same vector code
+        const uint pairs = 64;
+        const uint64_t last = first + n;
+        const long long firstBlock = first / (2 * pairs);
+        const long long lastBlock = (last - 1) / (2 * pairs);
+
+        #pragma omp parallel for
+        for (long long b = firstBlock; b <= lastBlock; ++b) {
+            double u1[pairs], u2[pairs], r[pairs], n1[pairs], n2[pairs];
+            const uint64_t pair0 = b * pairs;
+            for (uint j = 0; j < pairs; ++j)
+                uniform2(pair0 + j, u1[j], u2[j]);
+
+            // cos and sin in separate loops, in one the compiler fuses them
+            // into a sincos call that has no vector version
+            for (uint j = 0; j < pairs; ++j) {
+                r[j] = std::sqrt(-2.0 * std::log(u1[j]));
+                u2[j] *= 2.0 * constant::pi;
+                n1[j] = r[j] * std::cos(u2[j]);
+            }
+            for (uint j = 0; j < pairs; ++j)
+                n2[j] = r[j] * std::sin(u2[j]);
+
+            // The part of the block inside [first, last)
+            const uint64_t lo = std::max(first, 2 * pair0);
+            const uint64_t hi = std::min(last, 2 * (pair0 + pairs));
+            for (uint64_t k = lo; k < hi; ++k) {
+                const uint64_t j = k / 2 - pair0;
+                out[k - first] = mean + sigma * ((k % 2) ? n2[j] : n1[j]);
+            }
+        }
+    }
+}
@@ -93,15 +93,21 @@ inline void RingAndRfSection::drift(double *__restrict beam_dt,
 
 void RingAndRfSection::track()
 {
+    // Only the tracker moves the windows of the lazy arrays (see
+    // TurnArray), the other readers of the turn find their values there
+    Context::GP->advance(counter);
+    rfp->advance(counter);
+    acceleration_kick.advance(counter);
 
     if (!phi_noise.empty()) {
         if (noiseFB != NULL) {
             for (uint i = 0; i < phi_rf.size(); ++i)
-                phi_rf[i][counter] +=
-                    noiseFB->fX * phi_noise[i][counter];
+                phi_rf[i].set(counter, phi_rf[i][counter] +
+                              noiseFB->fX * phi_noise[i][counter]);
         } else {
             for (uint i = 0; i < phi_rf.size(); ++i)
-                phi_rf[i][counter] += phi_noise[i][counter];
+                phi_rf[i].set(counter,
+                              phi_rf[i][counter] + phi_noise[i][counter]);
         }
     }
 
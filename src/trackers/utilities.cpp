@@ -23,39 +23,135 @@ vector<int> is_in_separatrix(const GeneralParameters *GP,
 {
     /*
     Condition for being inside the separatrix.
-    For the time being, for single RF section only or from total voltage.
-    Single RF sinusoidal.
+    For the time being, for single RF section only.
     Uses beta, energy averaged over the turn.
-    To be generalized.
     */
 
+    // vector<bool> is not thread safe!!
+    vector<int> isin(dt.size(), 1);
+    separatrix_losses(GP, RfP, Beam, dt.data(), dE.data(), isin.data(),
+                      isin.size(), total_voltage);
+    return isin;
+}
+
+
+void separatrix_losses(const GeneralParameters *GP,
+                       const RfParameters *RfP,
+                       const Beams *Beam,
+                       const double *__restrict dt,
+                       const double *__restrict dE,
+                       int *__restrict id,
+                       const int size,
+                       const f_vector_t &total_voltage)
+{
     if (GP->n_sections > 1)
         cerr << "WARNING: is_in_separatrix is not yet properly computed"
              << "for several sections!\n";
-    if (RfP->n_rf > 1)
-        cerr << "WARNING: is_in_separatrix will be calculated for"
-             << "the first harmonic only!\n";
 
     const int counter = RfP->counter;
-    const double dt_sep = (constant::pi - RfP->phi_s[counter]
-                           - RfP->phi_rf[0][counter])
-                          / RfP->omega_rf[0][counter];
+    const double h0 = RfP->harmonic[0][counter];
+    double v0;
 
-    const double Hsep = abs(hamiltonian(GP, RfP, Beam, dt_sep, 0.0));
+    if (total_voltage.empty())
+        v0 = RfP->voltage[0][counter] * GP->charge;
+    else
+        v0 = total_voltage[counter] * GP->charge;
 
-    auto temp = hamiltonian(GP, RfP, Beam, dt.data(),
-                            dE.data(), dt.size(),
-                            total_voltage);
+    // As in hamiltonian()
+    const double c1 = RfP->eta_tracking(Beam, counter, 0.0)
+                      * constant::pi * constant::c
+                      / (GP->ring_circumference * RfP->beta[counter] *
+                         RfP->energy[counter]);
+    const double c2 = constant::c * RfP->beta[counter] * v0
+                      / (h0 * GP->ring_circumference);
+    const double phi_s = RfP->phi_s[counter];
+    const double omega_rf0 = RfP->omega_rf[0][counter];
+    const double phi_rf0 = RfP->phi_rf[0][counter];
+    const double eta0 = RfP->eta_0[counter];
+    const double cos_phi_s = mymath::fast_cos(phi_s);
+    const double sin_phi_s = mymath::fast_sin(phi_s);
 
-    // vector<bool> is not thread safe!!
-    vector<int> isin(temp.size());
-    const int size = isin.size();
+    // The other RF systems, when their potential is taken: the phase of
+    // system k is ratio[k] * (phi_b - phi_rf0) + phi_rf[k], and its term of
+    // the potential weight[k] * (cos(phase) - cos(phase at phi_s))
+    const int n_rf = total_voltage.empty() ? RfP->n_rf : 1;
+    f_vector_t ratio(n_rf), weight(n_rf), phi_rf(n_rf), cos_phi_s_rf(n_rf);
+    for (int k = 1; k < n_rf; ++k) {
+        ratio[k] = RfP->omega_rf[k][counter] / omega_rf0;
+        weight[k] = RfP->voltage[k][counter] * GP->charge
+                    / (v0 * ratio[k]);
+        phi_rf[k] = RfP->phi_rf[k][counter];
+        cos_phi_s_rf[k] = mymath::fast_cos(ratio[k] * (phi_s - phi_rf0)
+                                           + phi_rf[k]);
+    }
 
-    #pragma omp parallel for
-    for (int i = 0; i < size; i++)
-        isin[i] = abs(temp[i]) < Hsep;
+    // phase_modulo_below/above_transition without a branch in the loops
+    const double period = eta0 != 0 ? 2.0 * constant::pi : 0.0;
+    const double shift = eta0 < 0 ? 0.5 : 0.0;
+    auto phase = [ = ](const double dt) {
+        const double phi = omega_rf0 * dt + phi_rf0;
+        return phi - period * std::floor(phi / (2.0 * constant::pi) + shift);
+    };
+    // The potential over c2, 0 at phi_s
+    auto potential = [&](const double phi) {
+        double u = mymath::fast_cos(phi) - cos_phi_s
+                   + (phi - phi_s) * sin_phi_s;
+        for (int k = 1; k < n_rf; ++k)
+            u += weight[k] * (mymath::fast_cos(ratio[k] * (phi - phi_rf0)
+                                               + phi_rf[k])
+                              - cos_phi_s_rf[k]);
+        return u;
+    };
+
+    // With a single RF system the particles with |H| < Hsep are inside,
+    // the separatrix passes through pi - phi_s. Otherwise the bottom of
+    // the well (H0) and the lower of the two barriers around it are looked
+    // up over the period of phases that phase() gives, and the particles
+    // with 0 <= sign * (H - H0) < Hsep are inside.
+    double H0 = 0.0;
+    double Hsep;
+    const double sign = c1 < 0 ? -1.0 : 1.0;
+    if (n_rf == 1) {
+        const double dt_sep = (constant::pi - phi_s - phi_rf0) / omega_rf0;
+        Hsep = abs(hamiltonian(GP, RfP, Beam, dt_sep, 0.0));
+    } else {
+        // [0, 2 pi) above transition, [-pi, pi) below, and no wrap at it
+        double first = phi_s - constant::pi;
+        if (eta0 > 0)
+            first = 0.0;
+        else if (eta0 < 0)
+            first = -constant::pi;
+        const int n_points = 1000;
+        f_vector_t well(n_points);
+        for (int j = 0; j < n_points; ++j) {
+            const double phi = first + 2 * constant::pi * j / (n_points - 1);
+            well[j] = sign * c2 * potential(phi);
+        }
+        const int bottom = min_element(ALL(well)) - well.begin();
+        const double left = *max_element(well.begin(),
+                                          well.begin() + bottom + 1);
+        const double right = *max_element(well.begin() + bottom, well.end());
+        H0 = sign * well[bottom];
+        Hsep = min(left, right) - well[bottom];
+    }
 
-    return isin;
+    if (n_rf == 1) {
+        #pragma omp parallel for simd
+        for (int i = 0; i < size; i++) {
+            const double phi = phase(dt[i]);
+            const double H = c1 * dE[i] * dE[i]
+                             + c2 * (mymath::fast_cos(phi) - cos_phi_s
+                                     + (phi - phi_s) * sin_phi_s);
+            id[i] = abs(H - H0) < Hsep ? id[i] : 0;
+        }
+    } else {
+        #pragma omp parallel for
+        for (int i = 0; i < size; i++) {
+            const double H = c1 * dE[i] * dE[i] + c2 * potential(phase(dt[i]));
+            const double dH = sign * (H - H0);
+            id[i] = (dH >= 0 && dH < Hsep) ? id[i] : 0;
+        }
+    }
 }
 
 
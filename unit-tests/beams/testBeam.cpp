@@ -180,6 +180,46 @@ TEST_F(testBeam, losses_energy_cut1)
     }
 }
 
+TEST_F(testBeam, mean_dE_in_window1)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 1e6, 42, false);
+    Beam->statistics();
+    const double dt_min = Beam->mean_dt - Beam->sigma_dt;
+    const double dt_max = Beam->mean_dt + 2 * Beam->sigma_dt;
+    for (int i = 0; i < N_p; i += 7)
+        Beam->id[i] = 0;
+
+    double sum = 0;
+    int n = 0;
+    for (int i = 0; i < N_p; ++i) {
+        if (Beam->id[i] && Beam->dt[i] > dt_min && Beam->dt[i] < dt_max) {
+            sum += Beam->dE[i];
+            n++;
+        }
+    }
+    ASSERT_GT(n, 0);
+    const double ref = sum / n;
+    ASSERT_NEAR(ref, Beam->mean_dE_in_window(dt_min, dt_max),
+                1e-10 * std::fabs(ref));
+
+    // The fused statistics are the same as the separate ones
+    Beam->statistics();
+    const double mean_dt = Beam->mean_dt, sigma_dE = Beam->sigma_dE;
+    const int lost = Beam->n_macroparticles_lost;
+    Beam->mean_dt = Beam->sigma_dE = 0;
+    ASSERT_NEAR(ref, Beam->mean_dE_in_window(dt_min, dt_max, true),
+                1e-10 * std::fabs(ref));
+    ASSERT_DOUBLE_EQ(mean_dt, Beam->mean_dt);
+    ASSERT_DOUBLE_EQ(sigma_dE, Beam->sigma_dE);
+    ASSERT_EQ(lost, Beam->n_macroparticles_lost);
+
+    // An empty window
+    ASSERT_EQ(0.0, Beam->mean_dE_in_window(dt_max, dt_min));
+}
 
 
 class testBeam2 : public ::testing::Test {
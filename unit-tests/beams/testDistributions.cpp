@@ -3,6 +3,7 @@
 #include <blond/input_parameters/GeneralParameters.h>
 #include <blond/math_functions.h>
 #include <blond/trackers/Tracker.h>
+#include <blond/trackers/utilities.h>
 #include <blond/utilities.h>
 #include <gtest/gtest.h>
 #include <testing_utilities.h>
@@ -349,6 +350,60 @@ TEST(testHelpers, distribution_density_function4)
 }
 
 
+TEST_F(testDistributions, longitudinal_bigaussian_threads)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+
+    const int threads = omp_get_max_threads();
+
+    omp_set_num_threads(1);
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 1e6, 42, false);
+    const f_vector_t dt = Beam->dt, dE = Beam->dE;
+
+    omp_set_num_threads(4);
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 1e6, 42, false);
+    const f_vector_t dt4 = Beam->dt, dE4 = Beam->dE;
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 1e6, 43, false);
+    const f_vector_t dt43 = Beam->dt;
+    omp_set_num_threads(threads);
+
+    ASSERT_EQ(dt, dt4);
+    ASSERT_EQ(dE, dE4);
+    ASSERT_NE(dt, dt43);
+}
+
+TEST_F(testDistributions, longitudinal_bigaussian_reinsertion)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+
+    // A bunch as high as the bucket, many particles are outside
+    const double sigma_dt = 0.2 * GP->t_rev[0], sigma_dE = 1.5e6;
+    longitudinal_bigaussian(GP, RfP, Beam, sigma_dt, sigma_dE, 1, false);
+    auto is_in = is_in_separatrix(GP, RfP, Beam, Beam->dt, Beam->dE);
+    const int n_out = count(ALL(is_in), 0);
+    ASSERT_GT(n_out, 0);
+    const f_vector_t dt = Beam->dt;
+
+    longitudinal_bigaussian(GP, RfP, Beam, sigma_dt, sigma_dE, 1, true);
+    is_in = is_in_separatrix(GP, RfP, Beam, Beam->dt, Beam->dE);
+    ASSERT_EQ(N_p, count(ALL(is_in), 1));
+
+    // The particles inside are kept
+    int kept = 0;
+    for (int i = 0; i < N_p; ++i)
+        kept += (dt[i] == Beam->dt[i]);
+    ASSERT_EQ(N_p - n_out, kept);
+
+    // A bunch much larger than the bucket never fits in it
+    ASSERT_DEATH(longitudinal_bigaussian(GP, RfP, Beam, sigma_dt,
+                                         1e3 * sigma_dE, 1, true),
+                 "reinsertion passes");
+}
+
 TEST_F(testDistributions, matched_from_line_density1)
 {
     auto RfP = Context::RfP;
@@ -390,6 +445,10 @@ TEST_F(testDistributions, matched_from_line_density1)
     auto ret = matched_from_line_density(Beam, fullRing, line_density_opt,
                                          FullRingAndRf::lowest_freq, totVolt);
 
+    // The impedances are given back their slices
+    ASSERT_EQ(Slice, totVolt->fSlices);
+    ASSERT_EQ(Slice, indVoltTime->fSlices);
+
     util::read_vector_from_file(v, params + "hamiltonian_coord.txt");
     ASSERT_NEAR_LOOP(v, ret.hamiltonian_coord, "hamiltonian_coord", epsilon);
 
@@ -887,6 +946,42 @@ TEST_F(testDistributions, matched_from_distribution_density5)
     delete fullRing;
 }
 
+TEST_F(testDistributions, matched_from_distribution_density_grid)
+{
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    auto long_tracker = new RingAndRfSection(RfP);
+    auto fullRing = new FullRingAndRf({long_tracker});
+
+    map<string, multi_t> distribution_opt;
+    distribution_opt["type"] = {"gaussian"};
+    distribution_opt["bunch_length"] = {250e-9};
+    distribution_opt["density_variable"] = {"density_from_J"};
+
+    auto ret = matched_from_distribution_density(
+                   Beam, fullRing, distribution_opt,
+                   FullRingAndRf::lowest_freq, nullptr,
+                   map<string, f_vector_t>(), 1, 0, 1000);
+    const double sigma_dt = 250e-9 / 4;
+    const double sigma_dE = standard_deviation(Beam->dE);
+    ASSERT_NEAR(sigma_dt, standard_deviation(Beam->dt), 0.05 * sigma_dt);
+
+    // A coarser grid gives about the same bunch
+    ret = matched_from_distribution_density(
+              Beam, fullRing, distribution_opt,
+              FullRingAndRf::lowest_freq, nullptr,
+              map<string, f_vector_t>(), 1, 0, 300);
+
+    ASSERT_EQ(300u, ret.time_coord_low_res.size());
+    ASSERT_EQ(300u, ret.line_density.size());
+    ASSERT_NEAR(Beam->n_macroparticles, sum(ret.line_density), 1e-6);
+    ASSERT_NEAR(sigma_dt, standard_deviation(Beam->dt), 0.05 * sigma_dt);
+    ASSERT_NEAR(sigma_dE, standard_deviation(Beam->dE), 0.1 * sigma_dE);
+
+    delete long_tracker;
+    delete fullRing;
+}
+
 // FIXME there is an issue in this testcase
 TEST_F(testDistributions, DISABLED_matched_from_distribution_density6)
 {
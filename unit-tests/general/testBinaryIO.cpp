@@ -0,0 +1,78 @@
+#include <blond/binary_io.h>
+#include <blond/configuration.h>
+#include <blond/openmp.h>
+#include <blond/utilities.h>
+#include <cstdio>
+#include <gtest/gtest.h>
+
+class testBinaryIO : public ::testing::Test {
+protected:
+    const std::string text_file = "testBinaryIO.txt";
+    const std::string binary_file = "testBinaryIO.bin";
+
+    virtual void SetUp()
+    {
+        // Enough lines for several parts, with a few odd ones
+        std::ofstream out(text_file);
+        out.precision(17);
+        for (int i = 0; i < 100000; ++i) {
+            out << 1e-9 * i << " " << -3.5e6 / (i + 1) << " " << i << "\n";
+            if (i % 9999 == 0)
+                out << "\n  \t\n# not a number " << i << "\n";
+            if (i % 31337 == 0)
+                out << 0.1 * i << " junk " << i << "\n";
+        }
+    }
+
+    virtual void TearDown()
+    {
+        std::remove(text_file.c_str());
+        std::remove(binary_file.c_str());
+    }
+};
+
+TEST_F(testBinaryIO, parallel_text)
+{
+    f_vector_t ref;
+    util::read_vector_from_file(ref, text_file);
+
+    for (int threads : {1, 3, 8}) {
+        omp_set_num_threads(threads);
+        f_vector_t v;
+        binary_io::read_text(v, text_file);
+        ASSERT_EQ(ref, v) << threads << " threads";
+    }
+}
+
+TEST_F(testBinaryIO, convert_and_map)
+{
+    f_vector_t ref;
+    util::read_vector_from_file(ref, text_file);
+
+    ASSERT_FALSE(binary_io::is_binary(text_file));
+    ASSERT_TRUE(binary_io::convert(text_file, binary_file, 3));
+    ASSERT_TRUE(binary_io::is_binary(binary_file));
+
+    binary_io::MappedVector map(binary_file);
+    ASSERT_EQ(ref.size(), map.size());
+    ASSERT_EQ(3u, map.columns());
+    for (uint i = 0; i < ref.size(); ++i)
+        ASSERT_EQ(ref[i], map[i]);
+
+    // The view moves with its mapping
+    binary_io::MappedVector moved(std::move(map));
+    ASSERT_EQ(0u, map.size());
+    ASSERT_EQ(ref, moved.vector());
+
+    f_vector_t v;
+    binary_io::read(v, binary_file);
+    ASSERT_EQ(ref, v);
+    binary_io::read(v, text_file);
+    ASSERT_EQ(ref, v);
+}
+
+int main(int ac, char *av[])
+{
+    ::testing::InitGoogleTest(&ac, av);
+    return RUN_ALL_TESTS();
+}
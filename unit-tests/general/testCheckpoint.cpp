@@ -0,0 +1,192 @@
+#include <blond/beams/Distributions.h>
+#include <blond/checkpoint.h>
+#include <blond/globals.h>
+#include <blond/impedances/InducedVoltage.h>
+#include <blond/llrf/PhaseLoop.h>
+#include <blond/math_functions.h>
+#include <blond/monitors/Monitors.h>
+#include <blond/trackers/Tracker.h>
+#include <blond/utilities.h>
+#include <cstdio>
+#include <gtest/gtest.h>
+
+// Machine and RF parameters
+const double C = 26658.883;                   // Machine circumference [m]
+const double p_i = 450e9;                     // Synchronous momentum [eV/c]
+const long long h = 35640;                   // Harmonic number
+const double V = 6e6;                         // RF voltage [V]
+const double gamma_t = 55.759505;             // Transition gamma
+const double alpha = 1.0 / gamma_t / gamma_t; // First order mom. comp. factor
+const int alpha_order = 1;
+const int n_sections = 1;
+
+class testCheckpoint : public ::testing::Test {
+protected:
+    const std::string file = "testCheckpoint.ckp";
+    const std::string phaseSpaceFile = "testCheckpoint.h5";
+    unsigned N_t = 200;      // Number of turns to track
+    unsigned N_p = 10000;    // Macro-particles
+    unsigned N_slices = 100;
+    const long long N_b = 1e9;
+    const double tau_0 = 0.4e-9;
+
+    LHC *PL;
+    RingAndRfSection *long_tracker;
+    Resonators *resonator;
+    InducedVoltageFreq *indVoltFreq;
+    TotalInducedVoltage *totVol;
+
+    virtual void SetUp()
+    {
+        omp_set_num_threads(2);
+
+        f_vector_2d_t momentumVec(n_sections, f_vector_t(N_t + 1));
+        mymath::linspace(momentumVec[0].data(), p_i, 1.001 * p_i, N_t + 1);
+        f_vector_2d_t alphaVec(n_sections, f_vector_t(alpha_order + 1, alpha));
+        f_vector_t CVec(n_sections, C);
+        f_vector_2d_t hVec(n_sections, f_vector_t(N_t + 1, h));
+        f_vector_2d_t voltageVec(n_sections, f_vector_t(N_t + 1, V));
+        f_vector_2d_t dphiVec(n_sections, f_vector_t(N_t + 1, 0));
+
+        auto GP = Context::GP = new GeneralParameters(
+            N_t, CVec, alphaVec, alpha_order, momentumVec,
+            GeneralParameters::particle_t::proton);
+        auto Beam = Context::Beam = new Beams(GP, N_p, N_b);
+        auto RfP = Context::RfP = new RfParameters(GP, n_sections, hVec,
+                                                   voltageVec, dphiVec);
+
+        longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+        Context::Slice = new Slices(RfP, Beam, N_slices);
+
+        // A wake that lasts over several turns, with a short revolution
+        // period so that the memory window stays small
+        const uint nTurnsMem = 3;
+        const double dt = Context::Slice->bin_centers[1]
+                          - Context::Slice->bin_centers[0];
+        f_vector_t R_shunt = {1e7}, f_res = {1e9}, Q_factor = {1e4};
+        resonator = new Resonators(R_shunt, f_res, Q_factor);
+        indVoltFreq = new InducedVoltageFreq(Context::Slice, {resonator}, 0,
+                                             InducedVoltageFreq::round_option,
+                                             nTurnsMem);
+        totVol = new TotalInducedVoltage(Beam, Context::Slice, {indVoltFreq},
+                                         nTurnsMem,
+                                         f_vector_t(N_t + 1,
+                                                 1.5 * N_slices * dt));
+
+        const double PL_gain = 1 / (5 * GP->t_rev[0]);
+        PL = new LHC(f_vector_t(N_t + 1, PL_gain), PL_gain / 10);
+        PL->reference = 0.1;
+        long_tracker = new RingAndRfSection(RfP, Beam,
+                                            RingAndRfSection::simple, PL);
+    }
+
+    virtual void TearDown()
+    {
+        destroy();
+        std::remove(file.c_str());
+        std::remove(phaseSpaceFile.c_str());
+    }
+
+    void destroy()
+    {
+        delete long_tracker;
+        delete totVol;
+        delete indVoltFreq;
+        delete resonator;
+        delete PL;
+        delete Context::Slice;
+        delete Context::RfP;
+        delete Context::Beam;
+        delete Context::GP;
+    }
+
+    void track(const uint turns)
+    {
+        for (uint i = 0; i < turns; ++i) {
+            Context::Slice->track();
+            totVol->track(Context::Beam);
+            long_tracker->track();
+        }
+    }
+};
+
+TEST_F(testCheckpoint, save_and_restore)
+{
+    auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
+    PhaseSpaceMonitor phaseSpace(Context::GP, RfP, Beam, phaseSpaceFile, 5);
+    Checkpoint checkpoint(file, 0, RfP, Beam, Context::Slice, PL, NULL, NULL,
+                          NULL, totVol, &phaseSpace);
+
+    ASSERT_FALSE(checkpoint.restore());
+    track(10);
+    phaseSpace.track();
+    ASSERT_TRUE(checkpoint.save());
+
+    const f_vector_t dt = Beam->dt, dE = Beam->dE;
+    const f_vector_t phi_rf = RfP->phi_rf[0].vector();
+    const f_vector_t profile = Context::Slice->n_macroparticles;
+    const double lhc_y = PL->lhc_y, dphi = PL->dphi;
+    const f_vector_t memory = totVol->fInducedVoltageMem;
+
+    track(5);
+    phaseSpace.track();
+    ASSERT_NE(dt, Beam->dt);
+    ASSERT_NE(memory, totVol->fInducedVoltageMem);
+    ASSERT_EQ(15, phaseSpace.fLastTurn);
+    Beam->dE.resize(1);
+
+    ASSERT_TRUE(checkpoint.restore());
+    ASSERT_EQ(10, RfP->counter);
+    ASSERT_EQ(dt, Beam->dt);
+    ASSERT_EQ(dE, Beam->dE);
+    ASSERT_EQ(phi_rf, RfP->phi_rf[0].vector());
+    ASSERT_EQ(profile, Context::Slice->n_macroparticles);
+    ASSERT_EQ(lhc_y, PL->lhc_y);
+    ASSERT_EQ(dphi, PL->dphi);
+    ASSERT_EQ(10u, totVol->fCounterTurn);
+    ASSERT_EQ(memory, totVol->fInducedVoltageMem);
+    ASSERT_EQ(10, phaseSpace.fLastTurn);
+    phaseSpace.close();
+}
+
+TEST_F(testCheckpoint, restart)
+{
+    // Snapshots of turns 50 and 100, then on to the end. The induced
+    // voltage keeps the wakes of the previous turns.
+    {
+        Checkpoint checkpoint(file, 50, Context::RfP, Context::Beam,
+                              Context::Slice, PL, NULL, NULL, NULL, totVol);
+        for (uint i = 0; i < 120; ++i) {
+            Context::Slice->track();
+            totVol->track(Context::Beam);
+            long_tracker->track();
+            checkpoint.track();
+        }
+    }
+    track(N_t - 120);
+    const f_vector_t dt = Context::Beam->dt, dE = Context::Beam->dE;
+    const f_vector_t omega_rf = Context::RfP->omega_rf[0].vector();
+    const double domega_rf = PL->domega_rf;
+
+    // A new run, from the last snapshot
+    destroy();
+    SetUp();
+    Checkpoint checkpoint(file, 0, Context::RfP, Context::Beam,
+                          Context::Slice, PL, NULL, NULL, NULL, totVol);
+    ASSERT_TRUE(checkpoint.restore());
+    ASSERT_EQ(100, Context::RfP->counter);
+    ASSERT_EQ(100u, totVol->fCounterTurn);
+    track(N_t - 100);
+
+    ASSERT_EQ(dt, Context::Beam->dt);
+    ASSERT_EQ(dE, Context::Beam->dE);
+    ASSERT_EQ(omega_rf, Context::RfP->omega_rf[0].vector());
+    ASSERT_EQ(domega_rf, PL->domega_rf);
+}
+
+int main(int ac, char *av[])
+{
+    ::testing::InitGoogleTest(&ac, av);
+    return RUN_ALL_TESTS();
+}
@@ -1,4 +1,8 @@
+#include <atomic>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <thread>
 
 #include <blond/configuration.h>
 #include <blond/fft.h>
@@ -423,6 +427,407 @@ TEST(testRFFTFREQ, odd_spacing) {
     }
 }
 
+TEST(testConvolution, methods) {
+    // Every method must give the same result as the direct convolution
+    f_vector_t signal(1000), kernel(30), ref, res;
+    for (uint i = 0; i < signal.size(); ++i)
+        signal[i] = std::sin(0.1 * i) + 0.01 * i;
+    for (uint i = 0; i < kernel.size(); ++i)
+        kernel[i] = std::exp(-0.1 * i) * std::cos(0.5 * i);
+
+    ref.resize(signal.size() + kernel.size() - 1);
+    mymath::convolution(signal.data(), signal.size(), kernel.data(),
+                        kernel.size(), ref.data());
+
+    double max = *max_element(ref.begin(), ref.end(), [](double i, double j) {
+        return fabs(i) < fabs(j);
+    });
+    double epsilon = 1e-10 * fabs(max);
+
+    for (auto method : {fft::Convolution::direct_method,
+                        fft::Convolution::fft_method,
+                        fft::Convolution::overlap_save_method,
+                        fft::Convolution::auto_method}) {
+        fft::Convolution conv(kernel, method);
+        // Twice, the second time with the cached kernel spectrum
+        for (int turn = 0; turn < 2; ++turn) {
+            conv.convolve(signal, res);
+            ASSERT_EQ(ref.size(), res.size());
+            for (unsigned int i = 0; i < ref.size(); ++i) {
+                ASSERT_NEAR(ref[i], res[i], epsilon)
+                    << "Testing of convolution method " << method
+                    << " failed on i " << i << std::endl;
+            }
+        }
+    }
+    fft::destroy_plans();
+}
+
+TEST(testConvolution, select) {
+    f_vector_t shortKernel(4, 1.0), longKernel(4000, 1.0);
+
+    fft::Convolution conv1(shortKernel);
+    ASSERT_EQ(fft::Convolution::direct_method, conv1.select(100));
+
+    fft::Convolution conv2(longKernel);
+    ASSERT_EQ(fft::Convolution::fft_method, conv2.select(4000));
+
+    fft::Convolution conv3(f_vector_t(200, 1.0));
+    ASSERT_EQ(fft::Convolution::overlap_save_method, conv3.select(1000000));
+}
+
+TEST(testConvolution, empty) {
+    // An empty signal or kernel gives an empty result
+    f_vector_t signal(100, 1.0), res(5, 1.0);
+    fft::Convolution conv;
+    ASSERT_EQ(fft::Convolution::direct_method, conv.select(100));
+    conv.convolve(signal, res);
+    ASSERT_TRUE(res.empty());
+
+    fft::Convolution conv2(f_vector_t(3, 1.0));
+    res.assign(5, 1.0);
+    conv2.convolve(f_vector_t(), res);
+    ASSERT_TRUE(res.empty());
+
+    // A single point kernel, the overlap-save blocks start at 2 points
+    fft::Convolution conv3(f_vector_t(1, 2.0), fft::Convolution::auto_method);
+    conv3.select(100000);
+    conv3.convolve(signal, res);
+    ASSERT_EQ(signal.size(), res.size());
+    for (uint i = 0; i < res.size(); ++i)
+        ASSERT_NEAR(2.0, res[i], 1e-12);
+    fft::destroy_plans();
+}
+
+TEST(testPlanRegistry, sharing) {
+    auto &registry = fft::PlanRegistry::instance();
+    fft::destroy_plans();
+    ASSERT_EQ(0u, registry.size());
+
+    // Concurrent requests of the same plan create it only once
+    const int threads = omp_get_max_threads();
+    std::vector<fftw_plan> plans(threads);
+    #pragma omp parallel
+    {
+        auto plan = registry.get(64, fft::RFFT, 1, fft::FFTW_FLAGS);
+        plans[omp_get_thread_num()] = plan.p;
+    }
+    for (int i = 1; i < threads; ++i)
+        ASSERT_EQ(plans[0], plans[i]);
+    ASSERT_EQ(1u, registry.size());
+
+    // The flags and the threads are part of the key
+    registry.get(64, fft::RFFT, 1, FFTW_ESTIMATE);
+    registry.get(64, fft::RFFT, 2, fft::FFTW_FLAGS);
+    ASSERT_EQ(3u, registry.size());
+
+    // A plan that is held keeps its buffers after the cache is cleared
+    auto plan = registry.get(64, fft::RFFT, 1, fft::FFTW_FLAGS);
+    fft::destroy_plans();
+    ASSERT_EQ(0u, registry.size());
+    ASSERT_EQ(1, plan.in.use_count());
+    static_cast<double *>(plan.in.get())[63] = 1.0;
+}
+
+TEST(testPlanRegistry, thread_slots) {
+    fft::destroy_plans();
+
+    // Every thread of a parallel region gets its own plans, so the
+    // transforms can run concurrently
+    const int threads = omp_get_max_threads();
+    const uint n = 90;
+    std::vector<f_vector_t> results(threads);
+    std::vector<void *> buffers(threads);
+    #pragma omp parallel
+    {
+        const int id = omp_get_thread_num();
+        buffers[id] = fft::find_plan(n, fft::IRFFT, 1).in.get();
+        for (int rep = 0; rep < 20; ++rep) {
+            f_vector_t in(n);
+            for (uint i = 0; i < n; ++i)
+                in[i] = std::cos(0.1 * i * (id + 1));
+            complex_vector_t out;
+            fft::rfft(in, out);
+            fft::irfft(out, results[id]);
+            for (uint i = 0; i < n; ++i)
+                EXPECT_NEAR(in[i], results[id][i], 1e-12);
+        }
+    }
+    for (int i = 1; i < threads; ++i)
+        ASSERT_NE(buffers[0], buffers[i]);
+
+    fft::destroy_plans();
+}
+
+TEST(testPlanRegistry, std_thread_slots) {
+    fft::destroy_plans();
+
+    // Threads that are not openmp's get their own plans too. They all
+    // stay alive until the last one is done, an exited thread gives its
+    // slot back.
+    const int threads = 4;
+    const uint n = 90;
+    std::vector<uint> slots(threads);
+    std::vector<void *> buffers(threads);
+    std::vector<double> errors(threads, 0.0);
+    std::vector<std::thread> pool;
+    std::atomic<int> done(0);
+    for (int id = 0; id < threads; ++id)
+        pool.push_back(std::thread([&, id]() {
+            slots[id] = fft::plan_slot();
+            buffers[id] = fft::find_plan(n, fft::IRFFT, 1).in.get();
+            for (int rep = 0; rep < 20; ++rep) {
+                f_vector_t in(n), res;
+                for (uint i = 0; i < n; ++i)
+                    in[i] = std::cos(0.1 * i * (id + 1));
+                complex_vector_t out;
+                fft::rfft(in, out);
+                fft::irfft(out, res);
+                for (uint i = 0; i < n; ++i)
+                    errors[id] = std::max(errors[id],
+                                          std::abs(in[i] - res[i]));
+            }
+            ++done;
+            while (done < threads)
+                std::this_thread::yield();
+        }));
+    for (auto &t : pool)
+        t.join();
+    for (int i = 0; i < threads; ++i) {
+        ASSERT_LT(errors[i], 1e-12);
+        for (int j = 0; j < i; ++j) {
+            ASSERT_NE(slots[j], slots[i]);
+            ASSERT_NE(buffers[j], buffers[i]);
+        }
+    }
+
+    fft::destroy_plans();
+}
+
+TEST(testPlanRegistry, released_slots) {
+    auto &registry = fft::PlanRegistry::instance();
+    fft::destroy_plans();
+
+    // Threads that exit give their slot and their plans back, the next
+    // threads reuse the slot
+    const uint n = 90;
+    std::vector<uint> slots;
+    for (int rep = 0; rep < 5; ++rep) {
+        std::thread t([&]() {
+            slots.push_back(fft::plan_slot());
+            fft::find_plan(n, fft::RFFT, 1);
+            fft::find_plan<float>(n, fft::IRFFT, 1);
+            ASSERT_EQ(2u, registry.size());
+        });
+        t.join();
+        ASSERT_EQ(0u, registry.size());
+    }
+    for (uint i = 1; i < slots.size(); ++i)
+        ASSERT_EQ(slots[0], slots[i]);
+
+    fft::destroy_plans();
+}
+
+TEST(testPlanRegistry, wisdom) {
+    auto &registry = fft::PlanRegistry::instance();
+    const std::string file = "fft_wisdom_test";
+    std::remove(file.c_str());
+    fft::destroy_plans();
+    fftw_forget_wisdom();
+
+    // A measured plan exports the wisdom of its size
+    registry.set_wisdom_file(file);
+    registry.get(96, fft::RFFT, 1, FFTW_MEASURE);
+    fft::destroy_plans();
+    fftw_forget_wisdom();
+
+    // Without the wisdom, the plan can not be made without measuring
+    auto plan = registry.get(96, fft::RFFT, 1,
+                             FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    ASSERT_TRUE(plan.p == NULL);
+    ASSERT_EQ(0u, registry.size());
+
+    // Once imported, it is made from the wisdom
+    ASSERT_TRUE(registry.set_wisdom_file(file));
+    plan = registry.get(96, fft::RFFT, 1, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    ASSERT_TRUE(plan.p != NULL);
+
+    fft::destroy_plans();
+    registry.set_wisdom_file("");
+    std::remove(file.c_str());
+}
+
+TEST(testFFTView, rfft_irfft) {
+    // The array versions must match the vector versions, and the scaling
+    // must be applied in the same pass
+    const uint n = 96;
+    f_vector_t in(n), back(n), ref;
+    for (uint i = 0; i < n; ++i)
+        in[i] = std::sin(0.2 * i) + 0.1 * i;
+    const f_vector_t orig = in;
+
+    complex_vector_t out(n / 2 + 1), refOut;
+    fft::rfft(in.data(), out.data(), n, 1, 2.0);
+    fft::rfft(in, refOut);
+
+    // The input is preserved
+    for (uint i = 0; i < n; ++i)
+        ASSERT_DOUBLE_EQ(orig[i], in[i]);
+
+    for (uint i = 0; i < out.size(); ++i) {
+        ASSERT_NEAR(2.0 * refOut[i].real(), out[i].real(), 1e-10);
+        ASSERT_NEAR(2.0 * refOut[i].imag(), out[i].imag(), 1e-10);
+    }
+
+    fft::irfft(out.data(), back.data(), n, 1, 0.5);
+    for (uint i = 0; i < n; ++i)
+        ASSERT_NEAR(orig[i], back[i], 1e-10) << "failed on i " << i;
+
+    // Misaligned arrays go through the plan buffers
+    f_vector_t shifted(n + 1);
+    std::copy(orig.begin(), orig.end(), shifted.begin() + 1);
+    complex_vector_t out2(n / 2 + 2);
+    fft::rfft(&shifted[1], &out2[0], n);
+    for (uint i = 0; i < refOut.size(); ++i) {
+        ASSERT_NEAR(refOut[i].real(), out2[i].real(), 1e-10);
+        ASSERT_NEAR(refOut[i].imag(), out2[i].imag(), 1e-10);
+    }
+    fft::destroy_plans();
+}
+
+TEST(testFFTView, fft_ifft) {
+    const uint n = 30;
+    complex_vector_t in(n), out(n), back(n);
+    for (uint i = 0; i < n; ++i)
+        in[i] = complex_t(std::cos(0.3 * i), std::sin(0.7 * i));
+
+    fft::fft(in.data(), out.data(), n);
+    fft::ifft(out.data(), back.data(), n);
+    for (uint i = 0; i < n; ++i) {
+        ASSERT_NEAR(in[i].real(), back[i].real(), 1e-10);
+        ASSERT_NEAR(in[i].imag(), back[i].imag(), 1e-10);
+    }
+    fft::destroy_plans();
+}
+
+TEST(testFFTSingle, rfft_irfft) {
+    // The float transforms must match the double ones to float accuracy
+    const uint n = 120;
+    f_vector_t in(n), back;
+    std::vector<float> inF(n), backF;
+    for (uint i = 0; i < n; ++i) {
+        in[i] = std::sin(0.2 * i) + 0.1 * i;
+        inF[i] = in[i];
+    }
+
+    complex_vector_t out;
+    std::vector<std::complex<float>> outF;
+    fft::rfft(in, out);
+    fft::rfft(inF, outF);
+
+    ASSERT_EQ(out.size(), outF.size());
+    const double epsilon = 1e-5 * std::abs(out[0]);
+    for (uint i = 0; i < out.size(); ++i) {
+        ASSERT_NEAR(out[i].real(), outF[i].real(), epsilon);
+        ASSERT_NEAR(out[i].imag(), outF[i].imag(), epsilon);
+    }
+
+    fft::irfft(outF, backF);
+    ASSERT_EQ(n, backF.size());
+    for (uint i = 0; i < n; ++i)
+        ASSERT_NEAR(in[i], backF[i], 1e-4) << "failed on i " << i;
+
+    // The single precision plans are kept apart from the double ones
+    auto &registry = fft::PlanRegistry::instance();
+    fft::destroy_plans();
+    registry.get<double>(n, fft::RFFT, 1, fft::FFTW_FLAGS);
+    registry.get<float>(n, fft::RFFT, 1, fft::FFTW_FLAGS);
+    ASSERT_EQ(2u, registry.size());
+    fft::destroy_plans();
+}
+
+TEST(testConvolution, single_precision) {
+    f_vector_t signal(1000), kernel(300), ref, res;
+    for (uint i = 0; i < signal.size(); ++i)
+        signal[i] = std::sin(0.1 * i) + 0.01 * i;
+    for (uint i = 0; i < kernel.size(); ++i)
+        kernel[i] = std::exp(-0.01 * i) * std::cos(0.5 * i);
+
+    ref.resize(signal.size() + kernel.size() - 1);
+    mymath::convolution(signal.data(), signal.size(), kernel.data(),
+                        kernel.size(), ref.data());
+
+    double max = *max_element(ref.begin(), ref.end(), [](double i, double j) {
+        return fabs(i) < fabs(j);
+    });
+    double epsilon = 1e-5 * fabs(max);
+
+    for (auto method : {fft::Convolution::fft_method,
+                        fft::Convolution::overlap_save_method}) {
+        fft::Convolution conv(kernel, method, fft::single_precision);
+        conv.convolve(signal, res);
+        ASSERT_EQ(ref.size(), res.size());
+        for (unsigned int i = 0; i < ref.size(); ++i) {
+            ASSERT_NEAR(ref[i], res[i], epsilon)
+                << "Testing of convolution method " << method
+                << " failed on i " << i << std::endl;
+        }
+    }
+    fft::destroy_plans();
+}
+
+TEST(testSizeSelector, policies) {
+    auto &selector = fft::SizeSelector::instance();
+    const auto policy = selector.policy();
+
+    fft::set_size_policy(fft::smallest_235);
+    for (uint target = 1; target < 5000; target += 13)
+        ASSERT_EQ(mymath::next_regular(target), fft::good_size(target));
+
+    // 7 and 11 give shorter lengths
+    fft::set_size_policy(fft::smallest_fftw);
+    ASSERT_EQ(49u, fft::good_size(48));
+    ASSERT_EQ(77u, fft::good_size(75));
+    ASSERT_EQ(1008u, fft::good_size(1000));
+    // Only one factor of 11, 847 = 7 * 11 * 11 is skipped
+    ASSERT_EQ(864u, fft::good_size(846));
+
+    // The fastest length is a candidate up to the next power of two,
+    // and stays the same once chosen
+    fft::set_size_policy(fft::fastest);
+    const uint n = fft::good_size(1000);
+    ASSERT_GT(n, 1000u);
+    ASSERT_LE(n, 1024u);
+    ASSERT_EQ(n, fft::good_size(1000));
+    ASSERT_GT(selector.timing(n), 0.0);
+
+    fft::set_size_policy(policy);
+    fft::destroy_plans();
+}
+
+TEST(testSizeSelector, timings_file) {
+    auto &selector = fft::SizeSelector::instance();
+    const std::string file = "testFFT_timings.txt";
+    std::remove(file.c_str());
+
+    ASSERT_FALSE(selector.set_timings_file(file));
+    selector.timing(96);
+    ASSERT_TRUE(selector.export_timings());
+
+    // The file is read back
+    ASSERT_TRUE(selector.set_timings_file(file));
+    std::ifstream in(file);
+    uint n;
+    double seconds;
+    bool found = false;
+    while (in >> n >> seconds)
+        found |= (n == 96 && seconds > 0.0);
+    ASSERT_TRUE(found);
+
+    std::remove(file.c_str());
+    fft::destroy_plans();
+}
+
 int main(int ac, char* av[]) {
     ::testing::InitGoogleTest(&ac, av);
     return RUN_ALL_TESTS();
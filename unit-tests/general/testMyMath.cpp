@@ -328,6 +328,51 @@ TEST(testConvolution, test3)
     v.clear();
 }
 
+TEST(testNextRegular, table)
+{
+    // The table lookup must give the same numbers as the generator
+    for (uint target = 0; target < 20000; target += 7) {
+        uint ref = 0;
+        for (auto i : mymath::Ham({2, 3, 5})) {
+            if (i > target) {
+                ref = i;
+                break;
+            }
+        }
+        ASSERT_EQ(ref, mymath::next_regular(target))
+                << "failed on target " << target;
+    }
+    ASSERT_EQ(9u, mymath::next_regular(8));
+    ASSERT_EQ(0u, mymath::next_regular(std::numeric_limits<int>::max()));
+}
+
+TEST(testConvolution, tiles)
+{
+    // Lengths around the tile width, and kernels longer than the signal
+    std::vector<std::pair<int, int>> lengths = {{1, 1}, {3, 5}, {8, 8},
+        {9, 7}, {17, 100}, {100, 17}, {255, 256}, {1000, 3}
+    };
+
+    for (const auto &l : lengths) {
+        f_vector_t a(l.first), b(l.second);
+        for (uint i = 0; i < a.size(); ++i) a[i] = std::sin(i + 1.0);
+        for (uint i = 0; i < b.size(); ++i) b[i] = std::cos(0.3 * i);
+
+        f_vector_t c(a.size() + b.size() - 1);
+        convolution(a.data(), a.size(), b.data(), b.size(), c.data());
+
+        for (int n = 0; n < (int) c.size(); ++n) {
+            double ref = 0.0;
+            for (int k = 0; k < (int) a.size(); ++k)
+                if (n - k >= 0 && n - k < (int) b.size())
+                    ref += a[k] * b[n - k];
+            ASSERT_NEAR(ref, c[n], 1e-12 * std::max(1.0, std::abs(ref)))
+                    << "Testing of convolution failed for lengths "
+                    << l.first << ", " << l.second << " on n " << n << std::endl;
+        }
+    }
+}
+
 TEST(arange, test1)
 {
     std::string params = TEST_FILES "/MyMath/arange/";
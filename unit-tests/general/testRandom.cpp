@@ -0,0 +1,111 @@
+#include <blond/configuration.h>
+#include <blond/math_functions.h>
+#include <blond/random.h>
+#include <gtest/gtest.h>
+
+TEST(testPhilox, known_answers)
+{
+    // Known answer vectors of the Random123 library
+    uint32_t ctr1[4] = {0, 0, 0, 0};
+    uint32_t key1[2] = {0, 0};
+    rng::philox4x32(ctr1, key1);
+    ASSERT_EQ(0x6627e8d5u, ctr1[0]);
+    ASSERT_EQ(0xe169c58du, ctr1[1]);
+    ASSERT_EQ(0xbc57ac4cu, ctr1[2]);
+    ASSERT_EQ(0x9b00dbd8u, ctr1[3]);
+
+    uint32_t ctr2[4] = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+    uint32_t key2[2] = {0xffffffff, 0xffffffff};
+    rng::philox4x32(ctr2, key2);
+    ASSERT_EQ(0x408f276du, ctr2[0]);
+    ASSERT_EQ(0x41c83b0eu, ctr2[1]);
+    ASSERT_EQ(0xa20bc7c6u, ctr2[2]);
+    ASSERT_EQ(0x6d5451fdu, ctr2[3]);
+
+    uint32_t ctr3[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+    uint32_t key3[2] = {0xa4093822, 0x299f31d0};
+    rng::philox4x32(ctr3, key3);
+    ASSERT_EQ(0xd16cfe09u, ctr3[0]);
+    ASSERT_EQ(0x94fdccebu, ctr3[1]);
+    ASSERT_EQ(0x5001e420u, ctr3[2]);
+    ASSERT_EQ(0x24126ea1u, ctr3[3]);
+}
+
+TEST(testCounterRNG, thread_independence)
+{
+    // The batches do not depend on the number of threads
+    const uint n = 10001;
+    rng::CounterRNG gen(1234);
+    f_vector_t u1(n), u4(n), g1(n), g4(n);
+
+    const int threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    gen.uniform(u1.data(), n);
+    gen.normal(g1.data(), n);
+    omp_set_num_threads(4);
+    gen.uniform(u4.data(), n);
+    gen.normal(g4.data(), n);
+    omp_set_num_threads(threads);
+
+    for (uint i = 0; i < n; ++i) {
+        ASSERT_EQ(u1[i], u4[i]);
+        ASSERT_EQ(g1[i], g4[i]);
+        ASSERT_EQ(gen.uniform(i), u1[i]);
+    }
+
+    // A batch can start anywhere in the sequence, also inside a pair
+    for (uint start : {5000u, 4999u, 127u, 128u}) {
+        f_vector_t part(101);
+        gen.normal(part.data(), part.size(), start);
+        for (uint i = 0; i < part.size(); ++i)
+            ASSERT_EQ(g1[start + i], part[i]);
+    }
+
+    // Both numbers of a pair, as normal2() up to the last bits
+    for (uint i = 0; i < n; ++i)
+        ASSERT_NEAR(gen.normal(i), g1[i], 1e-12 * (1 + std::abs(g1[i])));
+}
+
+TEST(testCounterRNG, streams)
+{
+    rng::CounterRNG a(42), b(42), c(43);
+    auto s = a.substream(1);
+    ASSERT_EQ(a.uniform(7), b.uniform(7));
+    ASSERT_NE(a.uniform(7), c.uniform(7));
+    ASSERT_NE(a.uniform(7), s.uniform(7));
+    ASSERT_EQ(s.uniform(7), rng::CounterRNG(42, 1).uniform(7));
+}
+
+TEST(testCounterRNG, moments)
+{
+    const uint n = 1000000;
+    rng::CounterRNG gen(7);
+    f_vector_t u(n), g(n);
+    gen.uniform(u.data(), n, 0, -1.0, 3.0);
+    gen.normal(g.data(), n, 0, 2.0, 0.5);
+
+    auto minmax = std::minmax_element(u.begin(), u.end());
+    ASSERT_GT(*minmax.first, -1.0);
+    ASSERT_LE(*minmax.second, 3.0);
+    ASSERT_NEAR(1.0, mymath::mean(u.data(), n), 0.01);
+    ASSERT_NEAR(4.0 / std::sqrt(12.0),
+                mymath::standard_deviation(u.data(), n), 0.01);
+
+    ASSERT_NEAR(2.0, mymath::mean(g.data(), n), 0.005);
+    ASSERT_NEAR(0.5, mymath::standard_deviation(g.data(), n), 0.005);
+
+    // The two numbers of a pair are uncorrelated
+    double sum = 0;
+    for (uint i = 0; i < n; ++i) {
+        double n1, n2;
+        gen.normal2(i, n1, n2);
+        sum += n1 * n2;
+    }
+    ASSERT_NEAR(0.0, sum / n, 0.005);
+}
+
+int main(int ac, char *av[])
+{
+    ::testing::InitGoogleTest(&ac, av);
+    return RUN_ALL_TESTS();
+}
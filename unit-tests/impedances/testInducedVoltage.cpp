@@ -296,6 +296,45 @@ TEST_F(testInducedVoltage, generation2)
 }
 
 
+TEST_F(testInducedVoltage, generation_single1)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+
+    slices->track();
+    // Float accuracy, relative to the peak voltage
+    auto epsilon = 1e-5;
+
+    auto indVoltTime = new InducedVoltageTime(slices, {resonator},
+            InducedVoltageTime::freq_domain,
+            fft::single_precision);
+    indVoltTime->induced_voltage_generation(beam);
+    auto res = indVoltTime->fInducedVoltage;
+    std::string params = std::string(TEST_FILES "/Impedances/") +
+                         "InducedVoltage/InducedVoltageTime/generation1/";
+
+    f_vector_t v;
+    util::read_vector_from_file(v, params + "induced_voltage.txt");
+
+    ASSERT_EQ(v.size(), res.size());
+
+    double max = *max_element(res.begin(), res.end(), [](double i, double j) {
+        return std::abs(i) < std::abs(j);
+    });
+    max = std::abs(max);
+    for (uint i = 0; i < v.size(); ++i) {
+        double ref = v[i];
+        double real = res[i];
+
+        ASSERT_NEAR(ref, real, epsilon * max)
+                << "Testing of indVoltTime->fInducedVoltage failed on i " << i
+                << std::endl;
+    }
+
+    delete indVoltTime;
+}
+
+
 TEST_F(testInducedVoltage, convolution1)
 {
     auto slices = Context::Slice;
@@ -334,6 +373,65 @@ TEST_F(testInducedVoltage, convolution1)
 
 
 
+TEST_F(testInducedVoltage, auto_domain1)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+
+    slices->track();
+    auto epsilon = 1e-8;
+
+    auto indVoltFreq = new InducedVoltageTime(slices, {resonator},
+            InducedVoltageTime::time_or_freq::freq_domain);
+    auto indVoltAuto = new InducedVoltageTime(slices, {resonator},
+            InducedVoltageTime::time_or_freq::auto_domain);
+    indVoltFreq->induced_voltage_generation(beam);
+    indVoltAuto->induced_voltage_generation(beam);
+    auto ref = indVoltFreq->fInducedVoltage;
+    auto res = indVoltAuto->fInducedVoltage;
+
+    ASSERT_EQ(ref.size(), res.size());
+
+    double max = *max_element(ref.begin(), ref.end(), [](double i, double j) {
+        return std::abs(i) < std::abs(j);
+    });
+    max = std::abs(max);
+
+    for (uint i = 0; i < ref.size(); ++i) {
+        ASSERT_NEAR(ref[i], res[i], epsilon * max)
+                << "Testing of indVoltAuto->fInducedVoltage failed on i " << i
+                << std::endl;
+    }
+    delete indVoltFreq;
+    delete indVoltAuto;
+
+    // A coarse profile, whatever method the timings choose for it
+    auto coarse = new Slices(Context::RfP, beam, 32, 0, 0,
+                             2 * constant::pi, Slices::cuts_unit_t::rad);
+    coarse->track();
+    indVoltFreq = new InducedVoltageTime(coarse, {resonator},
+            InducedVoltageTime::time_or_freq::freq_domain);
+    indVoltAuto = new InducedVoltageTime(coarse, {resonator},
+            InducedVoltageTime::time_or_freq::auto_domain);
+    ref = indVoltFreq->induced_voltage_generation(beam);
+    res = indVoltAuto->induced_voltage_generation(beam);
+    ASSERT_EQ(ref.size(), res.size());
+    max = *max_element(ref.begin(), ref.end(), [](double i, double j) {
+        return std::abs(i) < std::abs(j);
+    });
+    max = std::abs(max);
+    for (uint i = 0; i < ref.size(); ++i) {
+        ASSERT_NEAR(ref[i], res[i], epsilon * max)
+                << "Testing of coarse indVoltAuto failed on i " << i
+                << std::endl;
+    }
+    delete indVoltFreq;
+    delete indVoltAuto;
+    delete coarse;
+}
+
+
+
 TEST_F(testInducedVoltage, track1)
 {
     auto slices = Context::Slice;
@@ -541,6 +639,48 @@ TEST_F(testTotalInducedVoltage, track2)
 }
 
 
+TEST_F(testTotalInducedVoltage, track_memory1)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+
+    // With a revolution period of a whole number of slices the spectral
+    // shift of the memory must match a plain shift of the samples
+    const uint nTurnsMem = 2;
+    const uint shift = slices->n_slices;
+    const double dt = slices->bin_centers[1] - slices->bin_centers[0];
+
+    auto indVoltFreq = new InducedVoltageFreq(slices, {resonator}, 0,
+            InducedVoltageFreq::round_option, nTurnsMem);
+    auto totVol = new TotalInducedVoltage(beam, slices, {indVoltFreq},
+                                          nTurnsMem,
+                                          f_vector_t(N_t + 1, shift * dt));
+    slices->track();
+
+    totVol->track_memory();
+    auto firstTurn = totVol->fInducedVoltageMem;
+    ASSERT_EQ(totVol->fNPointsFFT, firstTurn.size());
+
+    totVol->track_memory();
+
+    const double maxV = std::abs(*std::max_element(
+                                     firstTurn.begin(), firstTurn.end(),
+    [](double a, double b) {return std::abs(a) < std::abs(b);}));
+    const double epsilon = 1e-8 * maxV;
+
+    for (int i = 0; i < slices->n_slices; ++i) {
+        double ref = firstTurn[i] + firstTurn[i + shift];
+        double real = totVol->fInducedVoltage[i];
+        ASSERT_NEAR(ref, real, epsilon)
+                << "Testing of totVol->fInducedVoltage failed on i " << i
+                << std::endl;
+    }
+
+    delete indVoltFreq;
+    delete totVol;
+}
+
+
 int main(int ac, char *av[])
 {
     ::testing::InitGoogleTest(&ac, av);
@@ -118,7 +118,7 @@ TEST_F(testInducedVoltageFreq, constructor1)
 
     for (uint i = 0; i < v.size(); ++i) {
         auto ref = v[i];
-        auto real = indVoltFreq->fNFFTSampling;
+        double real = indVoltFreq->fNFFTSampling;
         ASSERT_NEAR(ref, real, epsilon * std::max(std::abs(ref), std::abs(real)))
                 << "Testing of indVoltFreq->fNFFTSampling failed on i " << i
                 << std::endl;
@@ -162,7 +162,7 @@ TEST_F(testInducedVoltageFreq, constructor2)
 
     for (uint i = 0; i < v.size(); ++i) {
         auto ref = v[i];
-        auto real = indVoltFreq->fNTurnsMem;
+        double real = indVoltFreq->fNTurnsMem;
         ASSERT_NEAR(ref, real, epsilon * std::max(std::abs(ref), std::abs(real)))
                 << "Testing of indVoltFreq->fNTurnsMem failed on i " << i
                 << std::endl;
@@ -172,7 +172,7 @@ TEST_F(testInducedVoltageFreq, constructor2)
 
     for (uint i = 0; i < v.size(); ++i) {
         auto ref = v[i];
-        auto real = indVoltFreq->fLenArrayMem;
+        double real = indVoltFreq->fLenArrayMem;
         ASSERT_NEAR(ref, real, epsilon * std::max(std::abs(ref), std::abs(real)))
                 << "Testing of indVoltFreq->fLenArrayMem failed on i " << i
                 << std::endl;
@@ -182,7 +182,7 @@ TEST_F(testInducedVoltageFreq, constructor2)
 
     for (uint i = 0; i < v.size(); ++i) {
         auto ref = v[i];
-        auto real = indVoltFreq->fLenArrayMemExt;
+        double real = indVoltFreq->fLenArrayMemExt;
         ASSERT_NEAR(ref, real, epsilon * std::max(std::abs(ref), std::abs(real)))
                 << "Testing of indVoltFreq->fLenArrayMemExt failed on i " << i
                 << std::endl;
@@ -192,7 +192,7 @@ TEST_F(testInducedVoltageFreq, constructor2)
 
     for (uint i = 0; i < v.size(); ++i) {
         auto ref = v[i];
-        auto real = indVoltFreq->fNPointsFFT;
+        double real = indVoltFreq->fNPointsFFT;
         ASSERT_NEAR(ref, real, epsilon * std::max(std::abs(ref), std::abs(real)))
                 << "Testing of indVoltFreq->fNPointsFFT failed on i " << i
                 << std::endl;
@@ -312,7 +312,7 @@ TEST_F(testInducedVoltageFreq, reprocess1)
     util::read_vector_from_file(v, params + "n_fft_sampling.txt");
     for (uint i = 0; i < v.size(); ++i) {
         auto ref = v[i];
-        auto real = indVoltFreq->fNFFTSampling;
+        double real = indVoltFreq->fNFFTSampling;
         ASSERT_NEAR(ref, real, epsilon * std::max(std::abs(ref), std::abs(real)))
                 << "Testing of indVoltFreq->fNFFTSampling failed on i " << i
                 << std::endl;
@@ -372,6 +372,64 @@ TEST_F(testInducedVoltageFreq, induced_voltage_generation1)
 }
 
 
+TEST_F(testInducedVoltageFreq, induced_voltage_generation_single1)
+{
+    // Float accuracy, relative to the peak voltage
+    auto epsilon = 1e-5;
+    auto beam = Context::Beam;
+    auto slices = Context::Slice;
+    auto indVoltFreq = new InducedVoltageFreq(slices, {resonator}, 1e5,
+            InducedVoltageFreq::round_option,
+            0, false, false,
+            fft::single_precision);
+    slices->track();
+
+    indVoltFreq->induced_voltage_generation(beam);
+
+    // The same profile in double precision
+    auto indVoltDouble = new InducedVoltageFreq(slices, {resonator}, 1e5);
+    indVoltDouble->induced_voltage_generation(beam);
+    const auto &vd = indVoltDouble->fInducedVoltage;
+    ASSERT_EQ(vd.size(), indVoltFreq->fInducedVoltage.size());
+
+    double maxDouble = 0.0;
+    for (const auto &d : vd)
+        maxDouble = std::max(maxDouble, std::abs(d));
+
+    for (uint i = 0; i < vd.size(); ++i) {
+        ASSERT_NEAR(vd[i], indVoltFreq->fInducedVoltage[i],
+                    epsilon * maxDouble)
+                << "Testing of indVoltFreq->fInducedVoltage against the "
+                << "double precision failed on i " << i << std::endl;
+    }
+    delete indVoltDouble;
+
+    auto params =
+        std::string(TEST_FILES "/Impedances/") +
+        "InducedVoltage/InducedVoltageFreq/induced_voltage_generation1/";
+
+    f_vector_t v;
+
+    util::read_vector_from_file(v, params + "induced_voltage.txt");
+
+    ASSERT_EQ(v.size(), indVoltFreq->fInducedVoltage.size());
+
+    double max = 0.0;
+    for (const auto &ref : v)
+        max = std::max(max, std::abs(ref));
+
+    for (uint i = 0; i < v.size(); ++i) {
+        auto ref = v[i];
+        double real = indVoltFreq->fInducedVoltage[i];
+        ASSERT_NEAR(ref, real, epsilon * max)
+                << "Testing of indVoltFreq->fInducedVoltage failed on i " << i
+                << std::endl;
+    }
+
+    delete indVoltFreq;
+}
+
+
 TEST_F(testInducedVoltageFreq, induced_voltage_generation2)
 {
     auto epsilon = 1e-8;
@@ -469,6 +527,53 @@ TEST_F(testInducedVoltageFreq, track2)
     delete indVoltFreq;
 }
 
+TEST_F(testInducedVoltageFreq, save_individual_voltages1)
+{
+    auto slices = Context::Slice;
+    auto beam = Context::Beam;
+    slices->track();
+
+    // A second, broad band source
+    f_vector_t R_shunt = {1e5}, f_res = {1e9}, Q_factor = {1.0};
+    auto broadBand = new Resonators(R_shunt, f_res, Q_factor);
+
+    auto indVoltSave = new InducedVoltageFreq(slices, {resonator, broadBand},
+            1e5, InducedVoltageFreq::round_option, 0, false, true);
+    auto indVoltA = new InducedVoltageFreq(slices, {resonator}, 1e5);
+    auto indVoltB = new InducedVoltageFreq(slices, {broadBand}, 1e5);
+
+    indVoltSave->induced_voltage_generation(beam);
+    indVoltA->induced_voltage_generation(beam);
+    indVoltB->induced_voltage_generation(beam);
+
+    const auto &a = indVoltA->fInducedVoltage;
+    const auto &b = indVoltB->fInducedVoltage;
+    const auto &saved = indVoltSave->fMatrixSaveIndividualVoltages;
+    const int n = slices->n_slices;
+
+    ASSERT_EQ((uint) n, indVoltSave->fInducedVoltage.size());
+    ASSERT_EQ(2u * n, saved.size());
+
+    double max = 0.0;
+    for (int i = 0; i < n; ++i)
+        max = std::max(max, std::max(std::abs(a[i]), std::abs(b[i])));
+    const double epsilon = 1e-10 * max;
+
+    for (int i = 0; i < n; ++i) {
+        ASSERT_NEAR(a[i], saved[i], epsilon)
+                << "Testing of the first source failed on i " << i << std::endl;
+        ASSERT_NEAR(b[i], saved[n + i], epsilon)
+                << "Testing of the second source failed on i " << i << std::endl;
+        ASSERT_NEAR(a[i] + b[i], indVoltSave->fInducedVoltage[i], epsilon)
+                << "Testing of fInducedVoltage failed on i " << i << std::endl;
+    }
+
+    delete indVoltSave;
+    delete indVoltA;
+    delete indVoltB;
+    delete broadBand;
+}
+
 int main(int ac, char *av[])
 {
     ::testing::InitGoogleTest(&ac, av);
@@ -147,6 +147,33 @@ TEST_F(testGP, test_eta_0)
     }
 }
 
+TEST(testGP2, test_eta_1_2)
+{
+    // Second order momentum compaction (three terms), eta_1 and eta_2
+    // are both used
+    const int N_t = 100;
+    const double a0 = 3.2e-4, a1 = 1e-6, a2 = 1e-8;
+    f_vector_2d_t momentumVec(1, f_vector_t(N_t + 1));
+    mymath::linspace(momentumVec[0].data(), 1.4e9, 2e9, N_t + 1);
+    f_vector_2d_t alphaVec(1, {a0, a1, a2});
+    f_vector_t CVec(1, 157.08);
+    GeneralParameters GP(N_t, CVec, alphaVec, 3, momentumVec,
+                         GeneralParameters::particle_t::proton);
+
+    const double epsilon = 1e-10;
+    for (int i = 0; i < N_t + 1; ++i) {
+        const double betasq = GP.beta[0][i] * GP.beta[0][i];
+        const double gammasq = GP.gamma[0][i] * GP.gamma[0][i];
+        const double eta_0 = a0 - 1 / gammasq;
+        const double eta_1 = 3 * betasq / (2 * gammasq) + a1 - a0 * eta_0;
+        const double eta_2 = -betasq * (5 * betasq - 1) / (2 * gammasq) +
+                             a2 - 2 * a0 * a1 + a1 / gammasq +
+                             a0 * a0 * eta_0 - 3 * betasq * a0 / (2 * gammasq);
+        ASSERT_NEAR(eta_1, GP.eta_1[0][i], epsilon * std::abs(eta_1)) << i;
+        ASSERT_NEAR(eta_2, GP.eta_2[0][i], epsilon * std::abs(eta_2)) << i;
+    }
+}
+
 int main(int ac, char *av[])
 {
     ::testing::InitGoogleTest(&ac, av);
@@ -2,6 +2,7 @@
 
 #include <blond/globals.h>
 #include <blond/input_parameters/GeneralParameters.h>
+#include <blond/input_parameters/RfParameters.h>
 #include <blond/math_functions.h>
 #include <blond/utilities.h>
 #include <gtest/gtest.h>
@@ -211,6 +212,100 @@ TEST_F(testRFP, test_t_RF)
     }
 }
 
+TEST(testLazyParameters, lazy_equals_stored)
+{
+    const int N_t = 2000;
+    const double alpha = 1. / 55.759505 / 55.759505;
+    f_vector_2d_t alphaVec(1, f_vector_t(2, alpha));
+    f_vector_t CVec(1, 26658.883);
+    f_vector_2d_t hVec(1, f_vector_t(N_t + 1, 35640));
+    f_vector_2d_t voltageVec(1, f_vector_t(N_t + 1, 6e6));
+    f_vector_2d_t dphiVec(1, f_vector_t(N_t + 1, 0));
+
+    // A momentum program with two ramps, evaluated 64 turns at a time
+    f_vector_t turns = {0, 900, (double) N_t};
+    f_vector_2d_t program = {{450e9, 455e9, 460.005e9}};
+    GeneralParameters lazyGP(N_t, CVec, alphaVec, 2, turns, program,
+                             GeneralParameters::particle_t::proton, 64);
+
+    f_vector_2d_t momentumVec = {lazyGP.momentum[0].vector()};
+    GeneralParameters GP(N_t, CVec, alphaVec, 2, momentumVec,
+                         GeneralParameters::particle_t::proton);
+    ASSERT_EQ(0u, GP.turn_block);
+    ASSERT_TRUE(lazyGP.t_rev.lazy());
+    ASSERT_DOUBLE_EQ(450e9, momentumVec[0][0]);
+    ASSERT_DOUBLE_EQ(455e9, momentumVec[0][900]);
+    ASSERT_DOUBLE_EQ(460.005e9, momentumVec[0][N_t]);
+
+    RfParameters lazyRfP(&lazyGP, 1, hVec, voltageVec, dphiVec);
+    RfParameters RfP(&GP, 1, hVec, voltageVec, dphiVec);
+
+    // Forwards, as the tracker moves the windows, and then backwards
+    auto check = [&](int turn) {
+        ASSERT_EQ(GP.beta[0][turn], lazyGP.beta[0][turn]) << turn;
+        ASSERT_EQ(GP.energy[0][turn], lazyGP.energy[0][turn]) << turn;
+        ASSERT_EQ(GP.t_rev[turn], lazyGP.t_rev[turn]) << turn;
+        ASSERT_EQ(GP.omega_rev[turn], lazyGP.omega_rev[turn]) << turn;
+        ASSERT_EQ(GP.eta_0[0][turn], lazyGP.eta_0[0][turn]) << turn;
+        ASSERT_EQ(GP.eta_1[0][turn], lazyGP.eta_1[0][turn]) << turn;
+        ASSERT_EQ(RfP.phi_s[turn], lazyRfP.phi_s[turn]) << turn;
+        ASSERT_EQ(RfP.Qs[turn], lazyRfP.Qs[turn]) << turn;
+        ASSERT_EQ(RfP.omega_s0[turn], lazyRfP.omega_s0[turn]) << turn;
+        ASSERT_EQ(RfP.omega_rf_d[0][turn], lazyRfP.omega_rf_d[0][turn])
+                << turn;
+        if (turn < N_t) {
+            ASSERT_EQ(GP.cycle_time[turn], lazyGP.cycle_time[turn]) << turn;
+            ASSERT_EQ(RfP.E_increment[turn], lazyRfP.E_increment[turn])
+                    << turn;
+        }
+    };
+    for (int i = 0; i <= N_t; ++i) {
+        lazyGP.advance(i);
+        lazyRfP.advance(i);
+        check(i);
+    }
+    for (int i = N_t; i >= 0; i -= 7)
+        check(i);
+
+    // Reads do not move the windows, any thread can read any turn
+    lazyGP.advance(0);
+    f_vector_t t_rev(N_t + 1), phi_s(N_t + 1);
+    #pragma omp parallel for num_threads(4)
+    for (int i = 0; i <= N_t; ++i) {
+        t_rev[i] = lazyGP.t_rev[i];
+        phi_s[i] = lazyRfP.phi_s[i];
+    }
+    for (int i = 0; i <= N_t; ++i) {
+        ASSERT_EQ(GP.t_rev[i], t_rev[i]) << i;
+        ASSERT_EQ(RfP.phi_s[i], phi_s[i]) << i;
+    }
+
+    ASSERT_FALSE(RfP.omega_rf[0].lazy());
+    ASSERT_TRUE(lazyRfP.omega_rf[0].lazy());
+    ASSERT_TRUE(lazyRfP.phi_rf[0].lazy());
+    ASSERT_TRUE(lazyRfP.t_rf.lazy());
+    ASSERT_EQ(RfP.t_rf.vector(), lazyRfP.t_rf.vector());
+
+    // The writes of a phase loop, inside and outside of the window
+    for (int i : {1, 2, 3, N_t / 2, N_t}) {
+        lazyRfP.advance(i);
+        for (auto rfp : {&RfP, &lazyRfP}) {
+            rfp->omega_rf[0].set(i, rfp->omega_rf[0][i] * 1.001);
+            rfp->phi_rf[0].set(i - 1, rfp->phi_rf[0][i - 1] + 0.1);
+        }
+    }
+    lazyRfP.omega_rf[0].set(2, RfP.omega_rf[0][2]);
+    lazyRfP.advance(N_t / 2);
+    for (int i = 0; i <= N_t; ++i) {
+        ASSERT_EQ(RfP.omega_rf[0][i], lazyRfP.omega_rf[0][i]) << i;
+        ASSERT_EQ(RfP.phi_rf[0][i], lazyRfP.phi_rf[0][i]) << i;
+    }
+    ASSERT_EQ(RfP.omega_rf[0].vector(), lazyRfP.omega_rf[0].vector());
+    ASSERT_EQ(RfP.phi_rf[0].vector(), lazyRfP.phi_rf[0].vector());
+    ASSERT_DOUBLE_EQ(2 * constant::pi / RfP.omega_rf_d[0][N_t],
+                     lazyRfP.t_rf[N_t]);
+}
+
 int main(int ac, char *av[])
 {
     ::testing::InitGoogleTest(&ac, av);
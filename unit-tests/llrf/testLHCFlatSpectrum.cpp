@@ -243,6 +243,94 @@ TEST_F(testLHCFlatSpectrum, generate_none1) {
     delete lhcfs;
 }
 
+TEST_F(testLHCFlatSpectrum, streaming1) {
+
+    auto batch = new LHCFlatSpectrum(1000, 10, 0.1, 1, 0.1, 1, 2);
+    batch->generate();
+
+    auto stream = new LHCFlatSpectrum(1000, 10, 0.1, 1, 0.1, 1, 2,
+                                      LHCFlatSpectrum::predistortion_t::predistortion_none,
+                                      true);
+    stream->generate();
+    ASSERT_TRUE(stream->fDphi.empty());
+    ASSERT_TRUE(stream->fFs.lazy());
+
+    ASSERT_EQ(batch->fFs.size(), stream->fFs.size());
+    f_vector_t fs(stream->fFs.size());
+    stream->fFs.get(0, fs.size(), fs.data());
+    for (uint i = 0; i < fs.size(); ++i)
+        ASSERT_EQ(batch->fFs[i], fs[i]);
+
+    ASSERT_EQ(batch->fDphi.size(), N_t + 1);
+    for (uint i = 0; i < N_t + 1; ++i)
+        ASSERT_EQ(batch->fDphi[i], stream->dphi(i));
+
+    // Looking back one window, and jumping back to the start
+    ASSERT_EQ(batch->fDphi[N_t - 15], stream->dphi(N_t - 15));
+    ASSERT_EQ(batch->fDphi[3], stream->dphi(3));
+
+    delete batch;
+    delete stream;
+}
+
+TEST_F(testLHCFlatSpectrum, parallel_windows1) {
+
+    auto serial = new LHCFlatSpectrum(1000, 10, 0.1, 1, 0.1, 1, 2);
+    serial->generate();
+
+    omp_set_num_threads(4);
+    auto parallel = new LHCFlatSpectrum(1000, 10, 0.1, 1, 0.1, 1, 2);
+    parallel->generate();
+
+    ASSERT_EQ(serial->fDphi.size(), parallel->fDphi.size());
+    for (uint i = 0; i < serial->fDphi.size(); ++i)
+        ASSERT_DOUBLE_EQ(serial->fDphi[i], parallel->fDphi[i]);
+    ASSERT_EQ(serial->fSeed1, parallel->fSeed1);
+    ASSERT_EQ(serial->fSeed2, parallel->fSeed2);
+
+    delete serial;
+    delete parallel;
+}
+
+TEST_F(testLHCFlatSpectrum, parallel_windows_lazy1) {
+
+    // The same ramp, evaluated 50 turns at a time
+    f_vector_2d_t momentumVec(n_sections, {p_i, 1.01 * p_i});
+    f_vector_2d_t alphaVec(n_sections, f_vector_t(alpha_order + 1, alpha));
+    f_vector_t CVec(n_sections, C);
+    f_vector_2d_t hVec(n_sections, f_vector_t(N_t + 1, h));
+    f_vector_2d_t voltageVec(n_sections, f_vector_t(N_t + 1, V));
+    f_vector_2d_t dphiVec(n_sections, f_vector_t(N_t + 1, dphi));
+
+    auto storedGP = Context::GP;
+    auto storedRfP = Context::RfP;
+    Context::GP = new GeneralParameters(N_t, CVec, alphaVec, alpha_order,
+                                        {0.0, (double) N_t}, momentumVec,
+                                        GeneralParameters::particle_t::proton,
+                                        50);
+    Context::RfP = new RfParameters(Context::GP, n_sections, hVec,
+                                    voltageVec, dphiVec);
+    ASSERT_TRUE(Context::GP->f_rev.lazy());
+
+    auto serial = new LHCFlatSpectrum(1000, 10, 0.1, 1, 0.1, 1, 2);
+    serial->generate();
+
+    omp_set_num_threads(4);
+    auto parallel = new LHCFlatSpectrum(1000, 10, 0.1, 1, 0.1, 1, 2);
+    parallel->generate();
+
+    ASSERT_EQ(serial->fDphi.size(), parallel->fDphi.size());
+    for (uint i = 0; i < serial->fDphi.size(); ++i)
+        ASSERT_DOUBLE_EQ(serial->fDphi[i], parallel->fDphi[i]);
+
+    delete serial;
+    delete parallel;
+    delete Context::RfP;
+    delete Context::GP;
+    Context::GP = storedGP;
+    Context::RfP = storedRfP;
+}
+
 int main(int ac, char* av[]) {
     ::testing::InitGoogleTest(&ac, av);
     return RUN_ALL_TESTS();
@@ -1,4 +1,5 @@
 #include <blond/beams/Distributions.h>
+#include <blond/constants.h>
 #include <blond/globals.h>
 #include <blond/llrf/LHCNoiseFB.h>
 #include <blond/math_functions.h>
@@ -358,6 +359,58 @@ TEST_F(testLHCNoiseFBMultiBunch, fwhm_multi_bunch2)
     delete lhcnfb;
 }
 
+TEST_F(testLHCNoiseFBMultiBunch, fwhm_multi_bunch_buckets1)
+{
+    auto Slice = Context::Slice;
+    auto RfP = Context::RfP;
+
+    // Slices over 20 buckets, one bunch of a different length in each
+    const double omega_rf = RfP->omega_rf[0][RfP->counter];
+    const double phi_rf = RfP->phi_rf[0][RfP->counter];
+    const double bucket = 2 * constant::pi / omega_rf;
+    const double start = phi_rf / omega_rf;
+    const int n = Slice->n_slices;
+    for (int i = 0; i < n; i++) {
+        Slice->bin_centers[i] = start + 20 * bucket * (i + 0.5) / n;
+        const int b = (int)((Slice->bin_centers[i] - start) / bucket);
+        const double x = Slice->bin_centers[i] - start - (b + 0.5) * bucket;
+        const double sigma = bucket * (0.05 + 0.01 * b);
+        Slice->n_macroparticles[i] = 100 * std::exp(-x * x / (2 * sigma * sigma));
+    }
+
+    f_vector_t a;
+    for (int i = 0; i < 20; ++i)
+        a.push_back(i);
+    // The last bunch has an empty bucket
+    a.push_back(25);
+    auto lhcnfb = new LHCNoiseFB(1e-9, 1e8, 0.5, 10, false, a);
+    lhcnfb->fwhm_multi_bunch();
+
+    // Scan of all the slices for every bunch
+    for (uint k = 0; k < a.size(); ++k) {
+        const double lo = (phi_rf + 2 * constant::pi * a[k]) / omega_rf;
+        const double hi = lo + bucket;
+        double hheight = 0;
+        for (int j = 0; j < n; ++j)
+            if ((Slice->bin_centers[j] - lo) * (Slice->bin_centers[j] - hi) < 0)
+                hheight = std::max(hheight, Slice->n_macroparticles[j]);
+        hheight /= 2;
+
+        uint_vector_t index;
+        for (int j = 0; j < n; ++j)
+            if ((Slice->bin_centers[j] - lo) * (Slice->bin_centers[j] - hi) < 0
+                    && Slice->n_macroparticles[j] > hheight)
+                index.push_back(j);
+
+        const double ref = index.empty() ? 0.0
+                           : lhcnfb->fwhm_interpolation(index, hheight);
+        ASSERT_DOUBLE_EQ(ref, lhcnfb->fBlMeasBBB[k])
+                << "Testing of fBlMeasBBB failed on bunch " << k << std::endl;
+    }
+
+    delete lhcnfb;
+}
+
 TEST_F(testLHCNoiseFB, track1)
 {
 
@@ -87,7 +87,7 @@ TEST_F(testMonitors, SlicesMonitor1)
 
     longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, -1, false);
     auto slice = Slices(RfP, Beam, N_slices);
-    auto slicesMonitor = SlicesMonitor(filename, N_t / dt_save + 1, &slice);
+    SlicesMonitor slicesMonitor(filename, N_t / dt_save + 1, &slice);
     auto tracker = RingAndRfSection();
 
     for (int i = 0; i < N_t; i++) {
@@ -116,6 +116,71 @@ TEST_F(testMonitors, SlicesMonitor1)
 }
 
 
+TEST_F(testMonitors, SlicesMonitor_buffers)
+{
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    auto GP = Context::GP;
+    auto intfile = "n_macroparticles_int.h5";
+    auto floatfile = "n_macroparticles_float.h5";
+
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+    auto slice = Slices(RfP, Beam, N_slices);
+    auto tracker = RingAndRfSection();
+
+    // Every turn in buffers of 7, and every 10th turn as floats, from
+    // the turn 0 on
+    const int n_int = 203, n_float = (N_t + 9) / 10;
+    SlicesMonitor intMonitor(intfile, n_int, &slice, 9, 7);
+    SlicesMonitor floatMonitor(floatfile, N_t, &slice, 1, 100, 10, true);
+    vector<int> intRef;
+    vector<float> floatRef;
+    for (int i = 0; i < N_t; i++) {
+        tracker.track();
+        slice.track();
+        if (i < n_int)
+            for (auto n : slice.n_macroparticles)
+                intRef.push_back(n);
+        if (i % 10 == 0)
+            for (auto n : slice.n_macroparticles)
+                floatRef.push_back(n);
+        intMonitor.track();
+        floatMonitor.track();
+    }
+    ASSERT_EQ(n_int, intMonitor.fITurn);
+    ASSERT_EQ(n_float, floatMonitor.fITurn);
+    intMonitor.close();
+    floatMonitor.close();
+
+    // One slice per row
+    hsize_t dims[2];
+    int *real = (int *) read_2D(intfile, "Slices/n_macroparticles",
+                                "int", dims);
+    ASSERT_EQ((hsize_t) N_slices, dims[0]);
+    ASSERT_EQ((hsize_t) n_int, dims[1]);
+    for (int i = 0; i < N_slices; i++)
+        for (int j = 0; j < n_int; j++)
+            ASSERT_EQ(intRef[j * N_slices + i], real[i * n_int + j])
+                    << "Testing of n_macroparticles failed on slice " << i
+                    << " turn " << j << '\n';
+    free(real);
+
+    float *realF = (float *) read_2D(floatfile, "Slices/n_macroparticles",
+                                     "float", dims);
+    ASSERT_EQ((hsize_t) N_slices, dims[0]);
+    ASSERT_EQ((hsize_t) n_float, dims[1]);
+    for (int i = 0; i < N_slices; i++)
+        for (int j = 0; j < n_float; j++)
+            ASSERT_EQ(floatRef[j * N_slices + i], realF[i * n_float + j])
+                    << "Testing of n_macroparticles failed on slice " << i
+                    << " turn " << j << '\n';
+    free(realF);
+
+    remove(intfile);
+    remove(floatfile);
+}
+
+
 TEST_F(testMonitors, BunchMonitor1)
 {
     auto GP = Context::GP;
@@ -129,7 +194,7 @@ TEST_F(testMonitors, BunchMonitor1)
 
     longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, -1, false);
     auto slice = Slices(RfP, Beam, N_slices);
-    auto bunchmonitor = BunchMonitor(GP, RfP, Beam, filename, 100);
+    BunchMonitor bunchmonitor(GP, RfP, Beam, filename, 100);
     auto tracker = RingAndRfSection();
 
     for (int i = 0; i < N_t; i++) {
@@ -142,6 +207,8 @@ TEST_F(testMonitors, BunchMonitor1)
 
     hsize_t dimsPy[1];
     hsize_t dimsCpp[1];
+    // The references do not have the turns after the last full buffer
+    const uint turns = N_t / 100 * 100;
 
     int *realInt = (int *) read_1D(filename,
                                    "Beam/n_macroparticles_alive",
@@ -150,7 +217,7 @@ TEST_F(testMonitors, BunchMonitor1)
                                    "Beam/n_macroparticles_alive",
                                    "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; i++)
+    for (uint i = 0; i < turns; i++)
         ASSERT_EQ((int)ref[i], realInt[i])
                 << "Testing of n_macroparticles failed on i " << i << '\n';
 
@@ -164,7 +231,7 @@ TEST_F(testMonitors, BunchMonitor1)
                             "Beam/mean_dt",
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], realD[i], epsilon *
                     max(abs(ref[i]), abs(realD[i])))
                 << "Testing of mean_dt failed on i " << i << '\n';
@@ -179,7 +246,7 @@ TEST_F(testMonitors, BunchMonitor1)
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
 
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], realD[i], epsilon *
                     max(abs(ref[i]), abs(realD[i])))
                 << "Testing of mean_dE failed on i " << i << '\n';
@@ -193,7 +260,7 @@ TEST_F(testMonitors, BunchMonitor1)
                             "Beam/sigma_dt",
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], realD[i], epsilon *
                     max(abs(ref[i]), abs(realD[i])))
                 << "Testing of sigma_dt failed on i " << i << '\n';
@@ -206,7 +273,7 @@ TEST_F(testMonitors, BunchMonitor1)
                             "Beam/sigma_dE",
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], realD[i], epsilon *
                     max(abs(ref[i]), abs(realD[i])))
                 << "Testing of sigma_dE failed on i " << i << '\n';
@@ -219,7 +286,7 @@ TEST_F(testMonitors, BunchMonitor1)
                             "Beam/epsn_rms_l",
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], realD[i], epsilon *
                     max(abs(ref[i]), abs(realD[i])))
                 << "Testing of epsn_rms_l failed on i " << i << '\n';
@@ -248,8 +315,8 @@ TEST_F(testMonitors, BunchMonitor2)
     auto SL_gain = PL_gain / 10.0;
     f_vector_t PL_gainVec(N_t + 1 , PL_gain);
     auto PL = LHC(PL_gainVec, SL_gain);
-    auto bunchmonitor = BunchMonitor(GP, RfP, Beam, filename,
-                                     100, &slice, &PL);
+    BunchMonitor bunchmonitor(GP, RfP, Beam, filename,
+                              100, &slice, &PL);
     auto tracker = RingAndRfSection();
 
     for (int i = 0; i < N_t; i++) {
@@ -263,6 +330,8 @@ TEST_F(testMonitors, BunchMonitor2)
 
     hsize_t dimsPy[1];
     hsize_t dimsCpp[1];
+    // The references do not have the turns after the last full buffer
+    const uint turns = N_t / 100 * 100;
 
     double *realD = (double *) read_1D(filename,
                                        "Beam/PL_omegaRF",
@@ -272,7 +341,7 @@ TEST_F(testMonitors, BunchMonitor2)
                                       "double", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
 
-    for (uint i = 0; i < dimsCpp[0]; i++)
+    for (uint i = 0; i < turns; i++)
         ASSERT_NEAR(refD[i], realD[i], epsilon *
                     max(abs(refD[i]), abs(realD[i])))
                 << "Testing of PL_omegaRF failed on i " << i << '\n';
@@ -286,7 +355,7 @@ TEST_F(testMonitors, BunchMonitor2)
                                    "Beam/PL_phiRF",
                                    "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], real[i], epsilon *
                     max(abs(ref[i]), abs(real[i])))
                 << "Testing of PL_phiRF failed on i " << i << '\n';
@@ -300,7 +369,7 @@ TEST_F(testMonitors, BunchMonitor2)
                             "Beam/PL_bunch_phase",
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], real[i], epsilon *
                     max(abs(ref[i]), abs(real[i])))
                 << "Testing of PL_bunch_phase failed on i " << i << '\n';
@@ -314,7 +383,7 @@ TEST_F(testMonitors, BunchMonitor2)
                             "Beam/PL_phase_corr",
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], real[i], epsilon *
                     max(abs(ref[i]), abs(real[i])))
                 << "Testing of PL_phase_corr failed on i " << i << '\n';
@@ -327,7 +396,7 @@ TEST_F(testMonitors, BunchMonitor2)
                             "Beam/PL_omegaRF_corr",
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], real[i], epsilon *
                     max(abs(ref[i]), abs(real[i])))
                 << "Testing of PL_omegaRF_corr failed on i " << i << '\n';
@@ -340,7 +409,7 @@ TEST_F(testMonitors, BunchMonitor2)
                             "Beam/SL_dphiRF",
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], real[i], epsilon *
                     max(abs(ref[i]), abs(real[i])))
                 << "Testing of SL_dphiRF failed on i " << i << '\n';
@@ -354,7 +423,7 @@ TEST_F(testMonitors, BunchMonitor2)
                             "Beam/RL_drho",
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], real[i], epsilon *
                     max(abs(ref[i]), abs(real[i])))
                 << "Testing of RL_drho failed on i " << i << '\n';
@@ -386,8 +455,8 @@ TEST_F(testMonitors, BunchMonitor3)
 
     auto noiseFB = LHCNoiseFB(1e-8, 0.1e9, 0.93, 100, true, {10, 20, 30});
 
-    auto bunchmonitor = BunchMonitor(GP, RfP, Beam, filename,
-                                     100, &slice, &PL, &noiseFB);
+    BunchMonitor bunchmonitor(GP, RfP, Beam, filename,
+                              100, &slice, &PL, &noiseFB);
     auto tracker = RingAndRfSection();
 
     for (int i = 0; i < N_t; i++) {
@@ -400,6 +469,8 @@ TEST_F(testMonitors, BunchMonitor3)
 
     hsize_t dimsPy[1];
     hsize_t dimsCpp[1];
+    // The references do not have the turns after the last full buffer
+    const uint turns = N_t / 100 * 100;
 
     float *real = (float *) read_1D(filename,
                                     "Beam/LHC_noise_FB_factor",
@@ -408,7 +479,7 @@ TEST_F(testMonitors, BunchMonitor3)
                                    "Beam/LHC_noise_FB_factor",
                                    "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; i++)
+    for (uint i = 0; i < turns; i++)
         ASSERT_NEAR(ref[i], real[i], epsilon *
                     max(abs(ref[i]), abs(real[i])))
                 << "Testing of LHC_noise_FB_factor failed on i " << i << '\n';
@@ -423,7 +494,7 @@ TEST_F(testMonitors, BunchMonitor3)
                             "Beam/LHC_noise_FB_bl",
                             "float", dimsPy);
     ASSERT_EQ(dimsCpp[0], dimsPy[0]);
-    for (uint i = 0; i < dimsCpp[0]; ++i)
+    for (uint i = 0; i < turns; ++i)
         ASSERT_NEAR(ref[i], real[i], epsilon *
                     max(abs(ref[i]), abs(real[i])))
                 << "Testing of LHC_noise_FB_bl failed on i " << i << '\n';
@@ -449,6 +520,171 @@ TEST_F(testMonitors, BunchMonitor3)
     remove(filename);
 }
 
+TEST_F(testMonitors, BunchMonitor_buffers)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    auto filename = "bunch.h5";
+    remove(filename);
+
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+    auto slice = Slices(RfP, Beam, N_slices);
+    BunchMonitor bunchmonitor(GP, RfP, Beam, filename, 300, NULL,
+                              NULL, NULL, 9, {{"mean_dt", 0}});
+    auto tracker = RingAndRfSection();
+
+    // All the turns are written, the ones after the last full buffer
+    // when the monitor is closed
+    vector<float> mean_dt(1, Beam->mean_dt), sigma_dE(1, Beam->sigma_dE);
+    for (int i = 0; i < N_t; i++) {
+        tracker.track();
+        slice.track();
+        bunchmonitor.track();
+        mean_dt.push_back(Beam->mean_dt);
+        sigma_dE.push_back(Beam->sigma_dE);
+    }
+    bunchmonitor.close();
+    bunchmonitor.close();
+
+    hsize_t dims[1];
+    float *real = (float *) read_1D(filename, "Beam/mean_dt", "float", dims);
+    ASSERT_EQ(mean_dt.size(), dims[0]);
+    ASSERT_EQ(mean_dt, vector<float>(real, real + dims[0]));
+    free(real);
+
+    real = (float *) read_1D(filename, "Beam/sigma_dE", "float", dims);
+    ASSERT_EQ(sigma_dE, vector<float>(real, real + dims[0]));
+    free(real);
+
+    H5::H5File file(filename, H5F_ACC_RDONLY);
+    ASSERT_EQ(0, file.openDataSet("Beam/mean_dt").getCreatePlist()
+              .getNfilters());
+    ASSERT_EQ(1, file.openDataSet("Beam/sigma_dE").getCreatePlist()
+              .getNfilters());
+    file.close();
+
+    remove(filename);
+}
+
+TEST_F(testMonitors, BunchMonitor_close)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    auto filename = "bunch.h5";
+    remove(filename);
+
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+    BunchMonitor bunchmonitor(GP, RfP, Beam, filename, 100);
+    auto tracker = RingAndRfSection();
+
+    // Closed in the middle of the second buffer
+    for (int i = 0; i < 150; i++) {
+        tracker.track();
+        bunchmonitor.track();
+    }
+    const float last = Beam->mean_dt;
+    bunchmonitor.close();
+
+    hsize_t dims[1];
+    float *real = (float *) read_1D(filename, "Beam/mean_dt", "float", dims);
+    ASSERT_EQ(N_t + 1, (int) dims[0]);
+    ASSERT_EQ(last, real[150]);
+    ASSERT_NE(0, real[149]);
+    ASSERT_EQ(0, real[151]);
+    free(real);
+
+    remove(filename);
+}
+
+TEST_F(testMonitors, PhaseSpaceMonitor_sample)
+{
+    const int threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    const auto sample = PhaseSpaceMonitor::sample(1000000, 5000, 7);
+    omp_set_num_threads(4);
+    const auto sample4 = PhaseSpaceMonitor::sample(1000000, 5000, 7);
+    const auto other = PhaseSpaceMonitor::sample(1000000, 5000, 8);
+    omp_set_num_threads(threads);
+
+    ASSERT_EQ(sample, sample4);
+    ASSERT_NE(sample, other);
+
+    ASSERT_EQ(5000u, sample.size());
+    ASSERT_TRUE(is_sorted(sample.begin(), sample.end()));
+    ASSERT_TRUE(adjacent_find(sample.begin(), sample.end()) == sample.end());
+    ASSERT_GE(sample.front(), 0);
+    ASSERT_LT(sample.back(), 1000000);
+    ASSERT_EQ(mymath::arange(0, 10), PhaseSpaceMonitor::sample(10, 20));
+}
+
+
+TEST_F(testMonitors, PhaseSpaceMonitor1)
+{
+    auto GP = Context::GP;
+    auto RfP = Context::RfP;
+    auto Beam = Context::Beam;
+    auto filename = "phase_space.h5";
+    auto floatfile = "phase_space_float.h5";
+    const int every = 100, n_turns = 1000, n_sample = 500;
+
+    longitudinal_bigaussian(GP, RfP, Beam, tau_0 / 4, 0, 1, false);
+    Beam->id[3] = 0;
+    auto tracker = RingAndRfSection();
+    // The constructors take the snapshot of turn 0
+    PhaseSpaceMonitor monitor(GP, RfP, Beam, filename, every);
+    PhaseSpaceMonitor floatMonitor(GP, RfP, Beam, floatfile, every,
+                                   n_sample, true);
+    ASSERT_EQ(N_t / every + 1, monitor.fNSnapshots);
+
+    f_vector_t dt, dE;
+    for (int i = 0; i < n_turns; i++) {
+        tracker.track();
+        monitor.track();
+        floatMonitor.track();
+        if (RfP->counter == 300) {
+            dt = Beam->dt;
+            dE = Beam->dE;
+        }
+    }
+    monitor.close();
+    floatMonitor.close();
+
+    hsize_t dims[2];
+    int *turn = (int *) read_1D(filename, "PhaseSpace/turn", "int", dims);
+    ASSERT_EQ((hsize_t) N_t / every + 1, dims[0]);
+    for (uint i = 0; i < dims[0]; i++)
+        ASSERT_EQ((int) i * every <= n_turns ? (int) i * every : -1, turn[i]);
+    free(turn);
+
+    double *real = (double *) read_2D(filename, "PhaseSpace/dt", "double",
+                                      dims);
+    ASSERT_EQ((hsize_t) N_p, dims[1]);
+    ASSERT_EQ(dt, f_vector_t(real + 3 * N_p, real + 4 * N_p));
+    free(real);
+    int *id = (int *) read_2D(filename, "PhaseSpace/id", "int", dims);
+    ASSERT_EQ(0, id[3 * N_p + 3]);
+    ASSERT_EQ(1, id[3 * N_p + 4]);
+    free(id);
+
+    // The sample as floats
+    int *index = (int *) read_1D(floatfile, "PhaseSpace/index", "int", dims);
+    ASSERT_EQ(floatMonitor.fSample, int_vector_t(index, index + dims[0]));
+    ASSERT_EQ(PhaseSpaceMonitor::sample(N_p, n_sample), floatMonitor.fSample);
+    float *realF = (float *) read_2D(floatfile, "PhaseSpace/dE", "float",
+                                     dims);
+    ASSERT_EQ((hsize_t) n_sample, dims[1]);
+    for (int i = 0; i < n_sample; i++)
+        ASSERT_EQ((float) dE[index[i]], realF[3 * n_sample + i]);
+    free(realF);
+    free(index);
+
+    remove(filename);
+    remove(floatfile);
+}
+
+
 int main(int ac, char *av[])
 {
     ::testing::InitGoogleTest(&ac, av);
@@ -475,7 +475,7 @@ TEST_F(testTrackerPeriodicity, set_periodicity1)
             RingAndRfSection::simple, NULL, NULL, true, 0.0);
 
     auto mean = mymath::mean(Beam->dt.data(), Beam->dt.size());
-    Context::GP->t_rev[Context::RfP->counter + 1] = mean;
+    Context::GP->t_rev.set(Context::RfP->counter + 1, mean);
 
     long_tracker->set_periodicity();
 
@@ -513,7 +513,7 @@ TEST_F(testTrackerPeriodicity, track1)
     auto params = std::string(TEST_FILES "/Tracker/periodicity/track1/");
 
     auto mean = mymath::mean(Beam->dt.data(), Beam->dt.size());
-    Context::GP->t_rev[Context::RfP->counter + 1] = mean;
+    Context::GP->t_rev.set(Context::RfP->counter + 1, mean);
 
     auto long_tracker = new RingAndRfSection(Context::RfP, Beam,
             RingAndRfSection::simple, NULL, NULL, true, 0.0);
@@ -345,6 +345,98 @@ TEST_F(testTrackerUtilities, is_in_separatrix1)
 
 
 
+TEST_F(testTrackerUtilities, separatrix_losses1)
+{
+    auto GP = Context::GP;
+    auto Beam = Context::Beam;
+    auto RfP = Context::RfP;
+
+    int i = 0;
+    for (auto &t : Beam->dt)
+        t += (3.0 * (i++) / N_p) * t;
+    for (auto &e : Beam->dE)
+        e *= 4;
+    RfP->counter = 100;
+
+    // The same as with the Hamiltonian of all the particles
+    const auto ham = hamiltonian(GP, RfP, Beam, Beam->dt.data(),
+                                 Beam->dE.data(), N_p);
+    const double dt_sep = (constant::pi - RfP->phi_s[100]
+                           - RfP->phi_rf[0][100]) / RfP->omega_rf[0][100];
+    const double Hsep = std::abs(hamiltonian(GP, RfP, Beam, dt_sep, 0.0));
+
+    Beam->id[7] = 0;
+    const int_vector_t id = Beam->id;
+    Beam->losses_separatrix(GP, RfP);
+
+    int lost = 0;
+    for (int i = 0; i < N_p; ++i) {
+        ASSERT_EQ(id[i] * (std::abs(ham[i]) < Hsep), Beam->id[i])
+                << "Testing of id failed on i " << i << "\n";
+        lost += Beam->id[i] == 0;
+    }
+    ASSERT_GT(lost, 1);
+    ASSERT_LT(lost, N_p);
+    ASSERT_EQ(0, Beam->id[7]);
+}
+
+
+TEST(testSeparatrix, double_harmonic)
+{
+    // Stationary bucket with a second harmonic of half the voltage: the
+    // potential is (1 + cos(phi)) + (1 - cos(2 phi)) / 4 in units of the one
+    // of the main harmonic. The barriers at 0 and 2 pi are the same, but at
+    // pi / 2 the well is 1.5 instead of 1 out of 2.
+    const int N_t = 10;
+    const double h = 35640, V = 6e6, p = 450e9;
+    const double alpha = 1. / 55.759505 / 55.759505;
+    f_vector_2d_t momentumVec(1, f_vector_t(N_t + 1, p));
+    f_vector_2d_t alphaVec(1, f_vector_t(2, alpha));
+    f_vector_t CVec(1, 26658.883);
+    auto GP = new GeneralParameters(N_t, CVec, alphaVec, 1, momentumVec,
+                                    GeneralParameters::particle_t::proton);
+    auto Beam = new Beams(GP, 1, 1e9);
+
+    auto RfP1 = new RfParameters(GP, 1, f_vector_2d_t(1, f_vector_t(N_t + 1, h)),
+                                 f_vector_2d_t(1, f_vector_t(N_t + 1, V)),
+                                 f_vector_2d_t(1, f_vector_t(N_t + 1, 0)));
+    f_vector_2d_t hVec = {f_vector_t(N_t + 1, h), f_vector_t(N_t + 1, 2 * h)};
+    f_vector_2d_t voltageVec = {f_vector_t(N_t + 1, V),
+                                f_vector_t(N_t + 1, V / 2)
+                               };
+    f_vector_2d_t dphiVec = {f_vector_t(N_t + 1, 0),
+                             f_vector_t(N_t + 1, constant::pi)
+                            };
+    auto RfP2 = new RfParameters(GP, 2, hVec, voltageVec, dphiVec);
+
+    const double omega = RfP1->omega_rf[0][0];
+    const double c1 = hamiltonian(GP, RfP1, Beam, constant::pi / omega, 1.0);
+    const double Hsep = std::abs(hamiltonian(GP, RfP1, Beam, 0.0, 0.0));
+    const double dE_max = std::sqrt(Hsep / std::abs(c1));
+
+    const f_vector_t dt = {constant::pi / omega, constant::pi / omega,
+                           constant::pi / 2 / omega, constant::pi / 2 / omega,
+                           constant::pi / 2 / omega
+                          };
+    const f_vector_t dE = {0.99 * dE_max, 1.01 * dE_max, 0.45 * dE_max,
+                           0.6 * dE_max, 0.75 * dE_max
+                          };
+    int_vector_t id1(dt.size(), 1), id2(dt.size(), 1);
+    separatrix_losses(GP, RfP1, Beam, dt.data(), dE.data(), id1.data(),
+                      dt.size());
+    separatrix_losses(GP, RfP2, Beam, dt.data(), dE.data(), id2.data(),
+                      dt.size());
+
+    ASSERT_EQ(int_vector_t({1, 0, 1, 1, 0}), id1);
+    ASSERT_EQ(int_vector_t({1, 0, 1, 0, 0}), id2);
+
+    delete RfP2;
+    delete RfP1;
+    delete Beam;
+    delete GP;
+}
+
+
 TEST(testMinMax, minmax_location1)
 {
     auto epsilon = 1e-8;